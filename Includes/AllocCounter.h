@@ -0,0 +1,8 @@
+#pragma once
+// AllocCounter.h
+// The global operator new and new[] are replaced by ones that count every
+// allocation of the process, made on any thread. The difference between two
+// readings is the number of allocations in between.
+#include "Main.h"
+
+LONG GetAllocationCount();
@@ -0,0 +1,137 @@
+#pragma once
+// AssetLoader.h
+// Background loading of sprite bitmaps. Requests return a handle at once,
+// worker threads decode the bitmap (and its transparency mask) and mark the
+// handle ready. Handles are reference counted and cached by name, so every
+// sprite using the same file shares one bitmap.
+#include "Main.h"
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#define LOADER_MAX_THREADS		4
+#define LOADER_DEFAULT_THREADS	2
+
+enum EAssetState
+{
+	ASSET_PENDING,
+	ASSET_READY,
+	ASSET_FAILED
+};
+
+class CBitmapAsset
+{
+	friend class CAssetLoader;
+
+public:
+	// Wrap an already loaded bitmap (resources), the handle owns it
+	static CBitmapAsset* FromBitmap(HBITMAP hBitmap);
+
+	void AddRef() { InterlockedIncrement(&m_lRefs); }
+	void Release();
+
+	bool IsReady() const { return m_lState == ASSET_READY; }
+	EAssetState State() const { return (EAssetState)m_lState; }
+
+	HBITMAP Bitmap() const { return m_hBitmap; }
+	HBITMAP TransparencyMask() const { return m_hMask; }	// 1 where the transparent colour is
+
+	// Known when AcquireBitmap returns, read from the header in the pack or
+	// the file, usually before the pixels are
+	int Width() const { return m_iWidth; }
+	int Height() const { return m_iHeight; }
+
+private:
+	CBitmapAsset(const char *szName, COLORREF crTransparent);
+	~CBitmapAsset();
+
+	CBitmapAsset(const CBitmapAsset& rhs);
+	CBitmapAsset& operator=(const CBitmapAsset& rhs);
+
+	char m_szName[MAX_PATH];
+	COLORREF m_crTransparent;	// CLR_INVALID when no mask is needed
+	int m_iStep;				// rotated by m_iStep / m_iSteps of a turn
+	int m_iSteps;
+	volatile LONG m_lRefs;
+	volatile LONG m_lState;
+	HBITMAP m_hBitmap;
+	HBITMAP m_hMask;
+	int m_iWidth;
+	int m_iHeight;
+	__int64 m_iRequestTime;		// performance counter when queued
+
+	// hot reload, decoded by a worker and swapped in by ApplyReloads
+	bool m_bReload;
+	HBITMAP m_hNextBitmap;
+	HBITMAP m_hNextMask;
+	int m_iNextWidth;
+	int m_iNextHeight;
+};
+
+typedef struct
+{
+	UINT uQueueDepth;			// requests waiting for a worker
+	UINT uMaxQueueDepth;
+	UINT uRequests;				// AcquireBitmap calls
+	UINT uCacheHits;
+	UINT uLoaded;
+	UINT uFailed;
+	UINT uReloaded;				// bitmaps swapped by hot reload
+	float fAvgLatency;			// request to ready, in milliseconds
+	float fMaxLatency;
+} sLoaderStats;
+
+class CAssetLoader
+{
+public:
+	CAssetLoader();
+	~CAssetLoader();
+
+	// Without started workers requests are loaded on the calling thread
+	bool Start(int iThreads = LOADER_DEFAULT_THREADS);
+	void Shutdown();
+
+	// Handle to the bitmap, the caller owns one reference.
+	// A crTransparent other than CLR_INVALID also builds the transparency mask.
+	// iStep / iSteps rotates the image clockwise by that fraction of a full
+	// turn, the rotated copy is built once and cached like any other bitmap.
+	CBitmapAsset* AcquireBitmap(const char *szFileName, COLORREF crTransparent = CLR_INVALID, int iStep = 0, int iSteps = 1);
+
+	// Wait until every queued request has been loaded
+	bool WaitIdle(DWORD dwTimeout = INFINITE);
+
+	// Decode a changed file again, from disk, for every cached variant of it.
+	// Sprites keep drawing the old bitmap until ApplyReloads swaps the new one
+	// in, which the game thread calls between frames. Returns the number of
+	// variants queued.
+	UINT Reload(const char *szFileName);
+	void ApplyReloads();
+
+	void GetStats(sLoaderStats &stats);
+
+private:
+	CAssetLoader(const CAssetLoader& rhs);
+	CAssetLoader& operator=(const CAssetLoader& rhs);
+
+	static DWORD WINAPI WorkerProc(LPVOID lpParam);
+	static void MakeKey(const char *szFileName, char *szKey, size_t uKeySize);
+	void Load(CBitmapAsset *pAsset);
+	void ReadSize(CBitmapAsset *pAsset);
+
+	CRITICAL_SECTION m_cs;
+	HANDLE m_hWork;				// semaphore counting queued requests
+	HANDLE m_hIdle;				// manual reset, set while nothing is queued or loading
+	LONG m_lBusy;				// queued and loading requests, guarded by m_cs
+	HANDLE m_hThreads[LOADER_MAX_THREADS];
+	int m_iThreadCount;
+	volatile LONG m_lQuit;
+
+	std::deque<CBitmapAsset*> m_Queue;
+	std::map<std::string, CBitmapAsset*> m_Cache;
+	std::vector<CBitmapAsset*> m_Reloaded;		// waiting for ApplyReloads
+
+	sLoaderStats m_Stats;
+	double m_dTotalLatency;
+	__int64 m_iFrequency;
+};
@@ -0,0 +1,74 @@
+#pragma once
+// AssetPack.h
+// Single file pack of the game data, mapped once and read in place.
+//
+// Layout: sPackHeader, then uEntryCount sPackEntry records sorted by name,
+// then the file contents, each starting on a PACK_ALIGNMENT boundary.
+// Names are stored lower case with '/' separators ("data/explosion.bmp").
+// Bitmaps may be stored as 8 bpp palette bitmaps, see EPackIndexing.
+#include "Main.h"
+#include "MappedFile.h"
+
+#define PACK_MAGIC			0x4B415047	// "GPAK"
+#define PACK_VERSION		1
+#define PACK_MAX_NAME		56
+#define PACK_ALIGNMENT		16
+#define PACK_DEFAULT_FILE	"Data.pak"
+#define PACK_DEFAULT_DIR	"Data"
+
+enum EAssetFormat
+{
+	ASSET_RAW,
+	ASSET_BMP,
+	ASSET_WAV,
+	ASSET_BMP_INDEXED		// converted to 8 bpp when the pack was built
+};
+
+// How Build stores true colour bitmaps
+enum EPackIndexing
+{
+	PACK_INDEX_NONE,		// as they are
+	PACK_INDEX_LOSSLESS,	// 8 bpp when they use at most 256 colours
+	PACK_INDEX_QUANTIZE		// always 8 bpp, reduced to 256 colours when needed
+};
+
+typedef struct
+{
+	uint32_t uMagic;
+	uint32_t uVersion;
+	uint32_t uEntryCount;
+	uint32_t uReserved;
+} sPackHeader;
+
+typedef struct
+{
+	char szName[PACK_MAX_NAME];
+	uint32_t uOffset;
+	uint32_t uSize;
+	uint32_t uFormat;		// EAssetFormat
+	uint32_t uReserved;
+} sPackEntry;
+
+class CAssetPack
+{
+public:
+	CAssetPack();
+
+	bool Open(const char *szPackFile);
+	void Close();
+	bool IsOpen() const { return m_pEntries != NULL; }
+
+	// Case insensitive lookup of a game path such as "data/PlaneImg.bmp".
+	// On success the view points into the mapped pack and stays valid until Close.
+	bool Find(const char *szName, const uint8_t **ppData, size_t *puSize, EAssetFormat *pFormat = NULL) const;
+
+	// Pack the .bmp and .wav files found in szDirectory into szPackFile
+	static bool Build(const char *szDirectory, const char *szPackFile, EPackIndexing eIndexing = PACK_INDEX_LOSSLESS);
+
+private:
+	static void NormalizeName(const char *szName, char *szOut);
+
+	CMappedFile m_File;
+	const sPackEntry *m_pEntries;
+	uint32_t m_uEntryCount;
+};
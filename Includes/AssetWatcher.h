@@ -0,0 +1,46 @@
+#pragma once
+// AssetWatcher.h
+// Watches the data folder for changed bitmaps so they can be reloaded while
+// the game runs. A thread waits on ReadDirectoryChangesW and records the
+// changed names, the game thread collects them between frames once a file
+// has been quiet for a moment, editors write a file in several steps.
+#include "Main.h"
+#include <map>
+#include <string>
+#include <vector>
+
+#define WATCH_SETTLE_TIME		200		// ms a file must be quiet before it is reported
+#define WATCH_BUFFER_SIZE		16384
+
+class CAssetWatcher
+{
+public:
+	CAssetWatcher();
+	~CAssetWatcher();
+
+	bool Start(const char *szDirectory);
+	void Shutdown();
+
+	// Fill files with the changed bitmaps that have settled, as lower case
+	// "directory/name.bmp" paths. Returns false when there are none.
+	bool Poll(std::vector<std::string> &files);
+
+private:
+	CAssetWatcher(const CAssetWatcher& rhs);
+	CAssetWatcher& operator=(const CAssetWatcher& rhs);
+
+	static DWORD WINAPI WatchProc(LPVOID lpParam);
+	void Record(const FILE_NOTIFY_INFORMATION *pInfo);
+
+	char m_szDirectory[MAX_PATH];
+
+	CRITICAL_SECTION m_cs;
+	HANDLE m_hDirectory;
+	HANDLE m_hQuit;
+	HANDLE m_hThread;
+
+	// guarded by m_cs, name to time of the last change
+	std::map<std::string, DWORD> m_Changed;
+
+	DWORD m_dwBuffer[WATCH_BUFFER_SIZE / sizeof(DWORD)];	// notifications are DWORD aligned
+};
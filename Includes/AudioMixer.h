@@ -0,0 +1,149 @@
+#pragma once
+// AudioMixer.h
+// Software mixer playing any number of sound clips at once. A single audio
+// thread sums the active voices into blocks of the sink's ring, the game
+// thread only queues commands, so no thread is created per sound. Commands
+// go through a lock free queue drained once per block, triggering a sound
+// never waits for the audio thread.
+// Clips are normally converted to the mixer rate when they are loaded, see
+// CSoundCache::SetConversion, any other clip is resampled by linear
+// interpolation while mixing.
+// Each voice is first resampled into a float block, then added to the stereo
+// mix with its left and right gains four samples per SSE instruction, so the
+// cost per voice stays a short pass over one block.
+//
+// Voices are managed on the audio thread. A trigger of a clip that started
+// on another voice moments ago is merged into that voice, which gets louder
+// instead. When the voice budget is used up the least important voice, by
+// priority and then by loudness, is stopped for the new sound, or the new
+// sound is dropped if it matters less than everything playing.
+#include "Main.h"
+#include "AudioSink.h"
+#include "SoundCache.h"
+#include "SpscQueue.h"
+
+#define MIXER_RATE				44100
+#define MIXER_CHANNELS			2
+#define MIXER_VOICES			64
+#define MIXER_BLOCK_FRAMES		512		// 11.6 ms at 44.1 kHz
+#define MIXER_BLOCKS			4		// blocks queued in the sink, the output latency
+#define MIXER_COMMANDS			256		// commands queued between two blocks
+#define MIXER_MERGE_BLOCKS		4		// identical triggers this close are merged, about 46 ms
+#define MIXER_MAX_GAIN			512		// 8.8 fixed point, merged voices grow up to twice as loud
+
+typedef struct
+{
+	UINT uPlays;
+	UINT uQueueFull;			// commands lost to a full queue
+	UINT uDropped;				// triggers less important than every playing voice
+	UINT uMerged;				// triggers merged into a voice playing the same clip
+	UINT uStolen;				// voices cut off to start a new sound
+	UINT uActive;				// voices playing in the last block
+	UINT uPeak;
+	UINT uBlocks;
+	float fAvgMixMs;			// time to mix a block
+	float fMaxMixMs;
+} sMixerStats;
+
+class CAudioMixer
+{
+public:
+	CAudioMixer();
+	~CAudioMixer();
+
+	// The mixer owns the sink from here on, it is deleted when Start fails
+	bool Start(IAudioSink *pSink);
+	void Shutdown();
+
+	// False before Start and once the sink has failed
+	bool IsRunning() const { return m_hThread && !m_lFailed; }
+
+	// Commands are called from the game thread only.
+	// Start a clip, iPriority takes ESoundPriority values. fPan goes from -1
+	// for the left speaker to 1 for the right one, fGain from 0 to 1.
+	bool Play(const sSoundClip *pClip, int iPriority = SOUND_PRIORITY_NORMAL, bool bLoop = false,
+		float fPan = 0.0f, float fGain = 1.0f);
+	// Stop every voice playing pClip
+	void Stop(const sSoundClip *pClip);
+	void StopAll();
+	// 0 to 1, applied to the whole mix
+	void SetMasterGain(float fGain);
+	// Voices that may play at once, at most MIXER_VOICES
+	void SetVoiceBudget(int iVoices);
+
+	void GetStats(sMixerStats &stats) const;
+
+private:
+	CAudioMixer(const CAudioMixer& rhs);
+	CAudioMixer& operator=(const CAudioMixer& rhs);
+
+	enum ECommand { MIX_PLAY, MIX_STOP, MIX_STOP_ALL, MIX_MASTER_GAIN, MIX_VOICE_BUDGET };
+
+	typedef struct
+	{
+		ECommand eCommand;
+		const sSoundClip *pClip;
+		bool bLoop;
+		int iValue;				// priority of a play, gain or budget
+		float fPan;
+		float fGain;
+	} sCommand;
+
+	typedef struct
+	{
+		const sSoundClip *pClip;	// NULL while the voice is free
+		__int64 iPos;				// frames into the clip, 32.32 fixed point
+		__int64 iStep;				// clip rate over mixer rate, 32.32 fixed point
+		bool bLoop;
+		int iPriority;
+		int iGain;					// 8.8 fixed point, raised by merged triggers
+		float fPan;					// -1 left to 1 right
+		float fGain;				// from the position of the emitter
+		float fLeft;				// gains applied while mixing
+		float fRight;
+		UINT uStarted;				// block the voice started in
+	} sVoice;
+
+	static DWORD WINAPI MixProc(LPVOID lpParam);
+	bool Send(const sCommand &cmd);
+	void Execute(const sCommand &cmd);
+	void StartVoice(const sCommand &cmd);
+	sVoice* FindWeakest();
+	static __int64 Importance(int iPriority, int iGain, float fGain, const sSoundClip *pClip);
+	static void UpdateGains(sVoice &voice);
+	UINT MixBlock(short *pOut);
+	static UINT ResampleVoice(sVoice &voice, float *pOut, UINT uFrames);
+
+	IAudioSink *m_pSink;
+	HANDLE m_hThread;
+	volatile LONG m_lQuit;
+	volatile LONG m_lFailed;
+
+	CSpscQueue<sCommand, MIXER_COMMANDS> m_Commands;
+
+	// game thread only
+	UINT m_uPlays;
+	UINT m_uQueueFull;
+
+	// written by the audio thread, read by GetStats without a lock
+	volatile LONG m_lDropped;
+	volatile LONG m_lMerged;
+	volatile LONG m_lStolen;
+	volatile LONG m_lActive;
+	volatile LONG m_lPeak;
+	volatile LONG m_lBlocks;
+	volatile LONG m_lAvgMixUs;
+	volatile LONG m_lMaxMixUs;
+
+	// audio thread only
+	sVoice m_Voices[MIXER_VOICES];
+	alignas(16) float m_fMix[MIXER_BLOCK_FRAMES * MIXER_CHANNELS];
+	alignas(16) float m_fVoice[MIXER_BLOCK_FRAMES * 2];	// one voice, at most stereo
+	float m_fMasterGain;
+	int m_iBudget;
+	UINT m_uBlock;
+	double m_dTotalMixUs;
+	__int64 m_iFrequency;
+};
+
+extern CAudioMixer g_AudioMixer;
@@ -0,0 +1,91 @@
+#pragma once
+// AudioSink.h
+// Outputs for the software mixer. The mixer asks the sink for a free block,
+// mixes into it and hands it back. The sink decides when there is room for
+// the next block, which paces the mixer thread.
+//
+// CWaveOutSink	plays through the waveOut device, blocks form a ring of buffers
+// CWavFileSink	writes the mix to a WAV file, for runs without a sound card
+// CNullSink	throws the mix away
+#include "Main.h"
+#include <stdio.h>
+#include <vector>
+
+#define SINK_WAIT_TIMEOUT		500		// ms without a finished block before the device counts as stalled
+
+class IAudioSink
+{
+public:
+	virtual ~IAudioSink() {}
+
+	virtual bool Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks) = 0;
+	virtual void Close() = 0;
+
+	// Wait for a free block of uBlockFrames frames, NULL when the sink failed
+	virtual short* Lock() = 0;
+	// Queue the block returned by the last Lock
+	virtual bool Submit() = 0;
+};
+
+class CWaveOutSink : public IAudioSink
+{
+public:
+	CWaveOutSink();
+	virtual ~CWaveOutSink();
+
+	virtual bool Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks);
+	virtual void Close();
+	virtual short* Lock();
+	virtual bool Submit();
+
+private:
+	HWAVEOUT m_hWaveOut;
+	HANDLE m_hDone;				// signalled by the driver when a block has played
+	std::vector<WAVEHDR> m_Headers;
+	std::vector<short> m_Buffer;
+	UINT m_uNext;
+};
+
+// File and null sinks keep to real time unless told otherwise, so sounds
+// land in the file where the game played them
+class CWavFileSink : public IAudioSink
+{
+public:
+	CWavFileSink(const char *szFileName, bool bRealTime = true);
+	virtual ~CWavFileSink();
+
+	virtual bool Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks);
+	virtual void Close();
+	virtual short* Lock();
+	virtual bool Submit();
+
+private:
+	char m_szFileName[MAX_PATH];
+	FILE *m_pFile;
+	WAVEFORMATEX m_wfx;
+	std::vector<short> m_Block;
+	UINT m_uBlockFrames;
+	UINT m_uDataBytes;
+	bool m_bRealTime;
+	DWORD m_dwStart;
+	__int64 m_iFrames;			// written since Open
+};
+
+class CNullSink : public IAudioSink
+{
+public:
+	CNullSink(bool bRealTime = true);
+
+	virtual bool Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks);
+	virtual void Close();
+	virtual short* Lock();
+	virtual bool Submit();
+
+private:
+	std::vector<short> m_Block;
+	UINT m_uBlockFrames;
+	UINT m_uRate;
+	bool m_bRealTime;
+	DWORD m_dwStart;
+	__int64 m_iFrames;
+};
@@ -0,0 +1,82 @@
+#pragma once
+// AutoSave.h
+// Background writer for world snapshots. The game thread hands over a
+// finished snapshot buffer by swapping it with an idle one, a worker thread
+// writes it to a temporary file, flushes it to disk and renames it over the
+// save. Between full saves only the 4KB blocks that differ from the last full
+// save are written, to a delta file next to it.
+#include "Main.h"
+#include <vector>
+
+#define AUTOSAVE_INTERVAL		15000	// ms between autosaves
+#define AUTOSAVE_FULL_EVERY		8		// deltas before a full save is forced
+
+typedef struct
+{
+	UINT uFullSaves;
+	UINT uDeltaSaves;
+	UINT uFailed;
+	UINT uLastBytes;			// bytes written by the last save
+	float fLastWriteMs;			// write, flush and rename
+	float fMaxWriteMs;
+} sAutoSaveStats;
+
+class CAutoSave
+{
+public:
+	CAutoSave();
+	~CAutoSave();
+
+	// Without a running thread Submit writes on the calling thread
+	bool Start(const char *szFileName);
+	void Shutdown();
+
+	// Take the snapshot in image and queue it for writing. image is given an
+	// older buffer back, so the caller can reuse its capacity. A newer submit
+	// replaces one that has not been written yet. Returns false when the last
+	// write failed.
+	bool Submit(std::vector<BYTE> &image, bool bFull = false);
+
+	// Wait until everything submitted is on disk. Returns false when the
+	// last write failed.
+	bool Flush();
+
+	void GetStats(sAutoSaveStats &stats);
+
+	// Read a save with its delta applied, if the delta matches the save
+	static bool Read(const char *szFileName, std::vector<BYTE> &image);
+
+private:
+	CAutoSave(const CAutoSave& rhs);
+	CAutoSave& operator=(const CAutoSave& rhs);
+
+	static DWORD WINAPI WriterProc(LPVOID lpParam);
+	bool Write(const std::vector<BYTE> &image, bool bFull);
+	bool WriteFull(const std::vector<BYTE> &image);
+	bool WriteDelta(const std::vector<BYTE> &image, const std::vector<UINT> &blocks);
+
+	char m_szFileName[MAX_PATH];
+	char m_szDeltaName[MAX_PATH];
+
+	CRITICAL_SECTION m_cs;
+	HANDLE m_hWake;				// auto reset, set by Submit
+	HANDLE m_hIdle;				// manual reset, set while nothing is queued
+	HANDLE m_hThread;
+	volatile LONG m_lQuit;
+
+	// guarded by m_cs
+	std::vector<BYTE> m_Pending;
+	bool m_bPending;
+	bool m_bPendingFull;
+	bool m_bFailed;
+	sAutoSaveStats m_Stats;
+
+	// writer side only
+	std::vector<BYTE> m_Writing;
+	std::vector<BYTE> m_Base;	// contents of the last full save
+	std::vector<BYTE> m_Delta;
+	std::vector<UINT> m_Blocks;
+	UINT m_uBaseHash;
+	UINT m_uDeltas;				// delta saves since the last full one
+	__int64 m_iFrequency;
+};
@@ -15,6 +15,10 @@ public:
 	void reset();
 
 	HDC getDC() const { return mhDC; }
+	// Memory DCs shared by all the sprites drawn to this buffer, a sprite
+	// selects its bitmaps into them and restores them when done
+	HDC getSpriteDC() const { return mhSpriteDC; }
+	HDC getMaskDC() const { return mhMaskDC; }
 	HWND getHWND() const { return mhWnd; }
 
 	int width() const { return mWidth; }
@@ -34,6 +38,8 @@ private:
 private:
 	HWND mhWnd;
 	HDC mhDC;
+	HDC mhSpriteDC;
+	HDC mhMaskDC;
 	HBITMAP mhSurface;
 	HBITMAP mhOldObject;
 	int mWidth;
@@ -0,0 +1,73 @@
+#pragma once
+// BmpDecoder.h
+// Windows bitmap decoder working straight on the file bytes (usually a
+// CMappedFile view). It does not depend on windows.h so it builds anywhere.
+#include <stddef.h>
+#include <stdint.h>
+
+// Uncompressed 1, 4, 8 bpp palette images, 16 bpp (555, 565 or any bit fields),
+// 24 bpp and 32 bpp (plain or bit fields), stored bottom-up or top-down.
+// The output is 32 bit BGRX (the RGBQUAD layout) with the unused byte set to 0.
+class CBmpDecoder
+{
+public:
+	CBmpDecoder();
+
+	// Validate the headers and locate the palette and pixel data.
+	// The bytes must stay valid while rows are decoded.
+	bool Parse(const uint8_t *pData, size_t uSize);
+
+	int Width() const { return m_iWidth; }
+	int Height() const { return m_iHeight; }
+	int BitCount() const { return m_iBitCount; }
+	bool IsTopDown() const { return m_bTopDown; }
+
+	// Decode the whole image into a Width() * Height() buffer of bottom-up rows
+	void Decode(uint32_t *pDst) const;
+
+	// Decode the iRow-th row in file order (the bottom one first unless the
+	// image is top-down) into Width() pixels
+	void DecodeRow(int iRow, uint32_t *pDst) const;
+
+	// Entries of the palette (BGRX), 0 for images without one
+	int PaletteSize() const { return m_eFormat == FMT_PALETTE ? m_iColors : 0; }
+	const uint32_t* Palette() const { return m_uPalette; }
+
+	// Copy the indices of an 8 bpp image into bottom-up rows of uStride
+	// bytes, the layout of an 8 bpp DIB section
+	bool DecodeIndices(uint8_t *pDst, size_t uStride) const;
+
+private:
+	enum EFormat
+	{
+		FMT_PALETTE,
+		FMT_RGB555,
+		FMT_RGB565,
+		FMT_BITFIELDS16,
+		FMT_RGB24,
+		FMT_RGB32,
+		FMT_BITFIELDS32
+	};
+
+	typedef struct
+	{
+		uint32_t uMask;
+		int iShift;
+		int iBits;
+	} sChannel;
+
+	static void SetupChannel(sChannel &chn, uint32_t uMask);
+	static uint32_t ExpandChannel(const sChannel &chn, uint32_t uPixel);
+
+	const uint8_t *m_pBits;		// first row in file order
+	size_t m_uStride;
+	int m_iWidth;
+	int m_iHeight;
+	int m_iBitCount;
+	bool m_bTopDown;
+	EFormat m_eFormat;
+	sChannel m_Channels[3];		// red, green, blue
+	uint32_t m_uPalette[256];
+	int m_iColors;
+	uint8_t m_uLut[3][16];		// blue, green and red of the first 16 entries
+};
@@ -21,10 +21,14 @@
 #include "ImageFile.h"
 #include <vector>
 #include "Crate.h"
-#include <stdlib.h>     /* srand, rand */
 #include "Heart.h"
 #include "Enemy.h"
 #include "EnemyBullet.h"
+#include "Snapshot.h"
+#include "AutoSave.h"
+#include "AssetWatcher.h"
+#include "QualityGovernor.h"
+#include "PerfOverlay.h"
 
 
 
@@ -62,6 +66,7 @@ private:
 	// Private Functions for This Class
 	//-------------------------------------------------------------------------
 	bool		BuildObjects	  ( );
+	void		PreloadAssets	  ( );
 	void		ReleaseObjects	( );
 	void		FrameAdvance	  ( );
 	bool		CreateDisplay	 ( );
@@ -73,9 +78,22 @@ private:
 	void		PlaneCollision();
 	void		CrateCollision();
 	void		HeartCollision();
+	void		BulletCollision();
 	void		DrawBackground();
 	void		Spawn();
 	void		Delete();
+	UINT		Random();
+
+	void		BuildSnapshot(std::vector<BYTE>& buffer);
+	bool		ApplySnapshot(const BYTE* pData, size_t uSize);
+	bool		SaveSnapshot(bool bFull);
+	bool		LoadSnapshot();
+	void		ReloadChangedAssets();
+	void		UpdateWorld();
+	void		EnterIdle();
+	void		LeaveIdle();
+	void		IdleWait();
+	void		ApplyQuality();
 
 
 
@@ -90,13 +108,25 @@ private:
 	// Private Variables For This Class
 	//-------------------------------------------------------------------------
 	CTimer				  m_Timer;			// Game timer
-	ULONG				   m_LastFrameRate;	// Used for making sure we update only when fps changes.
+	int						m_LastLives;		// The title is only set again when these change
+	int						m_LastScore;
+	float					m_LockFPS;			// Frame rate cap, 0 runs uncapped (F5 cycles it, F6 the limiter)
 	
 	HWND					m_hWnd;			 // Main window HWND
 	HICON				   m_hIcon;			// Window Icon
 	HMENU				   m_hMenu;			// Window Menu
 	
 	bool					m_bActive;		  // Is the application active ?
+	bool					m_bForeground;		// Does it have the focus ?
+
+	bool					m_bIdle;			// Minimized or in the background, nothing is drawn at full rate
+	float					m_IdleTickRate;		// World steps per second while idle, 0 pauses the game (-idletick <rate>)
+	HANDLE					m_hIdleTimer;		// Paces the idle steps
+	ULONG					m_IdleWakeups;		// Times the idle loop woke up
+	__int64					m_IdleStartTime;	// Wall clock and process CPU time when idling began (100 ns)
+	__int64					m_IdleStartCpu;
+	float					m_IdleCpuPercent;	// Measured over the last idle period
+	float					m_IdleWakeupRate;
 
 	ULONG				   m_nViewX;		   // X Position of render viewport
 	ULONG				   m_nViewY;		   // Y Position of render viewport
@@ -107,6 +137,11 @@ private:
 	HINSTANCE				m_hInstance;
 
 	CImageFile				m_imgBackground;
+	CImageFile				m_imgBackgroundSmall;	// Reduced copy drawn at the lower quality levels
+
+	CQualityGovernor		m_Governor;			// Trades detail for frame time (F7 turns it off)
+	CPerfOverlay			m_Overlay;			// Frame time breakdown drawn over the game (F3)
+	ULONG					m_CollisionPairs;	// Tests made this frame
 
 	
 	CPlayer*				m_pPlayer;
@@ -123,6 +158,15 @@ private:
 	__int64 m_EnemySpawnTime= timeGetTime();
 	__int64 m_EnemyShootTime = timeGetTime();
 
+	UINT					m_uRandomState;		// spawn position generator, saved with the world
+
+	CAutoSave				m_AutoSave;
+	std::vector<BYTE>		m_SaveBuffer;		// reused for every snapshot
+	__int64					m_AutoSaveTime = timeGetTime();
+
+	CAssetWatcher			m_AssetWatcher;		// reports edited bitmaps in the data folder
+	std::vector<std::string> m_ChangedFiles;
+
 
 };
 
@@ -15,6 +15,7 @@
 //-----------------------------------------------------------------------------
 #include "Main.h"
 #include "Sprite.h"
+#include "Snapshot.h"
 #include "Bullet.h"
 #include <vector>
 #include "EnemyBullet.h"
@@ -68,6 +69,8 @@ public:
 
 	void					Explode();
 	bool					AdvanceExplosion();
+	void					SaveState(sPlayerRecord& rec) const;
+	void					LoadState(const sPlayerRecord& rec);
 
 	bool					GetShot(Bullet& bullet);
 	bool					GetShotEnemy(EnemyBullet& bullet);
@@ -84,10 +87,14 @@ public:
 
 
 private:
+	void					SetRotation(int iIndex);
+
 	//-------------------------------------------------------------------------
 	// Private Variables for This Class.
 	//-------------------------------------------------------------------------
-	Sprite*					m_pSprite;
+	Sprite*					m_pSprite;			// the orientation drawn now
+	Sprite*					m_pRotations[4];	// forward, left, backward, right
+	int						m_iRotation;
 	ESpeedStates			m_eSpeedState;
 	float					m_fTimer;
 	
@@ -15,6 +15,7 @@
 //-----------------------------------------------------------------------------
 #include "Main.h"
 #include "Sprite.h"
+#include "Snapshot.h"
 #include "Bullet.h"
 
 //-----------------------------------------------------------------------------
@@ -65,6 +66,8 @@ public:
 
 	void					Explode();
 	bool					AdvanceExplosion();
+	void					SaveState(sPlayerRecord& rec) const;
+	void					LoadState(const sPlayerRecord& rec);
 
 
 	bool					GetShot(Bullet& bullet);
@@ -21,6 +21,58 @@
 //-----------------------------------------------------------------------------
 const ULONG MAX_SAMPLE_COUNT = 50; // Maximum frame time sample count
 
+const ULONG FRAME_HISTORY	= 1024;	// Longest window of the frame time statistics
+const ULONG FRAME_BUCKET_US	= 250;	// Width of a histogram bucket (microseconds)
+const ULONG FRAME_BUCKETS	= 200;	// Buckets up to 50 ms, slower frames share one more
+
+const float MIN_SLEEP_MARGIN	= 0.00025f;	// Time left to spin after a sleep (seconds)
+const float MAX_SLEEP_MARGIN	= 0.004f;
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION	0x00000002
+#endif
+
+//-----------------------------------------------------------------------------
+// Name : ELimiterMode (Enum)
+// Desc : How Tick waits out the rest of a locked frame.
+//-----------------------------------------------------------------------------
+enum ELimiterMode
+{
+	LIMITER_SPIN,		// Poll the counter until the frame is due
+	LIMITER_HYBRID		// Sleep, then poll for the last fraction of a millisecond
+};
+
+//-----------------------------------------------------------------------------
+// Name : sLimiterStats (Struct)
+// Desc : Frame limiter figures averaged over the last second, in
+//		milliseconds per frame unless noted.
+//-----------------------------------------------------------------------------
+typedef struct
+{
+	float	fSleep;
+	float	fSpin;
+	float	fMargin;		// Current sleep margin
+	float	fOversleep;		// How late the sleeps woke up
+	float	fJitter;		// Mean change of the frame time from one frame to the next
+	float	fCpuPercent;	// CPU time of the thread calling Tick, of one core
+} sLimiterStats;
+
+//-----------------------------------------------------------------------------
+// Name : sFrameStats (Struct)
+// Desc : Frame times over the statistics window, in milliseconds.
+//		Percentiles are read from the histogram, they are rounded up to the
+//		end of their bucket.
+//-----------------------------------------------------------------------------
+typedef struct
+{
+	ULONG	nFrames;
+	float	fMean;
+	float	fP50;
+	float	fP95;
+	float	fP99;
+	float	fMax;
+} sFrameStats;
+
 //-----------------------------------------------------------------------------
 // Main Class Declarations
 //-----------------------------------------------------------------------------
@@ -43,9 +95,19 @@ public:
 	// Public Functions For This Class
 	//------------------------------------------------------------
 	void			Tick( float fLockFPS = 0.0f );
+	void			Resume( );
 	unsigned long	GetFrameRate( LPTSTR lpszString = NULL, size_t size = 0 ) const;
 	float			GetTimeElapsed() const;
 
+	// Frame time statistics over the last nFrames frames (1 to FRAME_HISTORY)
+	void			SetStatsWindow( ULONG nFrames );
+	void			GetFrameStats( sFrameStats & Stats ) const;
+	float			GetPercentile( float fPercent ) const;
+
+	void			SetLimiterMode( ELimiterMode Mode ) { m_LimiterMode = Mode; }
+	ELimiterMode	GetLimiterMode( ) const { return m_LimiterMode; }
+	void			GetLimiterStats( sLimiterStats & Stats ) const { Stats = m_LimiterStats; }
+
 private:
 	//------------------------------------------------------------
 	// Private Variables For This Class
@@ -57,8 +119,38 @@ private:
 	__int64			m_LastTime;				 // Performance Counter last frame
 	__int64			m_PerfFreq;				 // Performance Frequency
 
-	float			m_FrameTime[MAX_SAMPLE_COUNT];
+	float			m_FrameTime[MAX_SAMPLE_COUNT];	// Ring of the filtered frame times
 	ULONG			m_SampleCount;
+	ULONG			m_SampleIndex;				// Next slot to write
+	float			m_SampleSum;				// Running sum of the ring
+
+	ULONG			m_History[FRAME_HISTORY];	// Ring of every frame time (microseconds)
+	ULONG			m_HistoryCount;				// Frames recorded so far
+	ULONG			m_StatsWindow;
+	ULONG			m_Buckets[FRAME_BUCKETS + 1];	// Histogram of the window
+	ULONG			m_WindowFrames;
+	__int64			m_WindowSum;
+	ULONG			m_MaxQueue[FRAME_HISTORY];	// Frames of decreasing time, the first is the window maximum
+	ULONG			m_MaxHead;
+	ULONG			m_MaxTail;
+
+	ELimiterMode	m_LimiterMode;
+	HANDLE			m_hWaitTimer;				// Waitable timer the limiter sleeps on
+	bool			m_bTimerPeriod;				// timeBeginPeriod was needed for it
+	float			m_SleepMargin;				// Part of the wait left to spin (seconds)
+	float			m_OversleepAvg;				// Running mean and deviation of the oversleep
+	float			m_OversleepDev;
+	float			m_LastFrameTime;
+
+	float			m_SecTime;					// Totals of the second being measured
+	float			m_SecSleep;
+	float			m_SecSpin;
+	float			m_SecOversleep;
+	float			m_SecJitter;
+	ULONG			m_SecFrames;
+	ULONG			m_SecSleeps;
+	__int64			m_SecCpuTime;				// Thread CPU time when it started (100 ns)
+	sLimiterStats	m_LimiterStats;
 
 	unsigned long	m_FrameRate;				// Stores current framerate
 	unsigned long	m_FPSFrameCount;			// Elapsed frames in any given second
@@ -67,6 +159,10 @@ private:
 	//------------------------------------------------------------
 	// Private Functions For This Class
 	//------------------------------------------------------------
+	void			RecordFrame( ULONG nTime );
+	__int64			QueryTime( ) const;
+	void			SleepFor( float fSeconds );
+	void			UpdateLimiterStats( float fTimeElapsed );
 };
 
 #endif // _CTIMER_H_
\ No newline at end of file
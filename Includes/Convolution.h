@@ -0,0 +1,104 @@
+#pragma once
+#include "ImageFile.h"
+#include <emmintrin.h>
+
+#define CONV_MAX_RADIUS 31
+
+// Separable convolution engine working in place on the 32 bit pixel buffer of
+// a CImageFile. Rows are split in horizontal bands, one per worker thread.
+// Each band filters its rows (plus the kernel halo) into a private float buffer,
+// then, once every band is done reading the source, filters its columns back
+// into the image in narrow column tiles so the kernel window stays in L1.
+// Threads and buffers are kept between calls, so the filters can run on a
+// frame every tick without allocating. The headless builds off Windows run
+// every band on the calling thread.
+class CConvolution
+{
+	enum EMode
+	{
+		MODE_FILTER,	// plain separable filter
+		MODE_SHARPEN,	// unsharp mask: src + amount * (src - blur)
+		MODE_SOBEL		// gradient magnitude of two separable kernels
+	};
+
+	enum EPhase
+	{
+		PHASE_ROWS,
+		PHASE_COLS
+	};
+
+	typedef struct
+	{
+		CConvolution *pEngine;
+		int iIndex;
+		HANDLE hThread;
+		HANDLE hStart;			// signalled by the engine to run the current phase
+		HANDLE hDone;			// signalled by the worker when the phase is done
+		__m128 *pRows;			// horizontally filtered rows of the band (plus halo)
+		__m128 *pRowsY;			// second plane used by the Sobel operator
+		__m128 *pLine;			// one padded source row converted to float
+		size_t uRowsSize;
+		size_t uLineSize;
+	} sBand;
+
+public:
+	// iThreads = 0 uses one band per processor
+	CConvolution(int iThreads = 0);
+	~CConvolution();
+
+	void GaussianBlur(CImageFile &img, float fSigma);
+	void BoxBlur(CImageFile &img, int iRadius);
+	void Sharpen(CImageFile &img, float fAmount, float fSigma = 1.0f);
+	void Sobel(CImageFile &img);
+
+	// Filter rows with pRowKernel then columns with pColKernel, both 2 * iRadius + 1 taps
+	// (iRadius is clamped to CONV_MAX_RADIUS)
+	void Convolve(CImageFile &img, const float *pRowKernel, const float *pColKernel, int iRadius);
+
+private:
+	// Make copy constructor and assignment operator private
+	// so client cannot copy the engine and its threads.
+	CConvolution(const CConvolution& rhs);
+	CConvolution& operator=(const CConvolution& rhs);
+
+	void Run(CImageFile &img, EMode eMode, int iRadius);
+	void Dispatch(EPhase ePhase);
+	void ProcessBand(int iIndex);
+	void FilterRows(sBand &band, int y0, int y1);
+	void FilterCols(sBand &band, int y0, int y1);
+	void Reserve(sBand &band, int iRows);
+	void PrepareTaps();
+
+#ifdef _WIN32
+	static DWORD WINAPI WorkerProc(LPVOID lpParam);
+#endif
+	static int BuildGaussian(float fSigma, float *pKernel);
+
+	sBand *m_pBands;
+	HANDLE *m_phDone;
+	int m_iThreads;
+	int m_iBands;
+	volatile bool m_bQuit;
+
+	// current job
+	RGBQUAD *m_pPixels;
+	int m_iWidth;
+	int m_iHeight;
+	EMode m_eMode;
+	EPhase m_ePhase;
+	int m_iRadius;
+	float m_fAmount;
+	float m_RowKernel[2 * CONV_MAX_RADIUS + 1];
+	float m_ColKernel[2 * CONV_MAX_RADIUS + 1];
+	float m_RowKernelY[2 * CONV_MAX_RADIUS + 1];
+	float m_ColKernelY[2 * CONV_MAX_RADIUS + 1];
+
+	// kernels broadcast to all four channels once per job (stored as floats,
+	// the engine itself may live on an 8 byte aligned heap block)
+	float m_RowTaps[2 * CONV_MAX_RADIUS + 1][4];
+	float m_ColTaps[2 * CONV_MAX_RADIUS + 1][4];
+	float m_RowTapsY[2 * CONV_MAX_RADIUS + 1][4];
+	float m_ColTapsY[2 * CONV_MAX_RADIUS + 1][4];
+	bool m_bRowSymmetric;
+	bool m_bColSymmetric;
+};
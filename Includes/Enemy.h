@@ -16,6 +16,7 @@
 //-----------------------------------------------------------------------------
 #include "Main.h"
 #include "Sprite.h"
+#include "Snapshot.h"
 #include "Bullet.h"
 
 //-----------------------------------------------------------------------------
@@ -49,6 +50,7 @@ public:
 	// Constructors & Destructors for This Class.
 	//-------------------------------------------------------------------------
 	Enemy(const BackBuffer* pBackBuffer);
+	Enemy(const Enemy& rhs);
 	virtual ~Enemy();
 
 	//-------------------------------------------------------------------------
@@ -62,6 +64,8 @@ public:
 	bool					out = false;
 	void					Explode();
 	bool					AdvanceExplosion();
+	void					SaveState(sEntityRecord& rec) const;
+	void					LoadState(const sEntityRecord& rec);
 
 	bool					GetShot(Bullet& bullet);
 	bool					AreIntersecting(const RECT& aFirst, const RECT& aSecond);
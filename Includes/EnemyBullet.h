@@ -16,6 +16,7 @@
 //-----------------------------------------------------------------------------
 #include "Main.h"
 #include "Sprite.h"
+#include "Snapshot.h"
 
 //-----------------------------------------------------------------------------
 // Main Class Definitions
@@ -48,6 +49,7 @@ public:
 	// Constructors & Destructors for This Class.
 	//-------------------------------------------------------------------------
 	EnemyBullet(const BackBuffer* pBackBuffer);
+	EnemyBullet(const EnemyBullet& rhs);
 	virtual ~EnemyBullet();
 
 	//-------------------------------------------------------------------------
@@ -61,6 +63,8 @@ public:
 	bool					out = false;
 	void					Explode();
 	bool					AdvanceExplosion();
+	void					SaveState(sEntityRecord& rec) const;
+	void					LoadState(const sEntityRecord& rec);
 
 
 	RECT EnemyBullet::GetRectangle() const
@@ -2,7 +2,7 @@
 // ImageFile.h
 // by Mihai Popescu
 // March 2009
-#include "main.h"
+#include "Main.h"
 
 
 typedef BYTE (*RGBQUAD_TO_BYTE)(const RGBQUAD &q);
@@ -36,15 +36,29 @@ public:
 	CImageFile(void);
 	virtual ~CImageFile(void);
 
-	bool LoadBitmapFromFile(const char* szFileName, HDC hdc);
+	// Any uncompressed 1 to 32 bpp bitmap, decoded from a mapped view of the file
+	// (hdc is not needed any more and is kept for existing callers). The asset
+	// pack is looked in first unless bUsePack is false.
+	bool LoadBitmapFromFile(const char* szFileName, HDC hdc = NULL, bool bUsePack = true);
+	bool Create(LONG lWidth, LONG lHeight);
 	virtual void Paint(HDC hdc, int x, int y);
 
+	// A copy iFactor times smaller, each pixel the average of the block it
+	// covers. Painted with PaintScaled it fills the same area with a fraction
+	// of the pixels to upload.
+	bool CreateReduced(const CImageFile &source, int iFactor);
+	// Same as Paint, stretched iScale times (x and y are in image pixels)
+	void PaintScaled(HDC hdc, int x, int y, int iScale);
+
 	LONG Height() const { return height; }
 	LONG Width() const { return width; }
+	RGBQUAD* Pixels() { return m_pRGB; }
 
 	void Clear() { ZeroMemory(m_pRGB, sizeof(RGBQUAD) * width * height); }
 	void Reload(HDC hdc);
 
 	BYTE* CopyMonoImage(EColorChannel chn, const RECT* rc = NULL);
+	// Same as above, writing into a caller supplied buffer of rc (or image) size
+	void CopyMonoImage(BYTE *img, EColorChannel chn, const RECT* rc = NULL) const;
 	void PasteMonoImage(const BYTE *img, EColorChannel chn, const RECT* rc = NULL);
 };
\ No newline at end of file
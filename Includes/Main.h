@@ -12,6 +12,7 @@
 //-----------------------------------------------------------------------------
 // Main Application Includes
 //-----------------------------------------------------------------------------
+#ifdef _WIN32
 #define CRTDBG_MAP_ALLOC
 #include "..\\Res\\resource.h"
 #include <windows.h>
@@ -21,6 +22,12 @@
 #include <tchar.h>
 #include <stdio.h>
 #include <math.h>
+#else
+// headless tools built elsewhere
+#include "Portable.h"
+#include <assert.h>
+#include <math.h>
+#endif
 
 
 //-----------------------------------------------------------------------------
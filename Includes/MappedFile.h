@@ -0,0 +1,29 @@
+#pragma once
+// MappedFile.h
+// Read only view of a whole file mapped into memory.
+// Uses CreateFileMapping on Windows and mmap elsewhere.
+#include <stddef.h>
+#include <stdint.h>
+
+class CMappedFile
+{
+public:
+	CMappedFile();
+	~CMappedFile();
+
+	// Map the whole file, any previous view is released first
+	bool Open(const char *szFileName);
+	void Close();
+
+	bool IsOpen() const { return m_pData != NULL; }
+	const uint8_t* Data() const { return m_pData; }
+	size_t Size() const { return m_uSize; }
+
+private:
+	// The view is owned by the object, it cannot be copied.
+	CMappedFile(const CMappedFile& rhs);
+	CMappedFile& operator=(const CMappedFile& rhs);
+
+	const uint8_t *m_pData;
+	size_t m_uSize;
+};
@@ -0,0 +1,118 @@
+#pragma once
+// PerfOverlay.h
+// Performance panel drawn into the back buffer (F3). Frame time is split
+// into stages by laps taken along the frame, and shown with per frame
+// counters and a graph of the last frame times. The text is drawn from a
+// glyph atlas of the fixed system font built once, into a DIB section that
+// is copied out with a single BitBlt. The figures are averaged and the text
+// redrawn PERF_REFRESH_MS apart, only the graph changes every frame.
+#include "Main.h"
+#include <vector>
+
+#define PERF_REFRESH_MS		250
+#define PERF_INFO_LINES		4		// lines of text supplied by the caller
+#define PERF_LINE_CHARS		46
+#define PERF_GRAPH_HEIGHT	64		// pixels, the top is two frame budgets
+#define PERF_GLYPHS			96		// ' ' to DEL
+
+// Where the time of a frame goes, in the order the laps are taken
+enum EPerfStage
+{
+	PERF_WAIT,			// limiter and messages, from the last present to the next frame
+	PERF_INPUT,
+	PERF_WORLD,			// collisions, spawning, removal
+	PERF_ANIMATE,
+	PERF_HOUSEKEEPING,	// autosave and asset reloads
+	PERF_BACKGROUND,
+	PERF_SPRITES,
+	PERF_OVERLAY,
+	PERF_PRESENT,
+	PERF_STAGES
+};
+
+enum EPerfCounter
+{
+	PERF_ENEMIES,
+	PERF_BULLETS,
+	PERF_ENEMY_BULLETS,
+	PERF_CRATES,
+	PERF_HEARTS,
+	PERF_COLLISION_PAIRS,
+	PERF_ALLOCATIONS,	// counted by the overlay
+	PERF_COUNTERS
+};
+
+class CPerfOverlay
+{
+public:
+	CPerfOverlay();
+	~CPerfOverlay();
+
+	// While hidden only the laps are taken
+	void SetVisible(bool bVisible);
+	bool IsVisible() const { return m_bVisible; }
+
+	// Closes the last frame and starts the next one, the time since the last
+	// lap is the wait. Returns true when the text of a visible overlay is about
+	// to be redrawn, the caller's lines should be set then.
+	bool FrameStart(float fBudgetMs);
+	// The time since the last lap belongs to stage
+	void Lap(EPerfStage stage);
+	// Drop the frame in progress, after a pause
+	void Resume();
+
+	// Counters are summed over the frames and shown per frame
+	void AddCount(EPerfCounter counter, ULONG nValue) { m_nCount[counter] += nValue; }
+	void SetInfo(int iLine, const char *szText);
+
+	void Draw(HDC hdc, int x, int y);
+
+private:
+	CPerfOverlay(const CPerfOverlay& rhs);
+	CPerfOverlay& operator=(const CPerfOverlay& rhs);
+
+	__int64 Now() const;
+	void ResetSums();
+	bool CreatePanel();
+	void ReleasePanel();
+	void PaintText();	// DrawText is taken by the Win32 macro
+	void PaintGraph();
+
+	bool m_bVisible;
+	__int64 m_iFrequency;
+	__int64 m_iLastLap;
+	__int64 m_iFrameStart;
+	__int64 m_iRefreshTime;
+	float m_fBudget;
+	LONG m_lAllocations;	// GetAllocationCount at the last frame start
+
+	// sums since the last refresh
+	__int64 m_iStage[PERF_STAGES];
+	ULONG m_nCount[PERF_COUNTERS];
+	ULONG m_nFrames;
+	// the averages shown
+	float m_fStage[PERF_STAGES];
+	float m_fCount[PERF_COUNTERS];
+	float m_fFrame;
+
+	char m_szInfo[PERF_INFO_LINES][PERF_LINE_CHARS + 1];
+	bool m_bTextDirty;
+
+	// frame times of the graph, one per column
+	std::vector<float> m_Graph;
+	UINT m_uGraphNext;
+
+	// one byte per pixel, non zero where the glyph is drawn. The glyphs
+	// are side by side, PERF_GLYPHS of them.
+	std::vector<BYTE> m_Glyphs;
+	int m_iCharWidth;
+	int m_iCharHeight;
+
+	HDC m_hPanelDC;
+	HBITMAP m_hPanel;
+	HGDIOBJ m_hOldPanel;
+	DWORD *m_pPanel;		// top down
+	int m_iPanelWidth;
+	int m_iPanelHeight;
+	int m_iTextHeight;
+};
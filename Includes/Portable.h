@@ -0,0 +1,144 @@
+#pragma once
+// Portable.h
+// Stand-ins for the Win32 types and CRT calls used by the image code, so the
+// headless tools (the resize benchmark) build off Windows. Main.h includes it
+// in place of windows.h there. Nothing that draws or opens a window is covered.
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef unsigned int UINT;
+typedef int BOOL;
+typedef long long __int64;
+typedef void *HANDLE;
+typedef void *HINSTANCE;
+typedef void *HDC;
+typedef void *HBITMAP;
+typedef void *LPVOID;
+
+#define TRUE	1
+#define FALSE	0
+#define MAX_PATH	260
+#define BI_RGB	0
+#define MOVEFILE_REPLACE_EXISTING	1
+
+// functions rather than the windows.h macros, which would break the C++ headers
+template <class T> inline T min(T a, T b) { return a < b ? a : b; }
+template <class T> inline T max(T a, T b) { return a > b ? a : b; }
+
+#define ZeroMemory(p, n)	memset((p), 0, (n))
+
+typedef union
+{
+	__int64 QuadPart;
+} LARGE_INTEGER;
+
+typedef struct
+{
+	BYTE rgbBlue;
+	BYTE rgbGreen;
+	BYTE rgbRed;
+	BYTE rgbReserved;
+} RGBQUAD;
+
+typedef struct
+{
+	LONG left;
+	LONG top;
+	LONG right;
+	LONG bottom;
+} RECT;
+
+typedef struct
+{
+	DWORD biSize;
+	LONG biWidth;
+	LONG biHeight;
+	WORD biPlanes;
+	WORD biBitCount;
+	DWORD biCompression;
+	DWORD biSizeImage;
+	LONG biXPelsPerMeter;
+	LONG biYPelsPerMeter;
+	DWORD biClrUsed;
+	DWORD biClrImportant;
+} BITMAPINFOHEADER;
+
+// written to disk as is, the same 2 byte packing as wingdi.h
+#pragma pack(push, 2)
+typedef struct
+{
+	WORD bfType;
+	DWORD bfSize;
+	WORD bfReserved1;
+	WORD bfReserved2;
+	DWORD bfOffBits;
+} BITMAPFILEHEADER;
+#pragma pack(pop)
+
+// there are no GDI objects, the handles are always 0
+inline BOOL DeleteObject(HBITMAP) { return TRUE; }
+
+// rename replaces an existing file in one step, as MOVEFILE_REPLACE_EXISTING does
+inline BOOL MoveFileEx(const char *szFrom, const char *szTo, DWORD)
+{
+	return rename(szFrom, szTo) == 0;
+}
+
+// monotonic nanoseconds
+inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *pFreq)
+{
+	pFreq->QuadPart = 1000000000LL;
+	return TRUE;
+}
+
+inline BOOL QueryPerformanceCounter(LARGE_INTEGER *pCount)
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	pCount->QuadPart = (__int64)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+	return TRUE;
+}
+
+inline int fopen_s(FILE **ppFile, const char *szName, const char *szMode)
+{
+	*ppFile = fopen(szName, szMode);
+	return *ppFile ? 0 : 1;
+}
+
+inline int strcpy_s(char *szDst, size_t uSize, const char *szSrc)
+{
+	if(strlen(szSrc) >= uSize)
+	{
+		szDst[0] = '\0';
+		return 1;
+	}
+	strcpy(szDst, szSrc);
+	return 0;
+}
+
+inline int sprintf_s(char *szDst, size_t uSize, const char *szFormat, ...)
+{
+	va_list args;
+	va_start(args, szFormat);
+	int iLen = vsnprintf(szDst, uSize, szFormat, args);
+	va_end(args);
+	return iLen;
+}
+
+template <size_t N>
+inline int sprintf_s(char (&szDst)[N], const char *szFormat, ...)
+{
+	va_list args;
+	va_start(args, szFormat);
+	int iLen = vsnprintf(szDst, N, szFormat, args);
+	va_end(args);
+	return iLen;
+}
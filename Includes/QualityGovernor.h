@@ -0,0 +1,49 @@
+#pragma once
+// QualityGovernor.h
+// Picks a quality level from the CTimer frame statistics. A window in which
+// the slow frames (p95) did not fit the frame budget steps the quality down,
+// a few windows in a row well inside it step it back up. Every decision
+// looks at a window made only of frames drawn at the current level.
+#include "Main.h"
+#include "CTimer.h"
+
+#define QUALITY_LEVELS			4
+#define QUALITY_HEADROOM		0.7f	// of the budget, the work has to stay under it to step up
+#define QUALITY_CALM_WINDOWS	3		// windows in a row under the headroom before stepping up
+#define QUALITY_WINDOW			120		// frames of the CTimer statistics window it is fed
+#define QUALITY_DEFAULT_FPS		60.0f	// the budget when the frame rate is not capped
+
+typedef struct
+{
+	int iExplosionStep;		// explosion frames advanced per animation tick
+	int iBackgroundScale;	// the background is drawn from a copy this many times smaller
+	int iVoiceBudget;		// sounds mixed at once
+} sQualitySettings;
+
+class CQualityGovernor
+{
+public:
+	CQualityGovernor();
+
+	// Call once a frame with the current statistics. fBudgetMs is the time
+	// one frame may take. Returns true when the level changed.
+	bool Update(const sFrameStats &frame, const sLimiterStats &limiter, float fBudgetMs);
+
+	// Forget the frames seen so far, after a pause or a change of the budget
+	void Restart();
+
+	// Disabled it stays at full quality
+	void SetEnabled(bool bEnabled);
+	bool IsEnabled() const { return m_bEnabled; }
+
+	int GetLevel() const { return m_iLevel; }		// 0 is full quality
+	const sQualitySettings &GetSettings() const;
+	float GetWorkTime() const { return m_fWork; }	// p95 of the last window without the limiter wait (ms)
+
+private:
+	bool m_bEnabled;
+	int m_iLevel;
+	ULONG m_nFrames;		// frames since the last decision
+	int m_iCalm;			// windows in a row under the headroom
+	float m_fWork;
+};
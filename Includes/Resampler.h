@@ -0,0 +1,44 @@
+#pragma once
+// Resampler.h
+// Sample rate conversion with a polyphase windowed sinc filter, used when
+// sound clips are loaded. The filter is tabulated for RESAMPLE_PHASES
+// positions between two input samples, the coefficients for a position in
+// between are interpolated from the two nearest phases. Below the input
+// rate the cut off follows the output rate so nothing aliases.
+#include "Main.h"
+#include <vector>
+
+#define RESAMPLE_TAPS			32		// input samples per output sample, a multiple of 4
+#define RESAMPLE_PHASE_BITS		7
+#define RESAMPLE_PHASES			(1 << RESAMPLE_PHASE_BITS)
+#define RESAMPLE_CUTOFF			0.95	// of the lower Nyquist frequency
+
+class CResampler
+{
+public:
+	CResampler();
+
+	bool Init(UINT uInRate, UINT uOutRate);
+
+	// Frames produced for uInFrames of input
+	UINT OutputFrames(UINT uInFrames) const;
+
+	// Resample one channel. pOut receives OutputFrames(uInFrames) samples,
+	// uOutStride floats apart so channels can be written interleaved.
+	void Process(const float *pIn, UINT uInFrames, float *pOut, UINT uOutStride);
+
+private:
+	CResampler(const CResampler& rhs);
+	CResampler& operator=(const CResampler& rhs);
+
+	UINT m_uInRate;
+	UINT m_uOutRate;
+	__int64 m_iStep;				// input frames per output frame, 32.32 fixed point
+	std::vector<float> m_Taps;		// RESAMPLE_PHASES + 1 rows of RESAMPLE_TAPS
+	std::vector<float> m_Padded;	// input with silence on both sides
+};
+
+// Sample format conversion, four samples per step
+void ShortToFloat(const short *pIn, float *pOut, UINT uSamples);
+void ByteToFloat(const BYTE *pIn, float *pOut, UINT uSamples);	// 8 bit unsigned, to the 16 bit scale
+void FloatToShort(const float *pIn, short *pOut, UINT uSamples);	// rounded and saturated
@@ -0,0 +1,12 @@
+#pragma once
+// ResizeBenchmark.h
+// Timing suite for CResizableImage::Resample and the CConvolution filters
+#include "ResizeEngine.h"
+
+// Run Resample with every filter over upscale, downscale, aspect-changing and
+// identity cases from sprite size up to 8K, and write megapixels per second
+// and peak working memory of each run to szReportFile, followed by the
+// blur, sharpen and Sobel filters of CConvolution from sprite size up to 4K.
+// No window is created, the suite is started with the -benchresize switch,
+// or by the resize_bench console program built off Windows.
+bool RunResizeBenchmark(const char *szReportFile);
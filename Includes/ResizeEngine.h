@@ -37,6 +37,16 @@ public:
 	int getRightBoundary(int dst_pos) {
 			return m_WeightTable[dst_pos].Right;
 	}
+
+	// Retrieve the maximum number of source pixels affecting a destination pixel
+	DWORD getWindowSize() const {
+			return m_WindowSize;
+	}
+
+	// Retrieve the number of bytes held by the table
+	size_t getMemorySize() const {
+			return m_LineLength * (sizeof(sContribution) + m_WindowSize * sizeof(double));
+	}
 };
 
 
@@ -46,16 +56,44 @@ class CResizableImage : public CImageFile
 	RGBQUAD *m_pResImg;
 	CWeightsTable *m_pWeights;
 
+	// working memory accounting of the last Resample call
+	size_t m_uLiveBytes;
+	size_t m_uPeakBytes;
+
 public:
-	CResizableImage() { m_pFilter = NULL; }
+	CResizableImage() { m_pFilter = NULL; m_uLiveBytes = m_uPeakBytes = 0; }
 	virtual ~CResizableImage() {}
 
 	void SetFilter(CGenericFilter *pFilter) { m_pFilter = pFilter; }
 
-	// Scale an image to the desired dimensions
+	// Peak number of bytes held by pixel buffers and weight tables during the last Resample
+	size_t GetPeakBytes() const { return m_uPeakBytes; }
+
+	// Scale an image to the desired dimensions.
+	// Exact 2x, 4x and 8x reductions with a box filter skip the weight tables
+	// and use the SSE2 box-average path instead.
 	void Resample(unsigned dst_width, unsigned dst_height);
 
+	// Build successive half-size box-averaged copies of the image (mip levels).
+	// Each level is computed from the previous one until 1x1 or iMaxLevels is
+	// reached. Returns the number of levels stored in ppLevels, the caller owns them.
+	int GenerateMipChain(CResizableImage **ppLevels, int iMaxLevels) const;
+
+	// Scale a BMP file straight into a 24 bit BMP file. Source rows are decoded
+	// from a mapped view one at a time and only the rows under the vertical filter
+	// support are kept in memory, so very large bitmaps are resized in bounded memory.
+	bool ResampleFile(const char *szSrcFile, const char *szDstFile, unsigned dst_width, unsigned dst_height);
+
 private:
+	void TrackAlloc(size_t uBytes) { m_uLiveBytes += uBytes; m_uPeakBytes = max(m_uPeakBytes, m_uLiveBytes); }
+	void TrackFree(size_t uBytes) { m_uLiveBytes -= uBytes; }
+
+	// Reduce the image by an integer ratio (2, 4 or 8) averaging ratio x ratio blocks
+	void BoxDownsample(unsigned int ratio);
+
+	// Average 2x2 pixel blocks of a width x height image into dst
+	static void HalveImage(const RGBQUAD *pSrc, unsigned int width, unsigned int height, RGBQUAD *pDst);
+
 	void ScaleRow(unsigned int dst_width, unsigned int /*dst_height*/, unsigned int row);
 	void ScaleCol(unsigned int dst_width, unsigned int dst_height, unsigned int col);
 
@@ -64,5 +102,8 @@ private:
 
 	// Performs vertical image filtering
 	void VerticalFilter(unsigned int dst_width, unsigned int dst_height);
+
+	// Horizontally filters one packed BMP scanline into a row of float BGR triplets
+	static void FilterScanline(CWeightsTable *pWeights, const BYTE *pSrc, unsigned int bytes_per_pixel, unsigned int dst_width, float *pDst);
 };
 
@@ -0,0 +1,100 @@
+//-----------------------------------------------------------------------------
+// File: Snapshot.h
+//
+// Desc: Records of the binary world snapshot written by the 'O' key and read
+//	   back by 'L'. The file is one sSnapshotHeader followed by the entity
+//	   records of every list, in ESnapshotList order. Autosaves may add a
+//	   delta file holding the 4KB blocks changed since that full save.
+//-----------------------------------------------------------------------------
+
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC		0x50414E53	// "SNAP"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_FILE		"Data/savegame.bin"
+
+#define SNAPSHOT_DELTA_MAGIC	0x544C4453	// "SDLT"
+#define SNAPSHOT_BLOCK_SIZE		4096
+
+enum ESnapshotList
+{
+	SNAP_BULLETS,
+	SNAP_CRATES,
+	SNAP_HEARTS,
+	SNAP_ENEMIES,
+	SNAP_ENEMYBULLETS,
+	SNAP_LIST_COUNT
+};
+
+enum ESnapshotTimer
+{
+	SNAP_TIMER_BULLET,
+	SNAP_TIMER_CRATE,
+	SNAP_TIMER_HEART,
+	SNAP_TIMER_ENEMYSPAWN,
+	SNAP_TIMER_ENEMYSHOOT,
+	SNAP_TIMER_COUNT
+};
+
+// State shared by every entity class
+typedef struct
+{
+	double		dPosX, dPosY;
+	double		dVelX, dVelY;
+	float		fTimer;
+	int32_t		iSpeedState;
+	int32_t		iExplosionFrame;
+	uint8_t		bExplosion;
+	uint8_t		bOut;
+	uint8_t		pad[2];
+} sEntityRecord;
+
+class Sprite;
+class AnimatedSprite;
+
+// Copy the state every entity class has to / from a record. The speed state
+// is stored as it is, LoadEntityState returns whether it was iSpeedStart.
+// Entities that cannot leave the screen pass a NULL pbOut.
+void SaveEntityState(sEntityRecord& rec, const Sprite* pSprite, float fTimer, int iSpeedState,
+	int iExplosionFrame, bool bExplosion, bool bOut);
+bool LoadEntityState(const sEntityRecord& rec, Sprite* pSprite, AnimatedSprite* pExplosionSprite, float& fTimer,
+	int iSpeedStart, int& iExplosionFrame, bool& bExplosion, bool* pbOut);
+
+typedef struct
+{
+	sEntityRecord	entity;
+	int32_t			iLife;
+	int32_t			iScore;
+	int32_t			iRotation;
+	int32_t			iReserved;
+} sPlayerRecord;
+
+typedef struct
+{
+	uint32_t		uMagic;
+	uint32_t		uVersion;
+	uint32_t		uSize;								// whole file, header included
+	uint32_t		uRandomState;
+	int64_t			iTimerAge[SNAP_TIMER_COUNT];		// ms since each spawn timer last fired
+	uint32_t		uCounts[SNAP_LIST_COUNT];
+	uint32_t		uReserved;
+	sPlayerRecord	player1;
+	sPlayerRecord	player2;
+} sSnapshotHeader;
+
+// Delta file: the header, uBlocks block indices in increasing order, then the
+// blocks. Every block is SNAPSHOT_BLOCK_SIZE bytes except one ending the image.
+typedef struct
+{
+	uint32_t		uMagic;
+	uint32_t		uVersion;
+	uint32_t		uBaseSize;			// full save the blocks apply to
+	uint32_t		uBaseHash;			// FNV-1a of that save
+	uint32_t		uSize;				// size of the patched snapshot
+	uint32_t		uBlocks;
+} sSnapshotDelta;
+
+#endif // _SNAPSHOT_H_
@@ -0,0 +1,125 @@
+#pragma once
+// SoundCache.h
+// Sound clips decoded once and played from memory. Each WAV is parsed when
+// it is first loaded, normally at startup, and kept as a plain PCM RIFF image
+// so PlaySound never touches the disk during gameplay. MS ADPCM files are
+// expanded to 16 bit PCM, other chunks of the file are dropped.
+//
+// With a conversion rate set every clip is resampled to that rate and 16 bit
+// as it is loaded, so the mixer never converts while playing. Converted clips
+// can be kept in a cache folder, keyed by a hash of the file they came from.
+#include "Main.h"
+#include "Vec2.h"
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#ifndef WAVE_FORMAT_ADPCM
+#define WAVE_FORMAT_ADPCM		2
+#endif
+
+#define WAV_HEADER_SIZE			44		// RIFF, fmt and data headers of the PCM image
+
+#define SOUND_CACHE_DIR			"SoundCache"
+#define SOUND_CACHE_MAGIC		0x444E5347	// "GSND"
+#define SOUND_CACHE_VERSION		1			// raise when the conversion changes
+
+// Start of a cache file, the PCM image of the converted clip follows
+typedef struct
+{
+	uint32_t uMagic;
+	uint32_t uVersion;
+	uint32_t uRate;				// rate the clip was converted to
+	uint32_t uSourceBytes;		// size and FNV-1a hash of the original file
+	uint32_t uSourceHash;
+} sSoundCacheHeader;
+
+typedef struct
+{
+	char szName[MAX_PATH];
+	WAVEFORMATEX wfx;			// always PCM, 8 or 16 bit
+	std::vector<BYTE> image;	// WAV_HEADER_SIZE bytes of header, then the samples
+	const BYTE *pPcm;			// samples inside image
+	UINT uPcmBytes;
+	UINT uFrames;				// samples per channel
+	UINT uLoudness;				// RMS level, 16 bit scale
+	UINT uFileBytes;			// size of the file it was read from
+} sSoundClip;
+
+typedef struct
+{
+	UINT uClips;
+	UINT uPcmBytes;				// memory held by the clips
+	UINT uFileBytes;			// size of the files they came from
+	UINT uPlays;
+	UINT uLateLoads;			// clips first loaded when played
+	UINT uConverted;			// clips resampled while loading
+	UINT uCacheHits;			// converted clips read from the cache folder
+	float fLoadMs;				// total time spent loading
+} sSoundCacheStats;
+
+class CSoundCache
+{
+public:
+	CSoundCache();
+	~CSoundCache();
+
+	// Load a clip from the asset pack or the disk, does nothing if cached
+	const sSoundClip* Load(const char *szFileName);
+	const sSoundClip* Find(const char *szFileName) const;
+	// Find, or load a clip that was not preloaded
+	const sSoundClip* Get(const char *szFileName);
+
+	// Play a cached clip with PlaySound, loading it first if needed
+	// (fdwSound takes the SND_ASYNC, SND_LOOP... flags of PlaySound)
+	BOOL Play(const char *szFileName, DWORD fdwSound);
+
+	// Convert clips loaded from here on to uRate, 0 keeps them as they are.
+	// szCacheDir may be NULL to convert every time.
+	void SetConversion(UINT uRate, const char *szCacheDir);
+
+	// Stops any playing sound and frees the clips
+	void Clear();
+
+	void GetStats(sSoundCacheStats &stats) const;
+
+	// Parse a WAV image into clip, PCM and MS ADPCM are understood
+	static bool Decode(const BYTE *pData, size_t uSize, sSoundClip &clip);
+	// Resample a decoded clip to uRate and 16 bit
+	static bool Convert(sSoundClip &clip, UINT uRate);
+
+private:
+	CSoundCache(const CSoundCache& rhs);
+	CSoundCache& operator=(const CSoundCache& rhs);
+
+	static void MakeKey(const char *szFileName, char *szKey);
+	void MakeCachePath(const char *szKey, char *szPath) const;
+	bool LoadConverted(const char *szKey, const BYTE *pData, size_t uSize, sSoundClip &clip);
+
+	// clips are not moved once loaded, PlaySound reads them asynchronously
+	std::map<std::string, sSoundClip*> m_Clips;
+	sSoundCacheStats m_Stats;
+	UINT m_uRate;
+	char m_szCacheDir[MAX_PATH];	// empty without a cache
+	__int64 m_iFrequency;
+};
+
+extern CSoundCache g_SoundCache;
+
+// When voices run out the mixer keeps the sounds of higher priority
+enum ESoundPriority
+{
+	SOUND_PRIORITY_LOW,			// hits and pickups, there may be many at once
+	SOUND_PRIORITY_NORMAL,
+	SOUND_PRIORITY_HIGH			// the player's own sounds
+};
+
+// Play a sound through the mixer when it runs, with PlaySound otherwise
+BOOL PlayAssetSound(const char *szFileName, DWORD fdwSound, int iPriority = SOUND_PRIORITY_NORMAL);
+// Same, panned by where the emitter is on the screen and quieter the further
+// it is past either edge. PlaySound ignores the position.
+BOOL PlayAssetSound(const char *szFileName, DWORD fdwSound, int iPriority, const Vec2 &position);
+
+// Width of the screen positions are panned across, set when the window is sized
+void SetSoundStage(ULONG nWidth);
@@ -7,18 +7,24 @@
 #include "main.h"
 #include "Vec2.h"
 #include "BackBuffer.h"
+#include "AssetLoader.h"
 
 class Sprite
 {
 public:
 	Sprite(int imageID, int maskID);
 	Sprite(const char *szImageFile, const char *szMaskFile);
-	Sprite(const char *szImageFile, COLORREF crTransparentColor);
+	// iStep / iSteps of a clockwise turn gives a rotated copy of the image
+	Sprite(const char *szImageFile, COLORREF crTransparentColor, int iStep = 0, int iSteps = 1);
+	// The bitmaps are shared, a copy takes another reference to them and
+	// does not go through the loader
+	Sprite(const Sprite& rhs);
 
 	virtual ~Sprite();
 
-	int width()		const	{ return mImageBM.bmWidth; }
-	int height()	const	{ return mImageBM.bmHeight; }
+	int width()		const	{ return mpImage->Width(); }
+	int height()	const	{ return mpImage->Height(); }
+	bool isLoaded()	const	{ return mpImage->IsReady() && (!mpMask || mpMask->IsReady()); }
 	void update(float dt);
 
 	void setBackBuffer(const BackBuffer *pBackBuffer);
@@ -35,20 +41,16 @@ public:
 	Vec2 mVelocity;
 
 private:
-	// Make copy constructor and assignment operator private
-	// so client cannot copy Sprites. We do this because
-	// this class is not designed to be copied because it
-	// is not efficient--copying bitmaps is slow (lots of memory).
-	Sprite(const Sprite& rhs);
+	// Make assignment operator private so client cannot
+	// assign Sprites, it would have to swap the bitmaps.
 	Sprite& operator=(const Sprite& rhs);
 
 protected:
-	HBITMAP mhImage;
-	HBITMAP mhMask;
-	BITMAP mImageBM;
-	BITMAP mMaskBM;
+	// Shared with every sprite using the same files, loaded in the background.
+	// Nothing is drawn until they are ready.
+	CBitmapAsset *mpImage;
+	CBitmapAsset *mpMask;
 
-	HDC mhSpriteDC;
 	const BackBuffer *mpBackBuffer;
 
 	COLORREF mcTransparentColor;
@@ -0,0 +1,56 @@
+#pragma once
+// SpscQueue.h
+// Fixed size ring buffer between exactly one producer thread and one
+// consumer thread. Push and Pop never lock, never allocate and never wait,
+// a full queue makes Push fail. Each index is written by one side only, the
+// release store publishing an item pairs with the acquire load reading it.
+#include <atomic>
+
+template<typename T, unsigned int N>
+class CSpscQueue
+{
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "CSpscQueue size must be a power of two");
+
+public:
+	CSpscQueue() : m_uHead(0), m_uTail(0) {}
+
+	// Producer side
+	bool Push(const T &item)
+	{
+		unsigned int uTail = m_uTail.load(std::memory_order_relaxed);
+		if(uTail - m_uHead.load(std::memory_order_acquire) == N)
+			return false;
+
+		m_Items[uTail & (N - 1)] = item;
+		m_uTail.store(uTail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side
+	bool Pop(T &item)
+	{
+		unsigned int uHead = m_uHead.load(std::memory_order_relaxed);
+		if(uHead == m_uTail.load(std::memory_order_acquire))
+			return false;
+
+		item = m_Items[uHead & (N - 1)];
+		m_uHead.store(uHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Either side, the answer may be stale by the time it is used
+	unsigned int Size() const
+	{
+		return m_uTail.load(std::memory_order_acquire) - m_uHead.load(std::memory_order_acquire);
+	}
+
+private:
+	CSpscQueue(const CSpscQueue& rhs);
+	CSpscQueue& operator=(const CSpscQueue& rhs);
+
+	// the indices run freely and wrap, on separate cache lines so the two
+	// threads do not share one
+	alignas(64) std::atomic<unsigned int> m_uHead;	// written by the consumer
+	alignas(64) std::atomic<unsigned int> m_uTail;	// written by the producer
+	alignas(64) T m_Items[N];
+};
@@ -0,0 +1,10 @@
+#pragma once
+// SpscQueueTest.h
+// Stress test of CSpscQueue
+
+// A producer and a consumer thread pass SPSC_TEST_ITEMS numbered items
+// through a small queue. Fails if an item arrives out of order, if either
+// thread allocates while they run, or if the atomics are not lock free.
+// The result is written to szReportFile. No window is created, the test is
+// started with the -testspscqueue switch.
+bool RunSpscQueueTest(const char *szReportFile);
@@ -0,0 +1,69 @@
+#pragma once
+// StartupProfiler.h
+// Timeline of the start of the game: the phases of initialisation, every
+// asset load with its queue wait and decode time, and the time to the first
+// frame. The report is written once the first frame has been drawn.
+#include "Main.h"
+#include <vector>
+
+#define STARTUP_REPORT_FILE		"startup.txt"
+#define STARTUP_MAX_DEPTH		8
+
+class CStartupProfiler
+{
+public:
+	CStartupProfiler();
+	~CStartupProfiler();
+
+	// Time zero, as early in WinMain as possible
+	void Start();
+
+	// Phases nest, EndPhase closes the last one begun
+	void BeginPhase(const char *szName);
+	void EndPhase();
+
+	// Called by the loader threads, times are performance counter values
+	void RecordAsset(const char *szName, __int64 iQueued, __int64 iStarted, __int64 iDone, bool bOk);
+
+	// Stops recording and writes the report, only the first call counts
+	void FirstFrame();
+
+	bool WriteReport(const char *szFileName);
+
+private:
+	CStartupProfiler(const CStartupProfiler& rhs);
+	CStartupProfiler& operator=(const CStartupProfiler& rhs);
+
+	double ToMs(__int64 iTicks) const { return iTicks * 1000.0 / m_iFrequency; }
+
+	typedef struct
+	{
+		char szName[64];
+		int iDepth;
+		__int64 iStart;
+		__int64 iEnd;
+	} sPhase;
+
+	typedef struct
+	{
+		char szName[MAX_PATH];
+		__int64 iQueued;
+		__int64 iStarted;
+		__int64 iDone;
+		DWORD dwThread;
+		bool bOk;
+	} sAssetLoad;
+
+	CRITICAL_SECTION m_cs;
+	__int64 m_iFrequency;
+	__int64 m_iStart;
+	__int64 m_iFirstFrame;
+	bool m_bRecording;
+
+	std::vector<sPhase> m_Phases;
+	int m_iOpen[STARTUP_MAX_DEPTH];		// indices of the phases still open
+	int m_iDepth;
+	std::vector<sAssetLoad> m_Assets;
+};
+
+extern CStartupProfiler g_Startup;
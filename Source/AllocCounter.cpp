@@ -0,0 +1,48 @@
+// AllocCounter.cpp
+// Counting replacements of the global operator new
+#include "AllocCounter.h"
+#include <new>
+#include <stdlib.h>
+
+static volatile LONG s_lAllocations = 0;
+
+LONG GetAllocationCount()
+{
+	return s_lAllocations;
+}
+
+void* operator new(size_t uSize)
+{
+	InterlockedIncrement(&s_lAllocations);
+
+	void *p = malloc(uSize ? uSize : 1);
+	if(!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t uSize)
+{
+	return operator new(uSize);
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	free(p);
+}
+
+// the sized forms too, a library default might not pass them on to free
+void operator delete(void *p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	free(p);
+}
@@ -0,0 +1,661 @@
+// AssetLoader.cpp
+// Background loading of sprite bitmaps
+#include "AssetLoader.h"
+#include "AssetPack.h"
+#include "BmpDecoder.h"
+#include "MappedFile.h"
+#include "StartupProfiler.h"
+#include <ctype.h>
+#include <math.h>
+#include <vector>
+
+extern HINSTANCE g_hInst;
+extern CAssetPack g_AssetPack;
+
+CBitmapAsset::CBitmapAsset(const char *szName, COLORREF crTransparent)
+{
+	strcpy_s(m_szName, MAX_PATH, szName);
+	m_crTransparent = crTransparent;
+	m_iStep = 0;
+	m_iSteps = 1;
+	m_lRefs = 1;
+	m_lState = ASSET_PENDING;
+	m_hBitmap = 0;
+	m_hMask = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+	m_iRequestTime = 0;
+	m_bReload = false;
+	m_hNextBitmap = 0;
+	m_hNextMask = 0;
+	m_iNextWidth = 0;
+	m_iNextHeight = 0;
+}
+
+CBitmapAsset::~CBitmapAsset()
+{
+	if(m_hBitmap)
+		DeleteObject(m_hBitmap);
+	if(m_hMask)
+		DeleteObject(m_hMask);
+	if(m_hNextBitmap)
+		DeleteObject(m_hNextBitmap);
+	if(m_hNextMask)
+		DeleteObject(m_hNextMask);
+}
+
+CBitmapAsset* CBitmapAsset::FromBitmap(HBITMAP hBitmap)
+{
+	CBitmapAsset *pAsset = new CBitmapAsset("", CLR_INVALID);
+	BITMAP bm;
+
+	pAsset->m_hBitmap = hBitmap;
+	if(hBitmap && GetObject(hBitmap, sizeof(BITMAP), &bm))
+	{
+		pAsset->m_iWidth = bm.bmWidth;
+		pAsset->m_iHeight = bm.bmHeight;
+		pAsset->m_lState = ASSET_READY;
+	}
+	else
+		pAsset->m_lState = ASSET_FAILED;
+
+	return pAsset;
+}
+
+void CBitmapAsset::Release()
+{
+	if(InterlockedDecrement(&m_lRefs) == 0)
+		delete this;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Decode a bitmap from the asset pack into a DIB section, falling back to
+// loading it from disk when the game runs without a pack. Hot reloads skip
+// the pack, it holds the old copy.
+static HBITMAP DecodeBitmap(const char *szFileName, bool bUsePack = true)
+{
+	const uint8_t *pData;
+	size_t uSize;
+	CBmpDecoder bmp;
+	CMappedFile file;
+
+	bool bFound = bUsePack && g_AssetPack.Find(szFileName, &pData, &uSize);
+	if(!bFound && file.Open(szFileName))
+	{
+		pData = file.Data();
+		uSize = file.Size();
+		bFound = true;
+	}
+
+	// formats the decoder does not handle go through GDI
+	if(!bFound || !bmp.Parse(pData, uSize))
+		return (HBITMAP)LoadImage(g_hInst, szFileName, IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION | LR_LOADFROMFILE);
+
+	// room for a full palette after the header
+	struct
+	{
+		BITMAPINFOHEADER bmiHeader;
+		RGBQUAD bmiColors[256];
+	} bmi;
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = bmp.Width();
+	bmi.bmiHeader.biHeight = bmp.Height();
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	// 8 bpp images stay 8 bpp, a quarter of the memory, GDI expands the
+	// palette when blitting
+	bool bIndexed = bmp.BitCount() == 8 && bmp.PaletteSize() > 0;
+	if(bIndexed)
+	{
+		bmi.bmiHeader.biBitCount = 8;
+		bmi.bmiHeader.biClrUsed = bmp.PaletteSize();
+		memcpy(bmi.bmiColors, bmp.Palette(), bmp.PaletteSize() * sizeof(RGBQUAD));
+	}
+	else
+		bmi.bmiHeader.biBitCount = 32;
+
+	void *pBits = NULL;
+	HBITMAP hBitmap = CreateDIBSection(NULL, (BITMAPINFO*)&bmi, DIB_RGB_COLORS, &pBits, NULL, 0);
+	if(hBitmap)
+	{
+		if(bIndexed)
+			bmp.DecodeIndices((uint8_t*)pBits, (bmp.Width() + 3) & ~3);
+		else
+			bmp.Decode((uint32_t*)pBits);
+	}
+
+	return hBitmap;
+}
+
+// Monochrome mask with 1 where the image has the transparent colour, built
+// the way Sprite::drawTransparent used to do it on every draw.
+static HBITMAP BuildTransparencyMask(HBITMAP hImage, int iWidth, int iHeight, COLORREF crTransparent)
+{
+	HBITMAP hMask = CreateBitmap(iWidth, iHeight, 1, 1, NULL);
+	if(!hMask)
+		return 0;
+
+	HDC dcImage = CreateCompatibleDC(NULL);
+	HDC dcMask = CreateCompatibleDC(NULL);
+	HGDIOBJ oldImage = SelectObject(dcImage, hImage);
+	HGDIOBJ oldMask = SelectObject(dcMask, hMask);
+
+	SetBkColor(dcImage, crTransparent);
+	BitBlt(dcMask, 0, 0, iWidth, iHeight, dcImage, 0, 0, SRCCOPY);
+
+	SelectObject(dcImage, oldImage);
+	SelectObject(dcMask, oldMask);
+	DeleteDC(dcImage);
+	DeleteDC(dcMask);
+
+	return hMask;
+}
+
+// Sine and cosine of a clockwise rotation by iStep / iSteps of a turn, exact
+// for quarter turns so those only move pixels around.
+static void RotationAngle(int iStep, int iSteps, double *pSin, double *pCos)
+{
+	if((iStep * 4) % iSteps == 0)
+	{
+		static const double dSin[4] = { 0, 1, 0, -1 };
+		int iQuarter = iStep * 4 / iSteps;
+		*pSin = dSin[iQuarter];
+		*pCos = dSin[(iQuarter + 1) & 3];
+		return;
+	}
+
+	double dAngle = 2.0 * 3.14159265358979323846 * iStep / iSteps;
+	*pSin = sin(dAngle);
+	*pCos = cos(dAngle);
+}
+
+// Size of the box holding the rotated image
+static void RotatedSize(int iWidth, int iHeight, int iStep, int iSteps, int *pWidth, int *pHeight)
+{
+	double dSin, dCos;
+	RotationAngle(iStep, iSteps, &dSin, &dCos);
+
+	*pWidth = (int)ceil(fabs(iWidth * dCos) + fabs(iHeight * dSin) - 1e-6);
+	*pHeight = (int)ceil(fabs(iWidth * dSin) + fabs(iHeight * dCos) - 1e-6);
+}
+
+// Rotated copy of a bitmap around its centre. Every pixel takes the nearest
+// source pixel, blending would smear the transparent colour into the edges.
+// Corners left uncovered get crFill.
+static HBITMAP RotateBitmap(HBITMAP hSource, int iStep, int iSteps, COLORREF crFill)
+{
+	BITMAP bm;
+	if(!GetObject(hSource, sizeof(BITMAP), &bm))
+		return 0;
+
+	int iWidth = bm.bmWidth;
+	int iHeight = bm.bmHeight;
+	int iNewWidth, iNewHeight;
+	RotatedSize(iWidth, iHeight, iStep, iSteps, &iNewWidth, &iNewHeight);
+
+	// both images are top-down 32 bit
+	BITMAPINFO bmi;
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = iWidth;
+	bmi.bmiHeader.biHeight = -iHeight;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	std::vector<uint32_t> source((size_t)iWidth * iHeight);
+	HDC hdc = CreateCompatibleDC(NULL);
+	int iLines = GetDIBits(hdc, hSource, 0, iHeight, &source[0], &bmi, DIB_RGB_COLORS);
+	DeleteDC(hdc);
+	if(iLines != iHeight)
+		return 0;
+
+	bmi.bmiHeader.biWidth = iNewWidth;
+	bmi.bmiHeader.biHeight = -iNewHeight;
+
+	uint32_t *pBits = NULL;
+	HBITMAP hBitmap = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void**)&pBits, NULL, 0);
+	if(!hBitmap)
+		return 0;
+
+	double dSin, dCos;
+	RotationAngle(iStep, iSteps, &dSin, &dCos);
+
+	uint32_t uFill = (GetRValue(crFill) << 16) | (GetGValue(crFill) << 8) | GetBValue(crFill);
+
+	// walk the destination and rotate each pixel centre back into the source
+	for(int y = 0; y < iNewHeight; y++)
+	{
+		double dy = y + 0.5 - iNewHeight * 0.5;
+		for(int x = 0; x < iNewWidth; x++)
+		{
+			double dx = x + 0.5 - iNewWidth * 0.5;
+			int sx = (int)floor(dCos * dx + dSin * dy + iWidth * 0.5);
+			int sy = (int)floor(dCos * dy - dSin * dx + iHeight * 0.5);
+
+			if(sx >= 0 && sx < iWidth && sy >= 0 && sy < iHeight)
+				*pBits++ = source[(size_t)sy * iWidth + sx];
+			else
+				*pBits++ = uFill;
+		}
+	}
+
+	return hBitmap;
+}
+
+CAssetLoader::CAssetLoader()
+{
+	InitializeCriticalSection(&m_cs);
+	m_hWork = 0;
+	m_hIdle = 0;
+	m_lBusy = 0;
+	m_iThreadCount = 0;
+	m_lQuit = 0;
+	ZeroMemory(m_hThreads, sizeof(m_hThreads));
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_dTotalLatency = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&m_iFrequency);
+}
+
+CAssetLoader::~CAssetLoader()
+{
+	Shutdown();
+	DeleteCriticalSection(&m_cs);
+}
+
+bool CAssetLoader::Start(int iThreads)
+{
+	if(m_iThreadCount)
+		return true;
+
+	if(iThreads < 1)
+		iThreads = 1;
+	if(iThreads > LOADER_MAX_THREADS)
+		iThreads = LOADER_MAX_THREADS;
+
+	m_lQuit = 0;
+	m_hWork = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL);
+	m_hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if(!m_hWork || !m_hIdle)
+		return false;
+
+	for(int i = 0; i < iThreads; i++)
+	{
+		m_hThreads[i] = CreateThread(NULL, 0, WorkerProc, this, 0, NULL);
+		if(!m_hThreads[i])
+			break;
+
+		// decoding must not take time from the game thread
+		SetThreadPriority(m_hThreads[i], THREAD_PRIORITY_BELOW_NORMAL);
+		m_iThreadCount++;
+	}
+
+	return m_iThreadCount > 0;
+}
+
+void CAssetLoader::Shutdown()
+{
+	if(m_iThreadCount)
+	{
+		InterlockedExchange(&m_lQuit, 1);
+		ReleaseSemaphore(m_hWork, m_iThreadCount, NULL);
+		WaitForMultipleObjects(m_iThreadCount, m_hThreads, TRUE, INFINITE);
+
+		for(int i = 0; i < m_iThreadCount; i++)
+		{
+			CloseHandle(m_hThreads[i]);
+			m_hThreads[i] = 0;
+		}
+		m_iThreadCount = 0;
+	}
+
+	if(m_hWork)
+	{
+		CloseHandle(m_hWork);
+		m_hWork = 0;
+	}
+	if(m_hIdle)
+	{
+		CloseHandle(m_hIdle);
+		m_hIdle = 0;
+	}
+
+	// drop the references held by the queue and the cache, sprites still
+	// alive keep their own
+	EnterCriticalSection(&m_cs);
+	for(size_t i = 0; i < m_Queue.size(); i++)
+		m_Queue[i]->Release();
+	m_Queue.clear();
+	m_lBusy = 0;
+
+	for(size_t i = 0; i < m_Reloaded.size(); i++)
+		m_Reloaded[i]->Release();
+	m_Reloaded.clear();
+
+	for(std::map<std::string, CBitmapAsset*>::iterator it = m_Cache.begin(); it != m_Cache.end(); ++it)
+		it->second->Release();
+	m_Cache.clear();
+	LeaveCriticalSection(&m_cs);
+}
+
+void CAssetLoader::ReadSize(CBitmapAsset *pAsset)
+{
+	const uint8_t *pData;
+	size_t uSize;
+	CBmpDecoder bmp;
+	CMappedFile file;
+
+	// the pack is mapped, reading the header costs no disk access. A loose
+	// file is mapped too, only the page holding the headers is read.
+	if(!g_AssetPack.Find(pAsset->m_szName, &pData, &uSize) || !bmp.Parse(pData, uSize))
+	{
+		if(!file.Open(pAsset->m_szName) || !bmp.Parse(file.Data(), file.Size()))
+			return;
+	}
+
+	pAsset->m_iWidth = bmp.Width();
+	pAsset->m_iHeight = bmp.Height();
+	if(pAsset->m_iStep)
+		RotatedSize(bmp.Width(), bmp.Height(), pAsset->m_iStep, pAsset->m_iSteps, &pAsset->m_iWidth, &pAsset->m_iHeight);
+}
+
+// Cache keys start with the lower case path using '/', the colour key and
+// rotation follow after a '|'
+void CAssetLoader::MakeKey(const char *szFileName, char *szKey, size_t uKeySize)
+{
+	size_t i = 0;
+
+	for(; szFileName[i] && i < uKeySize - 1; i++)
+		szKey[i] = szFileName[i] == '\\' ? '/' : (char)tolower((unsigned char)szFileName[i]);
+	szKey[i] = 0;
+}
+
+CBitmapAsset* CAssetLoader::AcquireBitmap(const char *szFileName, COLORREF crTransparent, int iStep, int iSteps)
+{
+	char szKey[MAX_PATH + 40];
+
+	if(iSteps < 1)
+		iSteps = 1;
+	iStep = (iStep % iSteps + iSteps) % iSteps;
+
+	MakeKey(szFileName, szKey, MAX_PATH);
+	size_t i = strlen(szKey);
+	if(iStep)
+		sprintf_s(szKey + i, sizeof(szKey) - i, "|%08X|%d/%d", crTransparent, iStep, iSteps);
+	else
+		sprintf_s(szKey + i, sizeof(szKey) - i, "|%08X", crTransparent);
+
+	EnterCriticalSection(&m_cs);
+
+	m_Stats.uRequests++;
+
+	std::map<std::string, CBitmapAsset*>::iterator it = m_Cache.find(szKey);
+	if(it != m_Cache.end())
+	{
+		CBitmapAsset *pAsset = it->second;
+		pAsset->AddRef();
+		m_Stats.uCacheHits++;
+		LeaveCriticalSection(&m_cs);
+		return pAsset;
+	}
+
+	// one reference for the cache, one for the caller
+	CBitmapAsset *pAsset = new CBitmapAsset(szFileName, crTransparent);
+	pAsset->m_iStep = iStep;
+	pAsset->m_iSteps = iSteps;
+	pAsset->AddRef();
+	m_Cache[szKey] = pAsset;
+	ReadSize(pAsset);
+
+	if(!m_iThreadCount)
+	{
+		LeaveCriticalSection(&m_cs);
+		QueryPerformanceCounter((LARGE_INTEGER*)&pAsset->m_iRequestTime);
+		Load(pAsset);
+		return pAsset;
+	}
+
+	// and one for the queue until a worker is done with it
+	pAsset->AddRef();
+	QueryPerformanceCounter((LARGE_INTEGER*)&pAsset->m_iRequestTime);
+	m_Queue.push_back(pAsset);
+	if(m_lBusy++ == 0)
+		ResetEvent(m_hIdle);
+
+	m_Stats.uQueueDepth = (UINT)m_Queue.size();
+	if(m_Stats.uQueueDepth > m_Stats.uMaxQueueDepth)
+		m_Stats.uMaxQueueDepth = m_Stats.uQueueDepth;
+
+	LeaveCriticalSection(&m_cs);
+
+	ReleaseSemaphore(m_hWork, 1, NULL);
+
+	return pAsset;
+}
+
+void CAssetLoader::Load(CBitmapAsset *pAsset)
+{
+	__int64 iStart;
+	QueryPerformanceCounter((LARGE_INTEGER*)&iStart);
+
+	bool bReload = pAsset->m_bReload;
+	HBITMAP hBitmap = DecodeBitmap(pAsset->m_szName, !bReload);
+	HBITMAP hMask = 0;
+	BITMAP bm;
+
+	// uncovered corners of a rotated image must not show, sprites drawn
+	// with a mask treat black as empty
+	if(hBitmap && pAsset->m_iStep)
+	{
+		HBITMAP hRotated = RotateBitmap(hBitmap, pAsset->m_iStep, pAsset->m_iSteps,
+			pAsset->m_crTransparent != CLR_INVALID ? pAsset->m_crTransparent : RGB(0, 0, 0));
+		DeleteObject(hBitmap);
+		hBitmap = hRotated;
+	}
+
+	bool bOk = hBitmap && GetObject(hBitmap, sizeof(BITMAP), &bm);
+
+	if(bOk && pAsset->m_crTransparent != CLR_INVALID)
+	{
+		hMask = BuildTransparencyMask(hBitmap, bm.bmWidth, bm.bmHeight, pAsset->m_crTransparent);
+		bOk = hMask != 0;
+	}
+
+	if(!bOk && hBitmap)
+		DeleteObject(hBitmap);
+
+	if(bReload)
+	{
+		// sprites may be drawing the current bitmap, keep it until the swap.
+		// A file caught half written fails and keeps the old version, the
+		// watcher reports it again once the write completes.
+		EnterCriticalSection(&m_cs);
+		if(bOk)
+		{
+			if(pAsset->m_hNextBitmap)
+				DeleteObject(pAsset->m_hNextBitmap);
+			if(pAsset->m_hNextMask)
+				DeleteObject(pAsset->m_hNextMask);
+			pAsset->m_hNextBitmap = hBitmap;
+			pAsset->m_hNextMask = hMask;
+			pAsset->m_iNextWidth = bm.bmWidth;
+			pAsset->m_iNextHeight = bm.bmHeight;
+
+			pAsset->AddRef();
+			m_Reloaded.push_back(pAsset);
+		}
+		pAsset->m_bReload = false;
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+
+	if(bOk)
+	{
+		pAsset->m_hBitmap = hBitmap;
+		pAsset->m_hMask = hMask;
+		pAsset->m_iWidth = bm.bmWidth;
+		pAsset->m_iHeight = bm.bmHeight;
+	}
+
+	__int64 iNow;
+	QueryPerformanceCounter((LARGE_INTEGER*)&iNow);
+	double dLatency = double(iNow - pAsset->m_iRequestTime) * 1000.0 / m_iFrequency;
+
+	EnterCriticalSection(&m_cs);
+	if(bOk)
+		m_Stats.uLoaded++;
+	else
+		m_Stats.uFailed++;
+	m_dTotalLatency += dLatency;
+	if(dLatency > m_Stats.fMaxLatency)
+		m_Stats.fMaxLatency = (float)dLatency;
+	LeaveCriticalSection(&m_cs);
+
+	g_Startup.RecordAsset(pAsset->m_szName, pAsset->m_iRequestTime, iStart, iNow, bOk);
+
+	// publish last, the game thread reads the bitmap once the state is ready
+	InterlockedExchange(&pAsset->m_lState, bOk ? ASSET_READY : ASSET_FAILED);
+}
+
+DWORD WINAPI CAssetLoader::WorkerProc(LPVOID lpParam)
+{
+	CAssetLoader *pLoader = (CAssetLoader*)lpParam;
+
+	for(;;)
+	{
+		WaitForSingleObject(pLoader->m_hWork, INFINITE);
+		if(pLoader->m_lQuit)
+			break;
+
+		EnterCriticalSection(&pLoader->m_cs);
+		CBitmapAsset *pAsset = NULL;
+		if(!pLoader->m_Queue.empty())
+		{
+			pAsset = pLoader->m_Queue.front();
+			pLoader->m_Queue.pop_front();
+			pLoader->m_Stats.uQueueDepth = (UINT)pLoader->m_Queue.size();
+		}
+		LeaveCriticalSection(&pLoader->m_cs);
+
+		if(pAsset)
+		{
+			pLoader->Load(pAsset);
+			pAsset->Release();
+
+			EnterCriticalSection(&pLoader->m_cs);
+			if(--pLoader->m_lBusy == 0)
+				SetEvent(pLoader->m_hIdle);
+			LeaveCriticalSection(&pLoader->m_cs);
+		}
+	}
+
+	return 0;
+}
+
+UINT CAssetLoader::Reload(const char *szFileName)
+{
+	char szKey[MAX_PATH];
+	std::vector<CBitmapAsset*> assets;
+
+	MakeKey(szFileName, szKey, MAX_PATH);
+	size_t uLength = strlen(szKey);
+
+	EnterCriticalSection(&m_cs);
+
+	for(std::map<std::string, CBitmapAsset*>::iterator it = m_Cache.lower_bound(szKey); it != m_Cache.end(); ++it)
+	{
+		if(it->first.compare(0, uLength, szKey) || it->first[uLength] != '|')
+			break;
+
+		// a first load still running reads the file anyway
+		CBitmapAsset *pAsset = it->second;
+		if(pAsset->m_lState == ASSET_PENDING || pAsset->m_bReload)
+			continue;
+
+		pAsset->m_bReload = true;
+		pAsset->AddRef();
+		QueryPerformanceCounter((LARGE_INTEGER*)&pAsset->m_iRequestTime);
+		assets.push_back(pAsset);
+
+		if(m_iThreadCount)
+		{
+			m_Queue.push_back(pAsset);
+			if(m_lBusy++ == 0)
+				ResetEvent(m_hIdle);
+		}
+	}
+
+	LeaveCriticalSection(&m_cs);
+
+	if(m_iThreadCount)
+	{
+		if(!assets.empty())
+			ReleaseSemaphore(m_hWork, (LONG)assets.size(), NULL);
+	}
+	else
+	{
+		for(size_t i = 0; i < assets.size(); i++)
+		{
+			Load(assets[i]);
+			assets[i]->Release();
+		}
+	}
+
+	return (UINT)assets.size();
+}
+
+void CAssetLoader::ApplyReloads()
+{
+	std::vector<CBitmapAsset*> reloaded;
+
+	EnterCriticalSection(&m_cs);
+	if(m_Reloaded.empty())
+	{
+		LeaveCriticalSection(&m_cs);
+		return;
+	}
+	reloaded.swap(m_Reloaded);
+	m_Stats.uReloaded += (UINT)reloaded.size();
+	LeaveCriticalSection(&m_cs);
+
+	// nothing is being drawn between frames, the old bitmaps can go
+	for(size_t i = 0; i < reloaded.size(); i++)
+	{
+		CBitmapAsset *pAsset = reloaded[i];
+
+		if(pAsset->m_hBitmap)
+			DeleteObject(pAsset->m_hBitmap);
+		if(pAsset->m_hMask)
+			DeleteObject(pAsset->m_hMask);
+
+		pAsset->m_hBitmap = pAsset->m_hNextBitmap;
+		pAsset->m_hMask = pAsset->m_hNextMask;
+		pAsset->m_iWidth = pAsset->m_iNextWidth;
+		pAsset->m_iHeight = pAsset->m_iNextHeight;
+		pAsset->m_hNextBitmap = 0;
+		pAsset->m_hNextMask = 0;
+		InterlockedExchange(&pAsset->m_lState, ASSET_READY);
+
+		pAsset->Release();
+	}
+}
+
+bool CAssetLoader::WaitIdle(DWORD dwTimeout)
+{
+	if(!m_iThreadCount)
+		return true;
+
+	return WaitForSingleObject(m_hIdle, dwTimeout) == WAIT_OBJECT_0;
+}
+
+void CAssetLoader::GetStats(sLoaderStats &stats)
+{
+	EnterCriticalSection(&m_cs);
+	stats = m_Stats;
+	UINT uDone = m_Stats.uLoaded + m_Stats.uFailed;
+	stats.fAvgLatency = uDone ? (float)(m_dTotalLatency / uDone) : 0.0f;
+	LeaveCriticalSection(&m_cs);
+}
@@ -0,0 +1,407 @@
+// AssetPack.cpp
+// Single file pack of the game data, mapped once and read in place.
+#include "AssetPack.h"
+#include "BmpDecoder.h"
+#include <ctype.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+
+
+CAssetPack::CAssetPack()
+{
+	m_pEntries = NULL;
+	m_uEntryCount = 0;
+}
+
+void CAssetPack::NormalizeName(const char *szName, char *szOut)
+{
+	int i = 0;
+
+	for(; szName[i] && i < PACK_MAX_NAME - 1; i++)
+		szOut[i] = szName[i] == '\\' ? '/' : (char)tolower((unsigned char)szName[i]);
+
+	szOut[i] = '\0';
+}
+
+bool CAssetPack::Open(const char *szPackFile)
+{
+	Close();
+
+	if(!m_File.Open(szPackFile))
+		return false;
+
+	const sPackHeader *pHeader = (const sPackHeader*)m_File.Data();
+	if(m_File.Size() < sizeof(sPackHeader) || pHeader->uMagic != PACK_MAGIC || pHeader->uVersion != PACK_VERSION ||
+		pHeader->uEntryCount > (m_File.Size() - sizeof(sPackHeader)) / sizeof(sPackEntry))
+	{
+		m_File.Close();
+		return false;
+	}
+
+	const sPackEntry *pEntries = (const sPackEntry*)(pHeader + 1);
+	for(uint32_t i = 0; i < pHeader->uEntryCount; i++)
+	{
+		if(pEntries[i].uOffset > m_File.Size() || pEntries[i].uSize > m_File.Size() - pEntries[i].uOffset)
+		{
+			m_File.Close();
+			return false;
+		}
+	}
+
+	m_pEntries = pEntries;
+	m_uEntryCount = pHeader->uEntryCount;
+
+	return true;
+}
+
+void CAssetPack::Close()
+{
+	m_File.Close();
+	m_pEntries = NULL;
+	m_uEntryCount = 0;
+}
+
+bool CAssetPack::Find(const char *szName, const uint8_t **ppData, size_t *puSize, EAssetFormat *pFormat) const
+{
+	if(!m_pEntries)
+		return false;
+
+	char szKey[PACK_MAX_NAME];
+	NormalizeName(szName, szKey);
+
+	// entries are sorted by name
+	uint32_t lo = 0, hi = m_uEntryCount;
+	while(lo < hi)
+	{
+		uint32_t mid = (lo + hi) / 2;
+		int cmp = strncmp(szKey, m_pEntries[mid].szName, PACK_MAX_NAME);
+
+		if(cmp == 0)
+		{
+			*ppData = m_File.Data() + m_pEntries[mid].uOffset;
+			*puSize = m_pEntries[mid].uSize;
+			if(pFormat)
+				*pFormat = (EAssetFormat)m_pEntries[mid].uFormat;
+			return true;
+		}
+
+		if(cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return false;
+}
+
+static bool EntryLess(const sPackEntry &a, const sPackEntry &b)
+{
+	return strncmp(a.szName, b.szName, PACK_MAX_NAME) < 0;
+}
+
+typedef struct
+{
+	uint32_t uColor;
+	uint32_t uCount;
+} sColorCount;
+
+static int Channel(uint32_t uColor, int iChannel)
+{
+	return (uColor >> (iChannel * 8)) & 0xFF;
+}
+
+static int g_iSortChannel;
+static bool ChannelLess(const sColorCount &a, const sColorCount &b)
+{
+	return Channel(a.uColor, g_iSortChannel) < Channel(b.uColor, g_iSortChannel);
+}
+
+// Median cut: the box of colours with the widest channel range is split at
+// its pixel weighted median until there are uMaxColors boxes, each gives the
+// weighted mean of its colours.
+static void MedianCut(std::vector<sColorCount> &colors, size_t uMaxColors, std::vector<uint32_t> &palette)
+{
+	std::vector< std::pair<size_t, size_t> > boxes;
+	if(!colors.empty())
+		boxes.push_back(std::make_pair((size_t)0, colors.size()));
+
+	while(boxes.size() < uMaxColors)
+	{
+		int iBest = -1, iBestChannel = 0, iBestRange = 0;
+		for(size_t i = 0; i < boxes.size(); i++)
+		{
+			for(int c = 0; c < 3; c++)
+			{
+				int iMin = 255, iMax = 0;
+				for(size_t j = boxes[i].first; j < boxes[i].second; j++)
+				{
+					int v = Channel(colors[j].uColor, c);
+					iMin = v < iMin ? v : iMin;
+					iMax = v > iMax ? v : iMax;
+				}
+				if(iMax - iMin > iBestRange)
+				{
+					iBest = (int)i;
+					iBestChannel = c;
+					iBestRange = iMax - iMin;
+				}
+			}
+		}
+		if(iBest < 0)
+			break;		// every box holds a single colour
+
+		size_t uBegin = boxes[iBest].first, uEnd = boxes[iBest].second;
+		g_iSortChannel = iBestChannel;
+		std::sort(colors.begin() + uBegin, colors.begin() + uEnd, ChannelLess);
+
+		uint64_t uTotal = 0, uHalf = 0;
+		for(size_t j = uBegin; j < uEnd; j++)
+			uTotal += colors[j].uCount;
+		size_t uSplit = uBegin + 1;
+		for(; uSplit < uEnd - 1; uSplit++)
+		{
+			uHalf += colors[uSplit - 1].uCount;
+			if(uHalf * 2 >= uTotal)
+				break;
+		}
+
+		boxes[iBest].second = uSplit;
+		boxes.push_back(std::make_pair(uSplit, uEnd));
+	}
+
+	for(size_t i = 0; i < boxes.size(); i++)
+	{
+		uint64_t uSum[3] = { 0, 0, 0 }, uCount = 0;
+		for(size_t j = boxes[i].first; j < boxes[i].second; j++)
+		{
+			for(int c = 0; c < 3; c++)
+				uSum[c] += (uint64_t)Channel(colors[j].uColor, c) * colors[j].uCount;
+			uCount += colors[j].uCount;
+		}
+		palette.push_back((uint32_t)((uSum[0] + uCount / 2) / uCount) |
+			((uint32_t)((uSum[1] + uCount / 2) / uCount) << 8) |
+			((uint32_t)((uSum[2] + uCount / 2) / uCount) << 16));
+	}
+}
+
+// Rewrite a true colour bitmap as an 8 bpp one. Images with at most 256
+// colours convert losslessly, others only when bQuantize allows reducing
+// them. Black and the magenta colour key stay exact, sprites rely on them
+// for transparency.
+static bool IndexBitmap(const uint8_t *pData, size_t uSize, bool bQuantize, std::vector<uint8_t> &out)
+{
+	CBmpDecoder bmp;
+	if(!bmp.Parse(pData, uSize) || bmp.BitCount() <= 8)
+		return false;
+
+	int iWidth = bmp.Width();
+	int iHeight = bmp.Height();
+	std::vector<uint32_t> pixels((size_t)iWidth * iHeight);
+	bmp.Decode(&pixels[0]);
+
+	// distinct colours with their pixel counts, sorted by colour
+	std::vector<uint32_t> sorted(pixels);
+	std::sort(sorted.begin(), sorted.end());
+	std::vector<sColorCount> colors;
+	for(size_t i = 0; i < sorted.size(); i++)
+	{
+		if(colors.empty() || colors.back().uColor != sorted[i])
+		{
+			sColorCount cc = { sorted[i], 0 };
+			colors.push_back(cc);
+		}
+		colors.back().uCount++;
+	}
+
+	std::vector<uint32_t> keys(colors.size());
+	for(size_t i = 0; i < colors.size(); i++)
+		keys[i] = colors[i].uColor;
+
+	std::vector<uint32_t> palette;
+	std::vector<uint8_t> map(colors.size());
+
+	if(colors.size() <= 256)
+	{
+		palette = keys;
+		for(size_t i = 0; i < map.size(); i++)
+			map[i] = (uint8_t)i;
+	}
+	else if(!bQuantize)
+		return false;
+	else
+	{
+		static const uint32_t uExact[2] = { 0x000000, 0xFF00FF };
+		std::vector<sColorCount> rest;
+		for(size_t i = 0; i < colors.size(); i++)
+		{
+			if(colors[i].uColor == uExact[0] || colors[i].uColor == uExact[1])
+				palette.push_back(colors[i].uColor);
+			else
+				rest.push_back(colors[i]);
+		}
+		size_t uReserved = palette.size();
+		MedianCut(rest, 256 - uReserved, palette);
+
+		// nearest entry, the exact ones only take their own colour
+		for(size_t i = 0; i < keys.size(); i++)
+		{
+			size_t uBest = 0;
+			int iBest = 0x7FFFFFFF;
+			for(size_t j = 0; j < palette.size(); j++)
+			{
+				if(j < uReserved && palette[j] != keys[i])
+					continue;
+				int d0 = Channel(keys[i], 0) - Channel(palette[j], 0);
+				int d1 = Channel(keys[i], 1) - Channel(palette[j], 1);
+				int d2 = Channel(keys[i], 2) - Channel(palette[j], 2);
+				int iDist = d0 * d0 + d1 * d1 + d2 * d2;
+				if(iDist < iBest)
+				{
+					iBest = iDist;
+					uBest = j;
+				}
+			}
+			map[i] = (uint8_t)uBest;
+		}
+	}
+
+	size_t uStride = (iWidth + 3) & ~3;
+	size_t uHeaders = 14 + 40 + palette.size() * 4;
+	out.assign(uHeaders + uStride * iHeight, 0);
+
+	// BITMAPFILEHEADER and BITMAPINFOHEADER, written byte by byte so the
+	// layout does not depend on structure packing
+	uint8_t *p = &out[0];
+	uint32_t uFields[] = { (uint32_t)out.size(), 0, (uint32_t)uHeaders, 40, (uint32_t)iWidth, (uint32_t)iHeight };
+	p[0] = 'B';
+	p[1] = 'M';
+	for(int i = 0; i < 6; i++)
+		memcpy(p + 2 + i * 4, &uFields[i], 4);
+	uint16_t uPlanes = 1, uBitCount = 8;
+	memcpy(p + 26, &uPlanes, 2);
+	memcpy(p + 28, &uBitCount, 2);
+	uint32_t uColors = (uint32_t)palette.size();
+	memcpy(p + 46, &uColors, 4);
+	memcpy(p + 54, &palette[0], palette.size() * 4);
+
+	// both the decoded pixels and the output are bottom-up
+	uint8_t *pRow = p + uHeaders;
+	for(int y = 0; y < iHeight; y++, pRow += uStride)
+	{
+		const uint32_t *pSrc = &pixels[(size_t)y * iWidth];
+		for(int x = 0; x < iWidth; x++)
+			pRow[x] = map[std::lower_bound(keys.begin(), keys.end(), pSrc[x]) - keys.begin()];
+	}
+
+	return true;
+}
+
+bool CAssetPack::Build(const char *szDirectory, const char *szPackFile, EPackIndexing eIndexing)
+{
+	std::vector<sPackEntry> entries;
+	char szPattern[MAX_PATH];
+	WIN32_FIND_DATA fd;
+
+	sprintf_s(szPattern, "%s\\*", szDirectory);
+	HANDLE hFind = FindFirstFile(szPattern, &fd);
+	if(hFind == INVALID_HANDLE_VALUE)
+		return false;
+
+	do
+	{
+		if(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+
+		const char *szExt = strrchr(fd.cFileName, '.');
+		sPackEntry entry;
+		ZeroMemory(&entry, sizeof(entry));
+
+		if(szExt && !_stricmp(szExt, ".bmp"))
+			entry.uFormat = ASSET_BMP;
+		else if(szExt && !_stricmp(szExt, ".wav"))
+			entry.uFormat = ASSET_WAV;
+		else
+			continue;		// save games and other run time files stay outside
+
+		char szName[MAX_PATH];
+		sprintf_s(szName, "%s/%s", szDirectory, fd.cFileName);
+		if(strlen(szName) >= PACK_MAX_NAME)
+			continue;
+
+		NormalizeName(szName, entry.szName);
+		entry.uSize = fd.nFileSizeLow;
+		entries.push_back(entry);
+	} while(FindNextFile(hFind, &fd));
+
+	FindClose(hFind);
+
+	std::sort(entries.begin(), entries.end(), EntryLess);
+
+	// converted bitmaps are kept until they are written, the other files are
+	// copied from disk
+	std::vector< std::vector<uint8_t> > converted(entries.size());
+	for(size_t i = 0; i < entries.size() && eIndexing != PACK_INDEX_NONE; i++)
+	{
+		CMappedFile src;
+		if(entries[i].uFormat == ASSET_BMP && src.Open(entries[i].szName) &&
+			IndexBitmap(src.Data(), src.Size(), eIndexing == PACK_INDEX_QUANTIZE, converted[i]))
+		{
+			entries[i].uFormat = ASSET_BMP_INDEXED;
+			entries[i].uSize = (uint32_t)converted[i].size();
+		}
+	}
+
+	// lay the contents out after the index
+	uint32_t uOffset = sizeof(sPackHeader) + (uint32_t)entries.size() * sizeof(sPackEntry);
+	for(size_t i = 0; i < entries.size(); i++)
+	{
+		uOffset = (uOffset + PACK_ALIGNMENT - 1) & ~(PACK_ALIGNMENT - 1);
+		entries[i].uOffset = uOffset;
+		uOffset += entries[i].uSize;
+	}
+
+	FILE *fout = NULL;
+	if(fopen_s(&fout, szPackFile, "wb") || !fout)
+		return false;
+
+	sPackHeader header;
+	ZeroMemory(&header, sizeof(header));
+	header.uMagic = PACK_MAGIC;
+	header.uVersion = PACK_VERSION;
+	header.uEntryCount = (uint32_t)entries.size();
+
+	bool bOk = fwrite(&header, sizeof(header), 1, fout) == 1;
+	if(bOk && !entries.empty())
+		bOk = fwrite(&entries[0], sizeof(sPackEntry), entries.size(), fout) == entries.size();
+
+	for(size_t i = 0; i < entries.size() && bOk; i++)
+	{
+		static const char padding[PACK_ALIGNMENT] = { 0 };
+		size_t uPad = entries[i].uOffset - ftell(fout);
+		bOk = fwrite(padding, 1, uPad, fout) == uPad;
+
+		if(bOk && !converted[i].empty())
+		{
+			bOk = fwrite(&converted[i][0], 1, converted[i].size(), fout) == converted[i].size();
+			continue;
+		}
+
+		// other files are copied as they are
+		CMappedFile src;
+		if(!src.Open(entries[i].szName) || src.Size() != entries[i].uSize)
+		{
+			bOk = false;
+			break;
+		}
+
+		bOk = bOk && fwrite(src.Data(), 1, src.Size(), fout) == src.Size();
+	}
+
+	fclose(fout);
+
+	if(!bOk)
+		remove(szPackFile);
+
+	return bOk;
+}
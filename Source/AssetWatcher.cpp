@@ -0,0 +1,173 @@
+// AssetWatcher.cpp
+// Watches the data folder for changed bitmaps
+#include "AssetWatcher.h"
+#include <ctype.h>
+
+CAssetWatcher::CAssetWatcher()
+{
+	InitializeCriticalSection(&m_cs);
+	m_szDirectory[0] = 0;
+	m_hDirectory = INVALID_HANDLE_VALUE;
+	m_hQuit = 0;
+	m_hThread = 0;
+}
+
+CAssetWatcher::~CAssetWatcher()
+{
+	Shutdown();
+	DeleteCriticalSection(&m_cs);
+}
+
+bool CAssetWatcher::Start(const char *szDirectory)
+{
+	if(m_hThread)
+		return true;
+
+	strcpy_s(m_szDirectory, MAX_PATH, szDirectory);
+
+	m_hDirectory = CreateFile(szDirectory, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+		NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL);
+	if(m_hDirectory == INVALID_HANDLE_VALUE)
+		return false;
+
+	m_hQuit = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(m_hQuit)
+		m_hThread = CreateThread(NULL, 0, WatchProc, this, 0, NULL);
+
+	if(!m_hThread)
+	{
+		Shutdown();
+		return false;
+	}
+
+	return true;
+}
+
+void CAssetWatcher::Shutdown()
+{
+	if(m_hThread)
+	{
+		SetEvent(m_hQuit);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = 0;
+	}
+
+	if(m_hQuit)
+	{
+		CloseHandle(m_hQuit);
+		m_hQuit = 0;
+	}
+	if(m_hDirectory != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(m_hDirectory);
+		m_hDirectory = INVALID_HANDLE_VALUE;
+	}
+
+	EnterCriticalSection(&m_cs);
+	m_Changed.clear();
+	LeaveCriticalSection(&m_cs);
+}
+
+bool CAssetWatcher::Poll(std::vector<std::string> &files)
+{
+	files.clear();
+
+	DWORD dwNow = timeGetTime();
+
+	EnterCriticalSection(&m_cs);
+	std::map<std::string, DWORD>::iterator it = m_Changed.begin();
+	while(it != m_Changed.end())
+	{
+		if(dwNow - it->second >= WATCH_SETTLE_TIME)
+		{
+			files.push_back(it->first);
+			m_Changed.erase(it++);
+		}
+		else
+			++it;
+	}
+	LeaveCriticalSection(&m_cs);
+
+	return !files.empty();
+}
+
+void CAssetWatcher::Record(const FILE_NOTIFY_INFORMATION *pInfo)
+{
+	if(pInfo->Action != FILE_ACTION_ADDED && pInfo->Action != FILE_ACTION_MODIFIED &&
+		pInfo->Action != FILE_ACTION_RENAMED_NEW_NAME)
+		return;
+
+	char szName[MAX_PATH];
+	int iLength = WideCharToMultiByte(CP_ACP, 0, pInfo->FileName, pInfo->FileNameLength / sizeof(WCHAR),
+		szName, MAX_PATH - 1, NULL, NULL);
+	if(iLength < 5)
+		return;
+	szName[iLength] = 0;
+
+	char szPath[MAX_PATH];
+	int iPath = sprintf_s(szPath, MAX_PATH, "%s/%s", m_szDirectory, szName);
+	if(iPath < 5)
+		return;
+
+	// same form as the asset loader keys
+	for(int i = 0; i < iPath; i++)
+		szPath[i] = szPath[i] == '\\' ? '/' : (char)tolower((unsigned char)szPath[i]);
+
+	if(strcmp(szPath + iPath - 4, ".bmp"))
+		return;
+
+	EnterCriticalSection(&m_cs);
+	m_Changed[szPath] = timeGetTime();
+	LeaveCriticalSection(&m_cs);
+}
+
+DWORD WINAPI CAssetWatcher::WatchProc(LPVOID lpParam)
+{
+	CAssetWatcher *pWatcher = (CAssetWatcher*)lpParam;
+
+	OVERLAPPED ov;
+	HANDLE hDone = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!hDone)
+		return 1;
+
+	HANDLE hWait[2] = { pWatcher->m_hQuit, hDone };
+
+	for(;;)
+	{
+		ZeroMemory(&ov, sizeof(ov));
+		ov.hEvent = hDone;
+		ResetEvent(hDone);
+
+		if(!ReadDirectoryChangesW(pWatcher->m_hDirectory, pWatcher->m_dwBuffer, sizeof(pWatcher->m_dwBuffer), FALSE,
+			FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE, NULL, &ov, NULL))
+			break;
+
+		DWORD dwBytes = 0;
+		if(WaitForMultipleObjects(2, hWait, FALSE, INFINITE) != WAIT_OBJECT_0 + 1)
+		{
+			// the buffer must not be written to once the thread is gone
+			CancelIo(pWatcher->m_hDirectory);
+			GetOverlappedResult(pWatcher->m_hDirectory, &ov, &dwBytes, TRUE);
+			break;
+		}
+
+		if(!GetOverlappedResult(pWatcher->m_hDirectory, &ov, &dwBytes, FALSE))
+			break;
+
+		// zero bytes means the buffer overflowed and the changes were lost
+		const BYTE *pEntry = (const BYTE*)pWatcher->m_dwBuffer;
+		while(dwBytes)
+		{
+			const FILE_NOTIFY_INFORMATION *pInfo = (const FILE_NOTIFY_INFORMATION*)pEntry;
+			pWatcher->Record(pInfo);
+			if(!pInfo->NextEntryOffset)
+				break;
+			pEntry += pInfo->NextEntryOffset;
+		}
+	}
+
+	CloseHandle(hDone);
+
+	return 0;
+}
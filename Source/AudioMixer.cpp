@@ -0,0 +1,493 @@
+// AudioMixer.cpp
+// Software mixer playing any number of sound clips at once
+#include "AudioMixer.h"
+#include "Resampler.h"
+#include <emmintrin.h>
+
+CAudioMixer::CAudioMixer()
+{
+	m_pSink = NULL;
+	m_hThread = 0;
+	m_lQuit = 0;
+	m_lFailed = 0;
+	m_uPlays = 0;
+	m_uQueueFull = 0;
+	m_lDropped = 0;
+	m_lMerged = 0;
+	m_lStolen = 0;
+	m_lActive = 0;
+	m_lPeak = 0;
+	m_lBlocks = 0;
+	m_lAvgMixUs = 0;
+	m_lMaxMixUs = 0;
+	ZeroMemory(m_Voices, sizeof(m_Voices));
+	m_fMasterGain = 1.0f;
+	m_iBudget = MIXER_VOICES;
+	m_uBlock = 0;
+	m_dTotalMixUs = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&m_iFrequency);
+}
+
+CAudioMixer::~CAudioMixer()
+{
+	Shutdown();
+}
+
+bool CAudioMixer::Start(IAudioSink *pSink)
+{
+	if(m_hThread)
+	{
+		delete pSink;
+		return true;
+	}
+
+	WAVEFORMATEX wfx;
+	ZeroMemory(&wfx, sizeof(wfx));
+	wfx.wFormatTag = WAVE_FORMAT_PCM;
+	wfx.nChannels = MIXER_CHANNELS;
+	wfx.nSamplesPerSec = MIXER_RATE;
+	wfx.wBitsPerSample = 16;
+	wfx.nBlockAlign = MIXER_CHANNELS * sizeof(short);
+	wfx.nAvgBytesPerSec = MIXER_RATE * wfx.nBlockAlign;
+
+	if(!pSink || !pSink->Open(wfx, MIXER_BLOCK_FRAMES, MIXER_BLOCKS))
+	{
+		delete pSink;
+		return false;
+	}
+
+	m_pSink = pSink;
+	m_lQuit = 0;
+	m_lFailed = 0;
+	ZeroMemory(m_Voices, sizeof(m_Voices));
+	m_uBlock = 0;
+
+	m_hThread = CreateThread(NULL, 0, MixProc, this, 0, NULL);
+	if(!m_hThread)
+	{
+		Shutdown();
+		return false;
+	}
+
+	// a late block is heard as a click, the game thread can wait
+	SetThreadPriority(m_hThread, THREAD_PRIORITY_HIGHEST);
+
+	return true;
+}
+
+void CAudioMixer::Shutdown()
+{
+	if(m_hThread)
+	{
+		InterlockedExchange(&m_lQuit, 1);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = 0;
+	}
+
+	if(m_pSink)
+	{
+		m_pSink->Close();
+		delete m_pSink;
+		m_pSink = NULL;
+	}
+
+	// nothing refers to the clips once the thread is gone, the queue can
+	// be emptied from this side
+	sCommand cmd;
+	while(m_Commands.Pop(cmd))
+		;
+	ZeroMemory(m_Voices, sizeof(m_Voices));
+}
+
+bool CAudioMixer::Send(const sCommand &cmd)
+{
+	if(!IsRunning())
+		return false;
+
+	// a full queue means the audio thread is stuck, better lose a sound
+	// than wait for it
+	if(!m_Commands.Push(cmd))
+	{
+		m_uQueueFull++;
+		return false;
+	}
+
+	return true;
+}
+
+bool CAudioMixer::Play(const sSoundClip *pClip, int iPriority, bool bLoop, float fPan, float fGain)
+{
+	if(!pClip)
+		return false;
+
+	sCommand cmd = { MIX_PLAY, pClip, bLoop, iPriority, fPan, fGain };
+	if(!Send(cmd))
+		return false;
+
+	m_uPlays++;
+	return true;
+}
+
+void CAudioMixer::Stop(const sSoundClip *pClip)
+{
+	sCommand cmd = { MIX_STOP, pClip, false, 0 };
+	Send(cmd);
+}
+
+void CAudioMixer::StopAll()
+{
+	sCommand cmd = { MIX_STOP_ALL, NULL, false, 0 };
+	Send(cmd);
+}
+
+void CAudioMixer::SetMasterGain(float fGain)
+{
+	sCommand cmd = { MIX_MASTER_GAIN, NULL, false, (int)(fGain * 256.0f + 0.5f) };
+	Send(cmd);
+}
+
+void CAudioMixer::SetVoiceBudget(int iVoices)
+{
+	sCommand cmd = { MIX_VOICE_BUDGET, NULL, false, iVoices };
+	Send(cmd);
+}
+
+void CAudioMixer::GetStats(sMixerStats &stats) const
+{
+	stats.uPlays = m_uPlays;
+	stats.uQueueFull = m_uQueueFull;
+	stats.uDropped = m_lDropped;
+	stats.uMerged = m_lMerged;
+	stats.uStolen = m_lStolen;
+	stats.uActive = m_lActive;
+	stats.uPeak = m_lPeak;
+	stats.uBlocks = m_lBlocks;
+	stats.fAvgMixMs = m_lAvgMixUs / 1000.0f;
+	stats.fMaxMixMs = m_lMaxMixUs / 1000.0f;
+}
+
+void CAudioMixer::Execute(const sCommand &cmd)
+{
+	switch(cmd.eCommand)
+	{
+	case MIX_PLAY:
+		StartVoice(cmd);
+		break;
+	case MIX_STOP:
+		for(int i = 0; i < MIXER_VOICES; i++)
+			if(m_Voices[i].pClip == cmd.pClip)
+				m_Voices[i].pClip = NULL;
+		break;
+	case MIX_STOP_ALL:
+		for(int i = 0; i < MIXER_VOICES; i++)
+			m_Voices[i].pClip = NULL;
+		break;
+	case MIX_MASTER_GAIN:
+		m_fMasterGain = (cmd.iValue < 0 ? 0 : (cmd.iValue > 256 ? 256 : cmd.iValue)) / 256.0f;
+		break;
+	case MIX_VOICE_BUDGET:
+	{
+		m_iBudget = cmd.iValue < 1 ? 1 : (cmd.iValue > MIXER_VOICES ? MIXER_VOICES : cmd.iValue);
+
+		// a smaller budget takes effect at once
+		int iActive = 0;
+		for(int i = 0; i < MIXER_VOICES; i++)
+			if(m_Voices[i].pClip)
+				iActive++;
+		for(; iActive > m_iBudget; iActive--)
+			FindWeakest()->pClip = NULL;
+		break;
+	}
+	}
+}
+
+// Priority first, then how loud the voice is
+__int64 CAudioMixer::Importance(int iPriority, int iGain, float fGain, const sSoundClip *pClip)
+{
+	return ((__int64)iPriority << 32) + (__int64)(iGain * fGain) * pClip->uLoudness;
+}
+
+// Constant power pan scaled so a centred voice keeps its full level, the far
+// channel fades out as the voice moves to one side
+void CAudioMixer::UpdateGains(sVoice &voice)
+{
+	float fAngle = (voice.fPan + 1.0f) * (float)(PI / 4);
+	float fGain = voice.iGain / 256.0f * voice.fGain;
+	float fLeft = 1.41421356f * cosf(fAngle);
+	float fRight = 1.41421356f * sinf(fAngle);
+
+	voice.fLeft = fGain * (fLeft < 1.0f ? fLeft : 1.0f);
+	voice.fRight = fGain * (fRight < 1.0f ? fRight : 1.0f);
+}
+
+// The voice to stop first, the one that has played longest among equals
+CAudioMixer::sVoice* CAudioMixer::FindWeakest()
+{
+	sVoice *pWeakest = NULL;
+	__int64 iWeakest = 0;
+
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		sVoice &voice = m_Voices[i];
+		if(!voice.pClip)
+			continue;
+
+		__int64 iImportance = Importance(voice.iPriority, voice.iGain, voice.fGain, voice.pClip);
+		if(!pWeakest || iImportance < iWeakest || (iImportance == iWeakest && voice.uStarted < pWeakest->uStarted))
+		{
+			pWeakest = &voice;
+			iWeakest = iImportance;
+		}
+	}
+
+	return pWeakest;
+}
+
+void CAudioMixer::StartVoice(const sCommand &cmd)
+{
+	// The same clip started moments ago, several explosions in one frame
+	// are heard as one louder explosion
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		sVoice &voice = m_Voices[i];
+		if(voice.pClip != cmd.pClip || m_uBlock - voice.uStarted >= MIXER_MERGE_BLOCKS)
+			continue;
+
+		voice.iGain += 128;
+		if(voice.iGain > MIXER_MAX_GAIN)
+			voice.iGain = MIXER_MAX_GAIN;
+		if(cmd.iValue > voice.iPriority)
+			voice.iPriority = cmd.iValue;
+		// heard from between the two emitters
+		voice.fPan = (voice.fPan + cmd.fPan) * 0.5f;
+		if(cmd.fGain > voice.fGain)
+			voice.fGain = cmd.fGain;
+		UpdateGains(voice);
+		m_lMerged++;
+		return;
+	}
+
+	sVoice *pVoice = NULL;
+	int iActive = 0;
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		if(m_Voices[i].pClip)
+			iActive++;
+		else if(!pVoice)
+			pVoice = &m_Voices[i];
+	}
+
+	// over budget, the new sound replaces the least important voice unless
+	// it is less important itself
+	if(!pVoice || iActive >= m_iBudget)
+	{
+		sVoice *pWeakest = FindWeakest();
+		if(Importance(cmd.iValue, 256, cmd.fGain, cmd.pClip) <
+			Importance(pWeakest->iPriority, pWeakest->iGain, pWeakest->fGain, pWeakest->pClip))
+		{
+			m_lDropped++;
+			return;
+		}
+
+		pVoice = pWeakest;
+		m_lStolen++;
+	}
+
+	pVoice->pClip = cmd.pClip;
+	pVoice->iPos = 0;
+	pVoice->iStep = ((__int64)cmd.pClip->wfx.nSamplesPerSec << 32) / MIXER_RATE;
+	pVoice->bLoop = cmd.bLoop;
+	pVoice->iPriority = cmd.iValue;
+	pVoice->iGain = 256;
+	pVoice->fPan = cmd.fPan < -1.0f ? -1.0f : (cmd.fPan > 1.0f ? 1.0f : cmd.fPan);
+	pVoice->fGain = cmd.fGain < 0.0f ? 0.0f : (cmd.fGain > 1.0f ? 1.0f : cmd.fGain);
+	pVoice->uStarted = m_uBlock;
+	UpdateGains(*pVoice);
+}
+
+static inline float ClipSample(const sSoundClip *pClip, UINT uIndex)
+{
+	if(pClip->wfx.wBitsPerSample == 8)
+		return ((int)pClip->pPcm[uIndex] - 128) * 256.0f;
+	return ((const short*)pClip->pPcm)[uIndex];
+}
+
+// Resample up to uFrames of the voice into pOut, with as many channels as the
+// clip has. Returns the frames written, fewer once the voice has played to
+// the end.
+UINT CAudioMixer::ResampleVoice(sVoice &voice, float *pOut, UINT uFrames)
+{
+	const sSoundClip *pClip = voice.pClip;
+	__int64 iEnd = (__int64)pClip->uFrames << 32;
+	UINT uChannels = pClip->wfx.nChannels;
+
+	// clips converted when they were loaded only need widening to float
+	if(voice.iStep == ((__int64)1 << 32) && pClip->wfx.wBitsPerSample == 16)
+	{
+		UINT uFrame = (UINT)(voice.iPos >> 32);
+		UINT uDone = 0;
+
+		while(uDone < uFrames)
+		{
+			if(uFrame >= pClip->uFrames)
+			{
+				if(!voice.bLoop)
+					break;
+				uFrame = 0;
+			}
+
+			UINT uCount = uFrames - uDone < pClip->uFrames - uFrame ? uFrames - uDone : pClip->uFrames - uFrame;
+			ShortToFloat((const short*)pClip->pPcm + uFrame * uChannels, pOut + uDone * uChannels, uCount * uChannels);
+			uDone += uCount;
+			uFrame += uCount;
+		}
+
+		voice.iPos = (__int64)uFrame << 32;
+		return uDone;
+	}
+
+	for(UINT i = 0; i < uFrames; i++)
+	{
+		if(voice.iPos >= iEnd)
+		{
+			if(!voice.bLoop)
+				return i;
+			voice.iPos -= iEnd;
+		}
+
+		// interpolate towards the next frame
+		UINT uFrame = (UINT)(voice.iPos >> 32);
+		UINT uNext = uFrame + 1 < pClip->uFrames ? uFrame + 1 : (voice.bLoop ? 0 : uFrame);
+		float fFrac = (UINT)voice.iPos * (1.0f / 4294967296.0f);
+
+		for(UINT c = 0; c < uChannels; c++)
+		{
+			float a = ClipSample(pClip, uFrame * uChannels + c);
+			float b = ClipSample(pClip, uNext * uChannels + c);
+			pOut[i * uChannels + c] = a + (b - a) * fFrac;
+		}
+		voice.iPos += voice.iStep;
+	}
+
+	return uFrames;
+}
+
+// pMix += mono pSrc spread to both channels, pMix is 16 byte aligned
+static void AccumulateMono(float *pMix, const float *pSrc, UINT uFrames, float fLeft, float fRight)
+{
+	const __m128 gain = _mm_setr_ps(fLeft, fRight, fLeft, fRight);
+	UINT i = 0;
+
+	for(; i + 4 <= uFrames; i += 4)
+	{
+		__m128 s = _mm_loadu_ps(pSrc + i);
+		__m128 lo = _mm_unpacklo_ps(s, s);		// s0 s0 s1 s1
+		__m128 hi = _mm_unpackhi_ps(s, s);		// s2 s2 s3 s3
+		_mm_store_ps(pMix + i * 2, _mm_add_ps(_mm_load_ps(pMix + i * 2), _mm_mul_ps(lo, gain)));
+		_mm_store_ps(pMix + i * 2 + 4, _mm_add_ps(_mm_load_ps(pMix + i * 2 + 4), _mm_mul_ps(hi, gain)));
+	}
+
+	for(; i < uFrames; i++)
+	{
+		pMix[i * 2] += pSrc[i] * fLeft;
+		pMix[i * 2 + 1] += pSrc[i] * fRight;
+	}
+}
+
+// pMix += interleaved stereo pSrc, pMix is 16 byte aligned
+static void AccumulateStereo(float *pMix, const float *pSrc, UINT uFrames, float fLeft, float fRight)
+{
+	const __m128 gain = _mm_setr_ps(fLeft, fRight, fLeft, fRight);
+	UINT i = 0;
+
+	for(; i + 2 <= uFrames; i += 2)
+		_mm_store_ps(pMix + i * 2, _mm_add_ps(_mm_load_ps(pMix + i * 2), _mm_mul_ps(_mm_loadu_ps(pSrc + i * 2), gain)));
+
+	for(; i < uFrames; i++)
+	{
+		pMix[i * 2] += pSrc[i * 2] * fLeft;
+		pMix[i * 2 + 1] += pSrc[i * 2 + 1] * fRight;
+	}
+}
+
+// Mix one block of every active voice, returns the number of voices
+UINT CAudioMixer::MixBlock(short *pOut)
+{
+	const UINT uSamples = MIXER_BLOCK_FRAMES * MIXER_CHANNELS;
+	UINT uActive = 0;
+
+	ZeroMemory(m_fMix, sizeof(m_fMix));
+
+	for(int i = 0; i < MIXER_VOICES; i++)
+	{
+		sVoice &voice = m_Voices[i];
+		if(!voice.pClip)
+			continue;
+
+		uActive++;
+		UINT uFrames = ResampleVoice(voice, m_fVoice, MIXER_BLOCK_FRAMES);
+		if(voice.pClip->wfx.nChannels == 2)
+			AccumulateStereo(m_fMix, m_fVoice, uFrames, voice.fLeft, voice.fRight);
+		else
+			AccumulateMono(m_fMix, m_fVoice, uFrames, voice.fLeft, voice.fRight);
+
+		if(uFrames < MIXER_BLOCK_FRAMES)
+			voice.pClip = NULL;
+	}
+
+	// round to 16 bit, the pack saturates what is out of range
+	const __m128 master = _mm_set1_ps(m_fMasterGain);
+	for(UINT i = 0; i < uSamples; i += 8)
+	{
+		__m128i lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(m_fMix + i), master));
+		__m128i hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_load_ps(m_fMix + i + 4), master));
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_packs_epi32(lo, hi));
+	}
+
+	return uActive;
+}
+
+DWORD WINAPI CAudioMixer::MixProc(LPVOID lpParam)
+{
+	CAudioMixer *pMixer = (CAudioMixer*)lpParam;
+
+	while(!pMixer->m_lQuit)
+	{
+		// waits until the sink has room, this sets the pace of the thread
+		short *pOut = pMixer->m_pSink->Lock();
+		if(!pOut)
+			break;
+
+		// everything the game thread sent since the last block
+		sCommand cmd;
+		while(pMixer->m_Commands.Pop(cmd))
+			pMixer->Execute(cmd);
+
+		__int64 iStart, iEnd;
+		QueryPerformanceCounter((LARGE_INTEGER*)&iStart);
+		UINT uActive = pMixer->MixBlock(pOut);
+		QueryPerformanceCounter((LARGE_INTEGER*)&iEnd);
+
+		if(!pMixer->m_pSink->Submit())
+			break;
+		pMixer->m_uBlock++;
+
+		double dMixUs = (iEnd - iStart) * 1000000.0 / pMixer->m_iFrequency;
+		pMixer->m_dTotalMixUs += dMixUs;
+
+		pMixer->m_lActive = uActive;
+		if((LONG)uActive > pMixer->m_lPeak)
+			pMixer->m_lPeak = uActive;
+		pMixer->m_lBlocks++;
+		pMixer->m_lAvgMixUs = (LONG)(pMixer->m_dTotalMixUs / pMixer->m_lBlocks);
+		if((LONG)dMixUs > pMixer->m_lMaxMixUs)
+			pMixer->m_lMaxMixUs = (LONG)dMixUs;
+	}
+
+	// sounds fall back to PlaySound from here on
+	if(!pMixer->m_lQuit)
+		InterlockedExchange(&pMixer->m_lFailed, 1);
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+// AudioSink.cpp
+// Outputs for the software mixer
+#include "AudioSink.h"
+
+// Sleep until iFrames frames at uRate are due since dwStart
+static void WaitForFrames(DWORD dwStart, __int64 iFrames, UINT uRate)
+{
+	DWORD dwDue = dwStart + (DWORD)(iFrames * 1000 / uRate);
+	int iWait = (int)(dwDue - timeGetTime());
+	if(iWait > 0)
+		Sleep(iWait);
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CWaveOutSink::CWaveOutSink()
+{
+	m_hWaveOut = NULL;
+	m_hDone = 0;
+	m_uNext = 0;
+}
+
+CWaveOutSink::~CWaveOutSink()
+{
+	Close();
+}
+
+bool CWaveOutSink::Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks)
+{
+	Close();
+
+	m_hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if(!m_hDone)
+		return false;
+
+	if(waveOutOpen(&m_hWaveOut, WAVE_MAPPER, &wfx, (DWORD_PTR)m_hDone, 0, CALLBACK_EVENT) != MMSYSERR_NOERROR)
+	{
+		m_hWaveOut = NULL;
+		Close();
+		return false;
+	}
+
+	UINT uBlockSamples = uBlockFrames * wfx.nChannels;
+	m_Buffer.assign(uBlockSamples * uBlocks, 0);
+	m_Headers.resize(uBlocks);
+
+	for(UINT i = 0; i < uBlocks; i++)
+	{
+		WAVEHDR &hdr = m_Headers[i];
+		ZeroMemory(&hdr, sizeof(WAVEHDR));
+		hdr.lpData = (LPSTR)&m_Buffer[i * uBlockSamples];
+		hdr.dwBufferLength = uBlockSamples * sizeof(short);
+		waveOutPrepareHeader(m_hWaveOut, &hdr, sizeof(WAVEHDR));
+
+		// free until it is first written
+		hdr.dwFlags |= WHDR_DONE;
+	}
+	m_uNext = 0;
+
+	return true;
+}
+
+void CWaveOutSink::Close()
+{
+	if(m_hWaveOut)
+	{
+		// returns every queued block to us
+		waveOutReset(m_hWaveOut);
+		for(size_t i = 0; i < m_Headers.size(); i++)
+			waveOutUnprepareHeader(m_hWaveOut, &m_Headers[i], sizeof(WAVEHDR));
+		waveOutClose(m_hWaveOut);
+		m_hWaveOut = NULL;
+	}
+
+	if(m_hDone)
+	{
+		CloseHandle(m_hDone);
+		m_hDone = 0;
+	}
+
+	m_Headers.clear();
+	m_Buffer.clear();
+}
+
+short* CWaveOutSink::Lock()
+{
+	if(!m_hWaveOut)
+		return NULL;
+
+	// the driver sets WHDR_DONE, then signals the event
+	WAVEHDR &hdr = m_Headers[m_uNext];
+	while(!(*(volatile DWORD*)&hdr.dwFlags & WHDR_DONE))
+	{
+		if(WaitForSingleObject(m_hDone, SINK_WAIT_TIMEOUT) == WAIT_TIMEOUT &&
+			!(*(volatile DWORD*)&hdr.dwFlags & WHDR_DONE))
+			return NULL;
+	}
+
+	return (short*)hdr.lpData;
+}
+
+bool CWaveOutSink::Submit()
+{
+	WAVEHDR &hdr = m_Headers[m_uNext];
+	hdr.dwFlags &= ~WHDR_DONE;
+	if(waveOutWrite(m_hWaveOut, &hdr, sizeof(WAVEHDR)) != MMSYSERR_NOERROR)
+		return false;
+
+	m_uNext = (m_uNext + 1) % m_Headers.size();
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CWavFileSink::CWavFileSink(const char *szFileName, bool bRealTime)
+{
+	strcpy_s(m_szFileName, MAX_PATH, szFileName);
+	m_pFile = NULL;
+	ZeroMemory(&m_wfx, sizeof(m_wfx));
+	m_uBlockFrames = 0;
+	m_uDataBytes = 0;
+	m_bRealTime = bRealTime;
+	m_dwStart = 0;
+	m_iFrames = 0;
+}
+
+CWavFileSink::~CWavFileSink()
+{
+	Close();
+}
+
+bool CWavFileSink::Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks)
+{
+	Close();
+
+	if(fopen_s(&m_pFile, m_szFileName, "wb") || !m_pFile)
+	{
+		m_pFile = NULL;
+		return false;
+	}
+
+	// the sizes are filled in by Close
+	BYTE header[44];
+	ZeroMemory(header, sizeof(header));
+	if(fwrite(header, 1, sizeof(header), m_pFile) != sizeof(header))
+	{
+		Close();
+		return false;
+	}
+
+	m_wfx = wfx;
+	m_uBlockFrames = uBlockFrames;
+	m_Block.assign(uBlockFrames * wfx.nChannels, 0);
+	m_uDataBytes = 0;
+	m_dwStart = timeGetTime();
+	m_iFrames = 0;
+
+	return true;
+}
+
+void CWavFileSink::Close()
+{
+	if(!m_pFile)
+		return;
+
+	struct
+	{
+		char riff[4];
+		DWORD dwRiffSize;
+		char wavefmt[8];
+		DWORD dwFmtSize;
+		WORD wFormatTag;
+		WORD nChannels;
+		DWORD nSamplesPerSec;
+		DWORD nAvgBytesPerSec;
+		WORD nBlockAlign;
+		WORD wBitsPerSample;
+		char data[4];
+		DWORD dwDataSize;
+	} header =
+	{
+		{ 'R', 'I', 'F', 'F' }, 36 + m_uDataBytes, { 'W', 'A', 'V', 'E', 'f', 'm', 't', ' ' }, 16,
+		m_wfx.wFormatTag, m_wfx.nChannels, m_wfx.nSamplesPerSec, m_wfx.nAvgBytesPerSec,
+		m_wfx.nBlockAlign, m_wfx.wBitsPerSample, { 'd', 'a', 't', 'a' }, m_uDataBytes
+	};
+
+	fseek(m_pFile, 0, SEEK_SET);
+	fwrite(&header, 1, sizeof(header), m_pFile);
+	fclose(m_pFile);
+	m_pFile = NULL;
+}
+
+short* CWavFileSink::Lock()
+{
+	if(!m_pFile)
+		return NULL;
+
+	if(m_bRealTime)
+		WaitForFrames(m_dwStart, m_iFrames, m_wfx.nSamplesPerSec);
+
+	return &m_Block[0];
+}
+
+bool CWavFileSink::Submit()
+{
+	size_t uBytes = m_Block.size() * sizeof(short);
+	if(fwrite(&m_Block[0], 1, uBytes, m_pFile) != uBytes)
+		return false;
+
+	m_uDataBytes += (UINT)uBytes;
+	m_iFrames += m_uBlockFrames;
+
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+CNullSink::CNullSink(bool bRealTime)
+{
+	m_uBlockFrames = 0;
+	m_uRate = 0;
+	m_bRealTime = bRealTime;
+	m_dwStart = 0;
+	m_iFrames = 0;
+}
+
+bool CNullSink::Open(const WAVEFORMATEX &wfx, UINT uBlockFrames, UINT uBlocks)
+{
+	m_Block.assign(uBlockFrames * wfx.nChannels, 0);
+	m_uBlockFrames = uBlockFrames;
+	m_uRate = wfx.nSamplesPerSec;
+	m_dwStart = timeGetTime();
+	m_iFrames = 0;
+
+	return true;
+}
+
+void CNullSink::Close()
+{
+	m_Block.clear();
+}
+
+short* CNullSink::Lock()
+{
+	if(m_Block.empty())
+		return NULL;
+
+	if(m_bRealTime)
+		WaitForFrames(m_dwStart, m_iFrames, m_uRate);
+
+	return &m_Block[0];
+}
+
+bool CNullSink::Submit()
+{
+	m_iFrames += m_uBlockFrames;
+
+	return true;
+}
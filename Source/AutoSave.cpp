@@ -0,0 +1,355 @@
+// AutoSave.cpp
+// Background writer for world snapshots
+#include "AutoSave.h"
+#include "MappedFile.h"
+#include "Snapshot.h"
+
+static UINT HashBytes(const BYTE *pData, size_t uSize)
+{
+	UINT uHash = 2166136261u;
+	for(size_t i = 0; i < uSize; i++)
+		uHash = (uHash ^ pData[i]) * 16777619u;
+	return uHash;
+}
+
+// Write the file next to its destination, flush it and rename it over the
+// destination, so a crash leaves either the old or the new file.
+static bool WriteFileSafe(const char *szFileName, const BYTE *pData, size_t uSize)
+{
+	char szTemp[MAX_PATH];
+	sprintf_s(szTemp, MAX_PATH, "%s.tmp", szFileName);
+
+	HANDLE hFile = CreateFile(szTemp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD dwWritten = 0;
+	BOOL bOk = WriteFile(hFile, pData, (DWORD)uSize, &dwWritten, NULL) && dwWritten == uSize;
+	bOk = bOk && FlushFileBuffers(hFile);
+	CloseHandle(hFile);
+
+	if(bOk)
+		bOk = MoveFileEx(szTemp, szFileName, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+	if(!bOk)
+		DeleteFile(szTemp);
+
+	return bOk != FALSE;
+}
+
+CAutoSave::CAutoSave()
+{
+	InitializeCriticalSection(&m_cs);
+	m_szFileName[0] = 0;
+	m_szDeltaName[0] = 0;
+	m_hWake = 0;
+	m_hIdle = 0;
+	m_hThread = 0;
+	m_lQuit = 0;
+	m_bPending = false;
+	m_bPendingFull = false;
+	m_bFailed = false;
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_uBaseHash = 0;
+	m_uDeltas = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&m_iFrequency);
+}
+
+CAutoSave::~CAutoSave()
+{
+	Shutdown();
+	DeleteCriticalSection(&m_cs);
+}
+
+bool CAutoSave::Start(const char *szFileName)
+{
+	if(m_hThread)
+		return true;
+
+	strcpy_s(m_szFileName, MAX_PATH, szFileName);
+	sprintf_s(m_szDeltaName, MAX_PATH, "%s.delta", szFileName);
+
+	// nothing is known about the save on disk, the first save is a full one
+	m_Base.clear();
+	m_uDeltas = 0;
+
+	m_lQuit = 0;
+	m_hWake = CreateEvent(NULL, FALSE, FALSE, NULL);
+	m_hIdle = CreateEvent(NULL, TRUE, TRUE, NULL);
+	if(m_hWake && m_hIdle)
+		m_hThread = CreateThread(NULL, 0, WriterProc, this, 0, NULL);
+
+	if(!m_hThread)
+	{
+		Shutdown();
+		return false;
+	}
+
+	// disk writes must not take time from the game thread
+	SetThreadPriority(m_hThread, THREAD_PRIORITY_BELOW_NORMAL);
+
+	return true;
+}
+
+void CAutoSave::Shutdown()
+{
+	// the writer drains the queue before it quits
+	if(m_hThread)
+	{
+		InterlockedExchange(&m_lQuit, 1);
+		SetEvent(m_hWake);
+		WaitForSingleObject(m_hThread, INFINITE);
+		CloseHandle(m_hThread);
+		m_hThread = 0;
+	}
+
+	if(m_hWake)
+	{
+		CloseHandle(m_hWake);
+		m_hWake = 0;
+	}
+	if(m_hIdle)
+	{
+		CloseHandle(m_hIdle);
+		m_hIdle = 0;
+	}
+}
+
+bool CAutoSave::Submit(std::vector<BYTE> &image, bool bFull)
+{
+	if(!m_hThread)
+	{
+		if(!m_szFileName[0])
+			return false;
+		return Write(image, bFull);
+	}
+
+	EnterCriticalSection(&m_cs);
+	m_Pending.swap(image);
+	m_bPending = true;
+	m_bPendingFull = m_bPendingFull || bFull;
+	ResetEvent(m_hIdle);
+	bool bOk = !m_bFailed;
+	LeaveCriticalSection(&m_cs);
+
+	SetEvent(m_hWake);
+
+	return bOk;
+}
+
+bool CAutoSave::Flush()
+{
+	if(m_hThread)
+		WaitForSingleObject(m_hIdle, INFINITE);
+
+	EnterCriticalSection(&m_cs);
+	bool bOk = !m_bFailed;
+	LeaveCriticalSection(&m_cs);
+
+	return bOk;
+}
+
+void CAutoSave::GetStats(sAutoSaveStats &stats)
+{
+	EnterCriticalSection(&m_cs);
+	stats = m_Stats;
+	LeaveCriticalSection(&m_cs);
+}
+
+DWORD WINAPI CAutoSave::WriterProc(LPVOID lpParam)
+{
+	CAutoSave *pSave = (CAutoSave*)lpParam;
+
+	for(;;)
+	{
+		WaitForSingleObject(pSave->m_hWake, INFINITE);
+
+		for(;;)
+		{
+			EnterCriticalSection(&pSave->m_cs);
+			if(!pSave->m_bPending)
+			{
+				SetEvent(pSave->m_hIdle);
+				LeaveCriticalSection(&pSave->m_cs);
+				break;
+			}
+
+			pSave->m_Writing.swap(pSave->m_Pending);
+			bool bFull = pSave->m_bPendingFull;
+			pSave->m_bPending = false;
+			pSave->m_bPendingFull = false;
+			LeaveCriticalSection(&pSave->m_cs);
+
+			pSave->Write(pSave->m_Writing, bFull);
+		}
+
+		if(pSave->m_lQuit)
+			break;
+	}
+
+	return 0;
+}
+
+bool CAutoSave::Write(const std::vector<BYTE> &image, bool bFull)
+{
+	if(image.empty())
+		return false;
+
+	__int64 iStart, iEnd;
+	QueryPerformanceCounter((LARGE_INTEGER*)&iStart);
+
+	// blocks that differ from the last full save
+	m_Blocks.clear();
+	if(!bFull && !m_Base.empty() && m_uDeltas < AUTOSAVE_FULL_EVERY)
+	{
+		UINT uCount = (UINT)((image.size() + SNAPSHOT_BLOCK_SIZE - 1) / SNAPSHOT_BLOCK_SIZE);
+		for(UINT i = 0; i < uCount; i++)
+		{
+			size_t uStart = (size_t)i * SNAPSHOT_BLOCK_SIZE;
+			size_t uLength = image.size() - uStart < SNAPSHOT_BLOCK_SIZE ? image.size() - uStart : SNAPSHOT_BLOCK_SIZE;
+
+			if(uStart + uLength > m_Base.size() || memcmp(&image[uStart], &m_Base[uStart], uLength))
+				m_Blocks.push_back(i);
+		}
+
+		// a delta covering most of the image is not worth it
+		if(m_Blocks.size() * 2 > uCount)
+			bFull = true;
+	}
+	else
+		bFull = true;
+
+	bool bOk = bFull ? WriteFull(image) : WriteDelta(image, m_Blocks);
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&iEnd);
+	float fMs = (float)((iEnd - iStart) * 1000.0 / m_iFrequency);
+
+	EnterCriticalSection(&m_cs);
+	if(!bOk)
+		m_Stats.uFailed++;
+	else if(bFull)
+		m_Stats.uFullSaves++;
+	else
+		m_Stats.uDeltaSaves++;
+	if(bOk)
+		m_Stats.uLastBytes = (UINT)(bFull ? image.size() : m_Delta.size());
+	m_Stats.fLastWriteMs = fMs;
+	if(fMs > m_Stats.fMaxWriteMs)
+		m_Stats.fMaxWriteMs = fMs;
+	m_bFailed = !bOk;
+	LeaveCriticalSection(&m_cs);
+
+	return bOk;
+}
+
+bool CAutoSave::WriteFull(const std::vector<BYTE> &image)
+{
+	if(!WriteFileSafe(m_szFileName, &image[0], image.size()))
+		return false;
+
+	// an old delta no longer matches, its base hash makes sure it is ignored
+	// should deleting it fail
+	DeleteFile(m_szDeltaName);
+
+	m_Base = image;
+	m_uBaseHash = HashBytes(&m_Base[0], m_Base.size());
+	m_uDeltas = 0;
+
+	return true;
+}
+
+bool CAutoSave::WriteDelta(const std::vector<BYTE> &image, const std::vector<UINT> &blocks)
+{
+	size_t uSize = sizeof(sSnapshotDelta) + blocks.size() * sizeof(uint32_t);
+	for(size_t i = 0; i < blocks.size(); i++)
+	{
+		size_t uStart = (size_t)blocks[i] * SNAPSHOT_BLOCK_SIZE;
+		uSize += image.size() - uStart < SNAPSHOT_BLOCK_SIZE ? image.size() - uStart : SNAPSHOT_BLOCK_SIZE;
+	}
+	m_Delta.resize(uSize);
+
+	sSnapshotDelta *pHeader = (sSnapshotDelta*)&m_Delta[0];
+	pHeader->uMagic = SNAPSHOT_DELTA_MAGIC;
+	pHeader->uVersion = SNAPSHOT_VERSION;
+	pHeader->uBaseSize = (uint32_t)m_Base.size();
+	pHeader->uBaseHash = m_uBaseHash;
+	pHeader->uSize = (uint32_t)image.size();
+	pHeader->uBlocks = (uint32_t)blocks.size();
+
+	uint32_t *pIndex = (uint32_t*)(pHeader + 1);
+	BYTE *pBlock = (BYTE*)(pIndex + blocks.size());
+	for(size_t i = 0; i < blocks.size(); i++)
+	{
+		size_t uStart = (size_t)blocks[i] * SNAPSHOT_BLOCK_SIZE;
+		size_t uLength = image.size() - uStart < SNAPSHOT_BLOCK_SIZE ? image.size() - uStart : SNAPSHOT_BLOCK_SIZE;
+
+		pIndex[i] = blocks[i];
+		memcpy(pBlock, &image[uStart], uLength);
+		pBlock += uLength;
+	}
+
+	if(!WriteFileSafe(m_szDeltaName, &m_Delta[0], m_Delta.size()))
+		return false;
+
+	m_uDeltas++;
+
+	return true;
+}
+
+bool CAutoSave::Read(const char *szFileName, std::vector<BYTE> &image)
+{
+	CMappedFile file;
+
+	if(!file.Open(szFileName))
+		return false;
+
+	image.assign(file.Data(), file.Data() + file.Size());
+
+	char szDeltaName[MAX_PATH];
+	sprintf_s(szDeltaName, MAX_PATH, "%s.delta", szFileName);
+
+	CMappedFile delta;
+	if(!delta.Open(szDeltaName) || delta.Size() < sizeof(sSnapshotDelta))
+		return true;
+
+	// a delta that does not belong to this save is ignored
+	const sSnapshotDelta *pHeader = (const sSnapshotDelta*)delta.Data();
+	if(pHeader->uMagic != SNAPSHOT_DELTA_MAGIC || pHeader->uVersion != SNAPSHOT_VERSION ||
+		pHeader->uBaseSize != image.size() || pHeader->uSize == 0 ||
+		pHeader->uBaseHash != HashBytes(&image[0], image.size()))
+		return true;
+
+	size_t uCount = ((size_t)pHeader->uSize + SNAPSHOT_BLOCK_SIZE - 1) / SNAPSHOT_BLOCK_SIZE;
+	if(pHeader->uBlocks > uCount)
+		return true;
+
+	// a delta cut short by a crash may not even hold the whole index
+	size_t uExpected = sizeof(sSnapshotDelta) + (size_t)pHeader->uBlocks * sizeof(uint32_t);
+	if(delta.Size() < uExpected)
+		return true;
+
+	const uint32_t *pIndex = (const uint32_t*)(pHeader + 1);
+	for(uint32_t i = 0; i < pHeader->uBlocks; i++)
+	{
+		if(pIndex[i] >= uCount || (i && pIndex[i] <= pIndex[i - 1]))
+			return true;
+
+		size_t uStart = (size_t)pIndex[i] * SNAPSHOT_BLOCK_SIZE;
+		uExpected += pHeader->uSize - uStart < SNAPSHOT_BLOCK_SIZE ? pHeader->uSize - uStart : SNAPSHOT_BLOCK_SIZE;
+	}
+	if(uExpected != delta.Size())
+		return true;
+
+	image.resize(pHeader->uSize);
+
+	const BYTE *pBlock = (const BYTE*)(pIndex + pHeader->uBlocks);
+	for(uint32_t i = 0; i < pHeader->uBlocks; i++)
+	{
+		size_t uStart = (size_t)pIndex[i] * SNAPSHOT_BLOCK_SIZE;
+		size_t uLength = image.size() - uStart < SNAPSHOT_BLOCK_SIZE ? image.size() - uStart : SNAPSHOT_BLOCK_SIZE;
+
+		memcpy(&image[uStart], pBlock, uLength);
+		pBlock += uLength;
+	}
+
+	return true;
+}
@@ -20,6 +20,8 @@ BackBuffer::BackBuffer(HWND hWnd, int width, int height)
 	// Create system memory device context that is compatible
 	// with the window one.
 	mhDC = CreateCompatibleDC(hWndDC);
+	mhSpriteDC = CreateCompatibleDC(hWndDC);
+	mhMaskDC = CreateCompatibleDC(hWndDC);
 
 	// Create the backbuffer surface bitmap that is compatible
 	// with the window device context bitmap format. That is
@@ -57,6 +59,8 @@ BackBuffer::~BackBuffer()
 	SelectObject(mhDC, mhOldObject);
 	DeleteObject(mhSurface);
 	DeleteDC(mhDC);
+	DeleteDC(mhSpriteDC);
+	DeleteDC(mhMaskDC);
 }
 
 void BackBuffer::present()
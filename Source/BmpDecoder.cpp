@@ -0,0 +1,498 @@
+// BmpDecoder.cpp
+// Windows bitmap decoder working straight on the file bytes
+#include "BmpDecoder.h"
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define BMP_USE_SSE
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define BMP_TARGET_SSSE3
+#else
+#include <cpuid.h>
+#define BMP_TARGET_SSSE3 __attribute__((target("ssse3")))
+#endif
+#endif
+
+// compression values of the info header
+#define BMP_RGB				0
+#define BMP_BITFIELDS		3
+#define BMP_ALPHABITFIELDS	6
+
+#define BMP_FILEHEADER_SIZE	14
+#define BMP_COREHEADER_SIZE	12
+#define BMP_INFOHEADER_SIZE	40
+
+static inline uint32_t Read16(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t Read32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+#ifdef BMP_USE_SSE
+static bool HasSSSE3()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+	return (info[2] & (1 << 9)) != 0;
+#else
+	unsigned int a, b, c, d;
+	if(!__get_cpuid(1, &a, &b, &c, &d))
+		return false;
+	return (c & (1 << 9)) != 0;
+#endif
+}
+
+static const bool g_bHasSSSE3 = HasSSSE3();
+
+// 16 pixels per step, the three loads cover exactly 48 source bytes
+BMP_TARGET_SSSE3 static int Expand24_SSSE3(const uint8_t *pSrc, uint32_t *pDst, int iWidth)
+{
+	const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -128, 3, 4, 5, -128, 6, 7, 8, -128, 9, 10, 11, -128);
+	int x = 0;
+
+	for(; x + 16 <= iWidth; x += 16, pSrc += 48, pDst += 16)
+	{
+		__m128i a = _mm_loadu_si128((const __m128i*)pSrc);
+		__m128i b = _mm_loadu_si128((const __m128i*)(pSrc + 16));
+		__m128i c = _mm_loadu_si128((const __m128i*)(pSrc + 32));
+
+		_mm_storeu_si128((__m128i*)pDst, _mm_shuffle_epi8(a, shuffle));
+		_mm_storeu_si128((__m128i*)(pDst + 4), _mm_shuffle_epi8(_mm_alignr_epi8(b, a, 12), shuffle));
+		_mm_storeu_si128((__m128i*)(pDst + 8), _mm_shuffle_epi8(_mm_alignr_epi8(c, b, 8), shuffle));
+		_mm_storeu_si128((__m128i*)(pDst + 12), _mm_shuffle_epi8(_mm_srli_si128(c, 4), shuffle));
+	}
+
+	return x;
+}
+
+// 4 pixels per step, the 16 byte load reads 4 bytes past them so at least
+// two more pixels must follow
+static int Expand24_SSE2(const uint8_t *pSrc, uint32_t *pDst, int iWidth)
+{
+	const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+	int x = 0;
+
+	for(; x + 6 <= iWidth; x += 4, pSrc += 12, pDst += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)pSrc);
+		__m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+		__m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+		_mm_storeu_si128((__m128i*)pDst, _mm_and_si128(_mm_unpacklo_epi64(p01, p23), mask));
+	}
+
+	return x;
+}
+
+// 8 pixels per step, channels are widened by replicating their top bits
+static int Expand16_SSE2(const uint8_t *pSrc, uint32_t *pDst, int iWidth, bool b565)
+{
+	const __m128i mask5 = _mm_set1_epi16(0x1F);
+	const __m128i mask6 = _mm_set1_epi16(0x3F);
+	int x = 0;
+
+	for(; x + 8 <= iWidth; x += 8, pSrc += 16, pDst += 8)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)pSrc);
+		__m128i r, g, b;
+
+		b = _mm_and_si128(v, mask5);
+		b = _mm_or_si128(_mm_slli_epi16(b, 3), _mm_srli_epi16(b, 2));
+
+		if(b565)
+		{
+			r = _mm_srli_epi16(v, 11);
+			g = _mm_and_si128(_mm_srli_epi16(v, 5), mask6);
+			g = _mm_or_si128(_mm_slli_epi16(g, 2), _mm_srli_epi16(g, 4));
+		}
+		else
+		{
+			r = _mm_and_si128(_mm_srli_epi16(v, 10), mask5);
+			g = _mm_and_si128(_mm_srli_epi16(v, 5), mask5);
+			g = _mm_or_si128(_mm_slli_epi16(g, 3), _mm_srli_epi16(g, 2));
+		}
+		r = _mm_or_si128(_mm_slli_epi16(r, 3), _mm_srli_epi16(r, 2));
+
+		// blue | green << 8 and red | 0 << 8, interleaved into BGRX
+		__m128i bg = _mm_or_si128(b, _mm_slli_epi16(g, 8));
+		_mm_storeu_si128((__m128i*)pDst, _mm_unpacklo_epi16(bg, r));
+		_mm_storeu_si128((__m128i*)(pDst + 4), _mm_unpackhi_epi16(bg, r));
+	}
+
+	return x;
+}
+
+// 16 pixels per step for images of up to 16 colours, one shuffle per channel
+// looks the indices up in the palette. Stops at indices past the table, the
+// caller finishes those.
+BMP_TARGET_SSSE3 static void ExpandLut_SSSE3(__m128i idx, uint32_t *pDst, const uint8_t (*pLut)[16])
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i b = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pLut[0]), idx);
+	__m128i g = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pLut[1]), idx);
+	__m128i r = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)pLut[2]), idx);
+
+	__m128i bgLo = _mm_unpacklo_epi8(b, g);
+	__m128i bgHi = _mm_unpackhi_epi8(b, g);
+	__m128i rLo = _mm_unpacklo_epi8(r, zero);
+	__m128i rHi = _mm_unpackhi_epi8(r, zero);
+
+	_mm_storeu_si128((__m128i*)pDst, _mm_unpacklo_epi16(bgLo, rLo));
+	_mm_storeu_si128((__m128i*)(pDst + 4), _mm_unpackhi_epi16(bgLo, rLo));
+	_mm_storeu_si128((__m128i*)(pDst + 8), _mm_unpacklo_epi16(bgHi, rHi));
+	_mm_storeu_si128((__m128i*)(pDst + 12), _mm_unpackhi_epi16(bgHi, rHi));
+}
+
+BMP_TARGET_SSSE3 static int Expand8_SSSE3(const uint8_t *pSrc, uint32_t *pDst, int iWidth, const uint8_t (*pLut)[16])
+{
+	const __m128i high = _mm_set1_epi8((char)0xF0);
+	int x = 0;
+
+	for(; x + 16 <= iWidth; x += 16, pSrc += 16, pDst += 16)
+	{
+		__m128i idx = _mm_loadu_si128((const __m128i*)pSrc);
+		if(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(idx, high), _mm_setzero_si128())) != 0xFFFF)
+			break;
+		ExpandLut_SSSE3(idx, pDst, pLut);
+	}
+
+	return x;
+}
+
+// 4 bpp images always fit the table, the left pixel is the high nibble
+BMP_TARGET_SSSE3 static int Expand4_SSSE3(const uint8_t *pSrc, uint32_t *pDst, int iWidth, const uint8_t (*pLut)[16])
+{
+	const __m128i low = _mm_set1_epi8(0x0F);
+	int x = 0;
+
+	for(; x + 16 <= iWidth; x += 16, pSrc += 8, pDst += 16)
+	{
+		__m128i v = _mm_loadl_epi64((const __m128i*)pSrc);
+		__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), low);
+		ExpandLut_SSSE3(_mm_unpacklo_epi8(hi, _mm_and_si128(v, low)), pDst, pLut);
+	}
+
+	return x;
+}
+
+static int Copy32_SSE2(const uint8_t *pSrc, uint32_t *pDst, int iWidth)
+{
+	const __m128i mask = _mm_set1_epi32(0x00FFFFFF);
+	int x = 0;
+
+	for(; x + 4 <= iWidth; x += 4, pSrc += 16, pDst += 4)
+		_mm_storeu_si128((__m128i*)pDst, _mm_and_si128(_mm_loadu_si128((const __m128i*)pSrc), mask));
+
+	return x;
+}
+#endif
+
+CBmpDecoder::CBmpDecoder()
+{
+	m_pBits = NULL;
+	m_uStride = 0;
+	m_iWidth = 0;
+	m_iHeight = 0;
+	m_iBitCount = 0;
+	m_bTopDown = false;
+	m_eFormat = FMT_RGB24;
+	memset(m_Channels, 0, sizeof(m_Channels));
+	memset(m_uPalette, 0, sizeof(m_uPalette));
+	m_iColors = 0;
+	memset(m_uLut, 0, sizeof(m_uLut));
+}
+
+void CBmpDecoder::SetupChannel(sChannel &chn, uint32_t uMask)
+{
+	chn.uMask = uMask;
+	chn.iShift = 0;
+	chn.iBits = 0;
+
+	if(!uMask)
+		return;
+
+	while(!(uMask & 1))
+	{
+		uMask >>= 1;
+		chn.iShift++;
+	}
+	while(uMask & 1)
+	{
+		uMask >>= 1;
+		chn.iBits++;
+	}
+}
+
+uint32_t CBmpDecoder::ExpandChannel(const sChannel &chn, uint32_t uPixel)
+{
+	if(!chn.iBits)
+		return 0;
+
+	uint32_t v = (uPixel & chn.uMask) >> chn.iShift;
+	if(chn.iBits >= 8)
+		return v >> (chn.iBits - 8);
+
+	// replicate the top bits so full intensity maps to 255
+	v <<= 8 - chn.iBits;
+	for(int s = chn.iBits; s < 8; s <<= 1)
+		v |= v >> s;
+	return v;
+}
+
+bool CBmpDecoder::Parse(const uint8_t *pData, size_t uSize)
+{
+	m_pBits = NULL;
+
+	if(!pData || uSize < BMP_FILEHEADER_SIZE + BMP_COREHEADER_SIZE || pData[0] != 'B' || pData[1] != 'M')
+		return false;
+
+	uint32_t uOffBits = Read32(pData + 10);
+	const uint8_t *pInfo = pData + BMP_FILEHEADER_SIZE;
+	uint32_t uInfoSize = Read32(pInfo);
+
+	if(uInfoSize > uSize - BMP_FILEHEADER_SIZE)
+		return false;
+
+	int32_t iWidth, iHeight;
+	uint32_t uCompression = BMP_RGB;
+	uint32_t uClrUsed = 0;
+	size_t uPaletteEntry = 4;
+
+	if(uInfoSize == BMP_COREHEADER_SIZE)
+	{
+		// OS/2 style header, 16 bit sizes and RGBTRIPLE palette
+		iWidth = (int16_t)Read16(pInfo + 4);
+		iHeight = (int16_t)Read16(pInfo + 6);
+		m_iBitCount = Read16(pInfo + 10);
+		uPaletteEntry = 3;
+	}
+	else if(uInfoSize >= BMP_INFOHEADER_SIZE)
+	{
+		// BITMAPINFOHEADER and its V4/V5 extensions
+		iWidth = (int32_t)Read32(pInfo + 4);
+		iHeight = (int32_t)Read32(pInfo + 8);
+		m_iBitCount = Read16(pInfo + 14);
+		uCompression = Read32(pInfo + 16);
+		uClrUsed = Read32(pInfo + 32);
+	}
+	else
+		return false;
+
+	if(iWidth <= 0 || iHeight == 0 || iHeight == INT32_MIN)
+		return false;
+
+	m_iWidth = iWidth;
+	m_bTopDown = iHeight < 0;
+	m_iHeight = m_bTopDown ? -iHeight : iHeight;
+
+	if(uCompression == BMP_BITFIELDS || uCompression == BMP_ALPHABITFIELDS)
+	{
+		// the masks follow a plain info header and are part of the larger ones,
+		// either way they start right after the first 40 bytes
+		if((m_iBitCount != 16 && m_iBitCount != 32) || uSize < BMP_FILEHEADER_SIZE + BMP_INFOHEADER_SIZE + 12)
+			return false;
+
+		uint32_t uRed = Read32(pInfo + 40);
+		uint32_t uGreen = Read32(pInfo + 44);
+		uint32_t uBlue = Read32(pInfo + 48);
+
+		if(m_iBitCount == 16 && uRed == 0xF800 && uGreen == 0x07E0 && uBlue == 0x001F)
+			m_eFormat = FMT_RGB565;
+		else if(m_iBitCount == 16 && uRed == 0x7C00 && uGreen == 0x03E0 && uBlue == 0x001F)
+			m_eFormat = FMT_RGB555;
+		else if(m_iBitCount == 32 && uRed == 0xFF0000 && uGreen == 0xFF00 && uBlue == 0xFF)
+			m_eFormat = FMT_RGB32;
+		else
+		{
+			m_eFormat = m_iBitCount == 16 ? FMT_BITFIELDS16 : FMT_BITFIELDS32;
+			SetupChannel(m_Channels[0], uRed);
+			SetupChannel(m_Channels[1], uGreen);
+			SetupChannel(m_Channels[2], uBlue);
+		}
+	}
+	else if(uCompression != BMP_RGB)
+		return false;		// RLE, JPEG and PNG payloads are not supported
+	else
+	{
+		switch(m_iBitCount)
+		{
+		case 1:
+		case 4:
+		case 8:
+			m_eFormat = FMT_PALETTE;
+			break;
+		case 16:
+			m_eFormat = FMT_RGB555;
+			break;
+		case 24:
+			m_eFormat = FMT_RGB24;
+			break;
+		case 32:
+			m_eFormat = FMT_RGB32;
+			break;
+		default:
+			return false;
+		}
+	}
+
+	if(m_eFormat == FMT_PALETTE)
+	{
+		// read what is there of the palette, missing entries stay black
+		size_t uColors = uClrUsed && uClrUsed < (1u << m_iBitCount) ? uClrUsed : (1u << m_iBitCount);
+		size_t uPaletteStart = BMP_FILEHEADER_SIZE + uInfoSize;
+		size_t uPaletteEnd = uOffBits < uSize ? uOffBits : uSize;
+		if(uPaletteEnd < uPaletteStart)
+			uPaletteEnd = uPaletteStart;
+		if(uColors > (uPaletteEnd - uPaletteStart) / uPaletteEntry)
+			uColors = (uPaletteEnd - uPaletteStart) / uPaletteEntry;
+
+		memset(m_uPalette, 0, sizeof(m_uPalette));
+		const uint8_t *p = pData + uPaletteStart;
+		for(size_t i = 0; i < uColors; i++, p += uPaletteEntry)
+			m_uPalette[i] = p[0] | (p[1] << 8) | (p[2] << 16);
+		m_iColors = (int)uColors;
+
+		// channel tables for the shuffle expansion, missing entries are black
+		for(int i = 0; i < 16; i++)
+		{
+			m_uLut[0][i] = (uint8_t)m_uPalette[i];
+			m_uLut[1][i] = (uint8_t)(m_uPalette[i] >> 8);
+			m_uLut[2][i] = (uint8_t)(m_uPalette[i] >> 16);
+		}
+	}
+
+	// the last row is allowed to miss its padding
+	uint64_t uStride = (((uint64_t)m_iWidth * m_iBitCount + 31) / 32) * 4;
+	uint64_t uNeeded = uStride * (m_iHeight - 1) + ((uint64_t)m_iWidth * m_iBitCount + 7) / 8;
+	if(uOffBits > uSize || uNeeded > uSize - uOffBits)
+		return false;
+
+	m_uStride = (size_t)uStride;
+	m_pBits = pData + uOffBits;
+
+	return true;
+}
+
+void CBmpDecoder::DecodeRow(int iRow, uint32_t *pDst) const
+{
+	const uint8_t *pSrc = m_pBits + iRow * m_uStride;
+	int x = 0;
+
+	switch(m_eFormat)
+	{
+	case FMT_PALETTE:
+		if(m_iBitCount == 8)
+		{
+#ifdef BMP_USE_SSE
+			if(g_bHasSSSE3 && m_iColors <= 16)
+				x = Expand8_SSSE3(pSrc, pDst, m_iWidth, m_uLut);
+#endif
+			for(; x < m_iWidth; x++)
+				pDst[x] = m_uPalette[pSrc[x]];
+		}
+		else if(m_iBitCount == 4)
+		{
+#ifdef BMP_USE_SSE
+			if(g_bHasSSSE3)
+				x = Expand4_SSSE3(pSrc, pDst, m_iWidth, m_uLut);
+#endif
+			for(; x < m_iWidth; x++)
+				pDst[x] = m_uPalette[(pSrc[x >> 1] >> ((~x & 1) << 2)) & 0x0F];
+		}
+		else
+		{
+			for(; x < m_iWidth; x++)
+				pDst[x] = m_uPalette[(pSrc[x >> 3] >> (7 - (x & 7))) & 1];
+		}
+		break;
+
+	case FMT_RGB555:
+	case FMT_RGB565:
+	{
+		bool b565 = m_eFormat == FMT_RGB565;
+#ifdef BMP_USE_SSE
+		x = Expand16_SSE2(pSrc, pDst, m_iWidth, b565);
+#endif
+		for(; x < m_iWidth; x++)
+		{
+			uint32_t v = Read16(pSrc + x * 2);
+			uint32_t r, g, b = v & 0x1F;
+			if(b565)
+			{
+				r = v >> 11;
+				g = (v >> 5) & 0x3F;
+				g = (g << 2) | (g >> 4);
+			}
+			else
+			{
+				r = (v >> 10) & 0x1F;
+				g = (v >> 5) & 0x1F;
+				g = (g << 3) | (g >> 2);
+			}
+			r = (r << 3) | (r >> 2);
+			b = (b << 3) | (b >> 2);
+			pDst[x] = b | (g << 8) | (r << 16);
+		}
+		break;
+	}
+
+	case FMT_RGB24:
+#ifdef BMP_USE_SSE
+		x = g_bHasSSSE3 ? Expand24_SSSE3(pSrc, pDst, m_iWidth) : Expand24_SSE2(pSrc, pDst, m_iWidth);
+#endif
+		for(pSrc += x * 3; x < m_iWidth; x++, pSrc += 3)
+			pDst[x] = pSrc[0] | (pSrc[1] << 8) | (pSrc[2] << 16);
+		break;
+
+	case FMT_RGB32:
+#ifdef BMP_USE_SSE
+		x = Copy32_SSE2(pSrc, pDst, m_iWidth);
+#endif
+		for(; x < m_iWidth; x++)
+			pDst[x] = Read32(pSrc + x * 4) & 0x00FFFFFF;
+		break;
+
+	case FMT_BITFIELDS16:
+	case FMT_BITFIELDS32:
+		for(; x < m_iWidth; x++)
+		{
+			uint32_t v = m_eFormat == FMT_BITFIELDS16 ? Read16(pSrc + x * 2) : Read32(pSrc + x * 4);
+			pDst[x] = ExpandChannel(m_Channels[2], v) | (ExpandChannel(m_Channels[1], v) << 8) |
+				(ExpandChannel(m_Channels[0], v) << 16);
+		}
+		break;
+	}
+}
+
+void CBmpDecoder::Decode(uint32_t *pDst) const
+{
+	if(!m_pBits)
+		return;
+
+	for(int y = 0; y < m_iHeight; y++)
+	{
+		int iDstRow = m_bTopDown ? m_iHeight - 1 - y : y;
+		DecodeRow(y, pDst + (size_t)iDstRow * m_iWidth);
+	}
+}
+
+bool CBmpDecoder::DecodeIndices(uint8_t *pDst, size_t uStride) const
+{
+	if(!m_pBits || m_eFormat != FMT_PALETTE || m_iBitCount != 8)
+		return false;
+
+	for(int y = 0; y < m_iHeight; y++)
+	{
+		int iDstRow = m_bTopDown ? m_iHeight - 1 - y : y;
+		memcpy(pDst + (size_t)iDstRow * uStride, m_pBits + y * m_uStride, m_iWidth);
+	}
+
+	return true;
+}
@@ -11,6 +11,7 @@
 // CPlayer Specific Includes
 //-----------------------------------------------------------------------------
 #include "Bullet.h"
+#include "SoundCache.h"
 
 //-----------------------------------------------------------------------------
 // Name : CPlayer () (Constructor)
@@ -38,6 +39,23 @@ Bullet::Bullet(const BackBuffer* pBackBuffer)
 	m_iExplosionFrame = 0;
 }
 
+//-----------------------------------------------------------------------------
+// Name : Bullet () (Copy Constructor)
+// Desc : Shares the bitmaps of rhs instead of asking the loader for them,
+//		so many objects of a kind are created quickly
+//-----------------------------------------------------------------------------
+Bullet::Bullet(const Bullet& rhs)
+{
+	m_pSprite = new Sprite(*rhs.m_pSprite);
+	m_eSpeedState = rhs.m_eSpeedState;
+	m_fTimer = rhs.m_fTimer;
+	out = rhs.out;
+
+	m_pExplosionSprite = new AnimatedSprite(*rhs.m_pExplosionSprite);
+	m_bExplosion = rhs.m_bExplosion;
+	m_iExplosionFrame = rhs.m_iExplosionFrame;
+}
+
 //-----------------------------------------------------------------------------
 // Name : ~CPlayer () (Destructor)
 // Desc : CPlayer Class Destructor
@@ -105,7 +123,7 @@ void Bullet::Explode()
 {
 	m_pExplosionSprite->mPosition = m_pSprite->mPosition;
 	m_pExplosionSprite->SetFrame(0);
-	PlaySound("data/explosion.wav", NULL, SND_FILENAME | SND_ASYNC);
+	PlayAssetSound("data/explosion.wav", SND_ASYNC, SOUND_PRIORITY_LOW, m_pSprite->mPosition);
 	m_bExplosion = true;
 }
 
@@ -125,4 +143,18 @@ bool Bullet::AdvanceExplosion()
 	}
 
 	return true;
-}
\ No newline at end of file
+}
+
+//-----------------------------------------------------------------------------
+// Name : SaveState () / LoadState ()
+// Desc : Copy the bullet state to / from a world snapshot record
+//-----------------------------------------------------------------------------
+void Bullet::SaveState(sEntityRecord& rec) const
+{
+	SaveEntityState(rec, m_pSprite, m_fTimer, m_eSpeedState, m_iExplosionFrame, m_bExplosion, out);
+}
+
+void Bullet::LoadState(const sEntityRecord& rec)
+{
+	m_eSpeedState = LoadEntityState(rec, m_pSprite, m_pExplosionSprite, m_fTimer, SPEED_START, m_iExplosionFrame, m_bExplosion, &out) ? SPEED_START : SPEED_STOP;
+}
@@ -10,11 +10,48 @@
 // CGameApp Specific Includes
 //-----------------------------------------------------------------------------
 #include "CGameApp.h"
-#include <iostream>
-#include <fstream>
+#include "StartupProfiler.h"
+#include "AssetPack.h"
+#include "SoundCache.h"
+#include "AudioMixer.h"
 using namespace std;
 
 extern HINSTANCE g_hInst;
+extern CAssetLoader g_AssetLoader;
+
+//-----------------------------------------------------------------------------
+// Preload manifest: every bitmap the game draws, with the colour key it is
+// drawn with. Longest decodes first so the workers finish together.
+//-----------------------------------------------------------------------------
+#define PRELOAD_TIMEOUT		5000	// ms, the game starts anyway after that
+
+static const struct
+{
+	const char*	szFileName;
+	COLORREF	crTransparent;
+} s_PreloadManifest[] =
+{
+	{ "data/explosion.bmp",				CLR_INVALID },
+	{ "data/explosionmask.bmp",			CLR_INVALID },
+	{ "data/planeimgandmask.bmp",		RGB(0xff, 0x00, 0xff) },
+	{ "data/PlaneImgAndMaskLeft.bmp",	RGB(0xff, 0x00, 0xff) },
+	{ "data/planeimgandmaskk.bmp",		RGB(0xff, 0x00, 0xff) },
+	{ "data/PlaneImgAndMaskRight.bmp",	RGB(0xff, 0x00, 0xff) },
+	{ "data/plane2imgandmask.bmp",		RGB(0xff, 0x00, 0xff) },
+	{ "data/crate.bmp",					RGB(0xff, 0x00, 0xff) },
+	{ "data/enemy.bmp",					RGB(0xff, 0x00, 0xff) },
+	{ "data/heart.bmp",					RGB(0xff, 0x00, 0xff) },
+	{ "data/bullet.bmp",				RGB(0xff, 0x00, 0xff) },
+};
+
+// Every sound the game plays, decoded before the first frame
+static const char* s_SoundManifest[] =
+{
+	"data/explosion.wav",
+	"data/jet-cabin.wav",
+	"data/jet-start.wav",
+	"data/jet-stop.wav",
+};
 
 //-----------------------------------------------------------------------------
 // CGameApp Member Functions
@@ -32,7 +69,20 @@ CGameApp::CGameApp()
 	m_pBBuffer		= NULL;
 	m_pPlayer		= NULL;
 	m_pPlayer2		= NULL; 
-	m_LastFrameRate = 0;
+	m_LastLives		= -1;
+	m_LastScore		= -1;
+	m_CollisionPairs = 0;
+	m_LockFPS		= 0.0f;
+	m_uRandomState	= 2463534242;
+	m_bForeground	= true;
+	m_bIdle			= false;
+	m_IdleTickRate	= 0.0f;
+	m_hIdleTimer	= NULL;
+	m_IdleWakeups	= 0;
+	m_IdleStartTime	= 0;
+	m_IdleStartCpu	= 0;
+	m_IdleCpuPercent = 0.0f;
+	m_IdleWakeupRate = 0.0f;
 }
 
 //-----------------------------------------------------------------------------
@@ -51,11 +101,22 @@ CGameApp::~CGameApp()
 //-----------------------------------------------------------------------------
 bool CGameApp::InitInstance( LPCTSTR lpCmdLine, int iCmdShow )
 {
+	// Queue every known bitmap, the workers decode them while the rest starts
+	g_Startup.BeginPhase("PreloadAssets");
+	PreloadAssets();
+	g_Startup.EndPhase();
+
 	// Create the primary display device
-	if (!CreateDisplay()) { ShutDown(); return false; }
+	g_Startup.BeginPhase("CreateDisplay");
+	bool bDisplay = CreateDisplay();
+	g_Startup.EndPhase();
+	if (!bDisplay) { ShutDown(); return false; }
 
 	// Build Objects
-	if (!BuildObjects()) 
+	g_Startup.BeginPhase("BuildObjects");
+	bool bObjects = BuildObjects();
+	g_Startup.EndPhase();
+	if (!bObjects) 
 	{ 
 		MessageBox( 0, _T("Failed to initialize properly. Reinstalling the application may solve this problem.\nIf the problem persists, please contact technical support."), _T("Fatal Error"), MB_OK | MB_ICONSTOP);
 		ShutDown(); 
@@ -63,7 +124,37 @@ bool CGameApp::InitInstance( LPCTSTR lpCmdLine, int iCmdShow )
 	}
 
 	// Set up all required game states
+	g_Startup.BeginPhase("SetupGameState");
 	SetupGameState();
+	g_Startup.EndPhase();
+
+	// Nothing should be decoded in the middle of gameplay
+	g_Startup.BeginPhase("WaitForAssets");
+	g_AssetLoader.WaitIdle(PRELOAD_TIMEOUT);
+	g_Startup.EndPhase();
+
+	// Autosaves are written by a background thread
+	m_AutoSave.Start(SNAPSHOT_FILE);
+
+	// Bitmaps edited while the game runs are reloaded between frames
+	m_AssetWatcher.Start(PACK_DEFAULT_DIR);
+
+	// While idle the world is paused, or stepped a few times a second with
+	// -idletick <steps per second>
+	LPCTSTR lpIdleTick = _tcsstr( lpCmdLine, _T("-idletick") );
+	if ( lpIdleTick )
+	{
+		m_IdleTickRate = (float)_ttoi( lpIdleTick + _tcslen( _T("-idletick") ) );
+		if ( m_IdleTickRate <= 0.0f ) m_IdleTickRate = 10.0f;
+		if ( m_IdleTickRate > 30.0f ) m_IdleTickRate = 30.0f;
+		m_hIdleTimer = CreateWaitableTimer( NULL, FALSE, NULL );
+	}
+
+	// The quality governor decides on windows of two seconds at 60 fps
+	m_Timer.SetStatsWindow( QUALITY_WINDOW );
+
+	// Loading is not a frame, the first one is timed from here
+	m_Timer.Resume();
 
 	// Success!
 	return true;
@@ -139,8 +230,18 @@ int CGameApp::BeginGame()
 			TranslateMessage( &msg );
 			DispatchMessage ( &msg );
 		} 
+		else if ( !m_bActive || !m_bForeground )
+		{
+			// Nothing needs drawing at full rate, block until a message
+			// arrives or the next idle step is due
+			if ( !m_bIdle ) EnterIdle();
+			IdleWait();
+
+		} // End If idle
 		else 
 		{
+			if ( m_bIdle ) LeaveIdle();
+
 			// Advance Game Frame.
 			FrameAdvance();
 
@@ -151,12 +252,112 @@ int CGameApp::BeginGame()
 	return 0;
 }
 
+//-----------------------------------------------------------------------------
+// Name : ProcessTime () (Static)
+// Desc : Wall clock and CPU time used by every thread of the process, in
+//		100 ns units.
+//-----------------------------------------------------------------------------
+static void ProcessTime( __int64 & Wall, __int64 & Cpu )
+{
+	FILETIME Now, Creation, Exit, Kernel, User;
+
+	GetSystemTimeAsFileTime( &Now );
+	Wall = (__int64)Now.dwHighDateTime << 32 | Now.dwLowDateTime;
+
+	Cpu = 0;
+	if ( GetProcessTimes( GetCurrentProcess(), &Creation, &Exit, &Kernel, &User ) )
+		Cpu = ((__int64)Kernel.dwHighDateTime << 32 | Kernel.dwLowDateTime) +
+			  ((__int64)User.dwHighDateTime << 32 | User.dwLowDateTime);
+}
+
+//-----------------------------------------------------------------------------
+// Name : EnterIdle () (Private)
+// Desc : Stops drawing at full rate, the idle steps start if enabled.
+//-----------------------------------------------------------------------------
+void CGameApp::EnterIdle()
+{
+	m_bIdle = true;
+	m_IdleWakeups = 0;
+	ProcessTime( m_IdleStartTime, m_IdleStartCpu );
+
+	if ( m_IdleTickRate > 0.0f && m_hIdleTimer )
+	{
+		// The first step is a period away, then every period
+		LONG Period = (LONG)(1000.0f / m_IdleTickRate);
+		LARGE_INTEGER Due;
+		Due.QuadPart = -(LONGLONG)Period * 10000;
+		SetWaitableTimer( m_hIdleTimer, &Due, Period, NULL, NULL, FALSE );
+
+		// The steps are timed on their own, not averaged with the last frames
+		m_Timer.Resume();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Name : LeaveIdle () (Private)
+// Desc : Back to full rate. Reports what the idle period cost.
+//-----------------------------------------------------------------------------
+void CGameApp::LeaveIdle()
+{
+	if ( m_hIdleTimer ) CancelWaitableTimer( m_hIdleTimer );
+	m_bIdle = false;
+
+	__int64 Wall, Cpu;
+	ProcessTime( Wall, Cpu );
+	if ( Wall > m_IdleStartTime )
+	{
+		// Wakeups per second stand in for power use, each one takes the
+		// CPU out of its low power state
+		m_IdleCpuPercent = (float)(Cpu - m_IdleStartCpu) * 100.0f / (float)(Wall - m_IdleStartTime);
+		m_IdleWakeupRate = m_IdleWakeups * 10000000.0f / (float)(Wall - m_IdleStartTime);
+	}
+
+	// The time spent idle is not a frame
+	m_Timer.Resume();
+	m_Governor.Restart();
+	m_Overlay.Resume();
+}
+
+//-----------------------------------------------------------------------------
+// Name : IdleWait () (Private)
+// Desc : Blocks until a message arrives or the next idle step is due, and
+//		runs that step. The world is drawn only if the window can be seen.
+//-----------------------------------------------------------------------------
+void CGameApp::IdleWait()
+{
+	m_IdleWakeups++;
+
+	if ( m_IdleTickRate <= 0.0f || !m_hIdleTimer )
+	{
+		WaitMessage();
+		return;
+	}
+
+	if ( MsgWaitForMultipleObjects( 1, &m_hIdleTimer, FALSE, INFINITE, QS_ALLINPUT ) == WAIT_OBJECT_0 )
+	{
+		m_Timer.Tick( );
+		AnimateObjects();
+		UpdateWorld();
+		if ( m_bActive ) DrawObjects();
+	}
+}
+
 //-----------------------------------------------------------------------------
 // Name : ShutDown ()
 // Desc : Shuts down the game engine, and frees up all resources.
 //-----------------------------------------------------------------------------
 bool CGameApp::ShutDown()
 {
+	// Finish writing any queued save
+	m_AutoSave.Shutdown();
+
+	if ( m_hIdleTimer )
+	{
+		CloseHandle( m_hIdleTimer );
+		m_hIdleTimer = NULL;
+	}
+	m_AssetWatcher.Shutdown();
+
 	// Release any previously built objects
 	ReleaseObjects ( );
 	
@@ -206,8 +407,6 @@ LRESULT CGameApp::DisplayWndProc( HWND hWnd, UINT Message, WPARAM wParam, LPARAM
 {
 	static UINT			fTimer;	
 	static TCHAR TitleBuffer[255];
-	std::ofstream fout;
-	std::ifstream fin;
 
 	// Determine message type
 	switch (Message)
@@ -223,6 +422,11 @@ LRESULT CGameApp::DisplayWndProc( HWND hWnd, UINT Message, WPARAM wParam, LPARAM
 			PostQuitMessage(0);
 			break;
 		
+		case WM_ACTIVATEAPP:
+			// Another application has the focus, the game idles
+			m_bForeground = wParam != FALSE;
+			break;
+
 		case WM_SIZE:
 			if ( wParam == SIZE_MINIMIZED )
 			{
@@ -238,6 +442,7 @@ LRESULT CGameApp::DisplayWndProc( HWND hWnd, UINT Message, WPARAM wParam, LPARAM
 				// Store new viewport sizes
 				m_nViewWidth  = LOWORD( lParam );
 				m_nViewHeight = HIWORD( lParam );
+				SetSoundStage( m_nViewWidth );
 		
 			
 			} // End if !Minimized
@@ -270,44 +475,44 @@ LRESULT CGameApp::DisplayWndProc( HWND hWnd, UINT Message, WPARAM wParam, LPARAM
 				m_pPlayer2->Explode();
 				break;
 			case 0x4f: //O
-				fout.open("Data/saveloadfile.txt");
-				fout << m_pPlayer->Position().x << " " << m_pPlayer->Position().y << "\n ";
-				fout << m_pPlayer2->Position().x << " " << m_pPlayer2->Position().y << "\n ";
-				fout << m_pPlayer->getLife() << "\n ";
-				fout<< m_pPlayer->getScore() << "\n ";
-				sprintf_s(TitleBuffer, _T("Game: %s"), "Game saved");
+				// Submit only reports the write before this one, wait for
+				// this save to reach the disk to know how it went
+				sprintf_s(TitleBuffer, _T("Game: %s"), "Saving...");
+				SetWindowText(m_hWnd, TitleBuffer);
+				SaveSnapshot(true);
+				if (m_AutoSave.Flush())
+					sprintf_s(TitleBuffer, _T("Game: %s"), "Game saved");
+				else
+					sprintf_s(TitleBuffer, _T("Game: %s"), "Unable to save file");
 				SetWindowText(m_hWnd, TitleBuffer);
-				fout.close();
 				break;
 			case 0x4c: //L
-				fin.open("Data/saveloadfile.txt");
-				if (fin)
-				{
-					int lives;
-					int score;
-					fin >> m_pPlayer->Position().x >> m_pPlayer->Position().y;
-					m_pPlayer->Velocity().x = 0;
-					m_pPlayer->Velocity().y = 0;
-					fin >> m_pPlayer2->Position().x >> m_pPlayer2->Position().y;
-					m_pPlayer2->Velocity().x = 0;
-					m_pPlayer2->Velocity().y = 0;
-					fin >> lives;
-					m_pPlayer->ReadLifes(lives);
-					fin >> score;
-					m_pPlayer->ReadScore(score);
+				if (LoadSnapshot())
 					sprintf_s(TitleBuffer, _T("Game: %s"), "Game loaded");
-					SetWindowText(m_hWnd, TitleBuffer);
-				}
 				else
-				{
 					sprintf_s(TitleBuffer, _T("Game: %s"), "Unable to open file");
-					SetWindowText(m_hWnd, TitleBuffer);
-				}
-				fin.close();
+				SetWindowText(m_hWnd, TitleBuffer);
 				break;
 			case 0x4e: //N
 				m_pPlayer->Rotate();
 				break;
+			case VK_F3:
+				m_Overlay.SetVisible( !m_Overlay.IsVisible() );
+				break;
+			case VK_F5:
+				// Cycle the frame cap: off, 60, 120
+				m_LockFPS = m_LockFPS == 0.0f ? 60.0f : (m_LockFPS == 60.0f ? 120.0f : 0.0f);
+				m_Governor.Restart();
+				break;
+			case VK_F6:
+				// Compare the limiters: sleep then spin, or spin only
+				m_Timer.SetLimiterMode( m_Timer.GetLimiterMode() == LIMITER_HYBRID ? LIMITER_SPIN : LIMITER_HYBRID );
+				break;
+			case VK_F7:
+				// Full quality whatever the frame time, or let the governor decide
+				m_Governor.SetEnabled( !m_Governor.IsEnabled() );
+				ApplyQuality();
+				break;
 			}
 			//break;
 
@@ -315,11 +520,20 @@ LRESULT CGameApp::DisplayWndProc( HWND hWnd, UINT Message, WPARAM wParam, LPARAM
 			switch(wParam)
 			{
 			case 1:
-				if(!m_pPlayer->AdvanceExplosion())
-					KillTimer(m_hWnd, 1);
+				// Lower quality levels skip explosion frames
+				for (int i = 0; i < m_Governor.GetSettings().iExplosionStep; i++)
+					if(!m_pPlayer->AdvanceExplosion())
+					{
+						KillTimer(m_hWnd, 1);
+						break;
+					}
 			case 2:
-				if (!m_pPlayer2->AdvanceExplosion())
-					KillTimer(m_hWnd, 2);
+				for (int i = 0; i < m_Governor.GetSettings().iExplosionStep; i++)
+					if (!m_pPlayer2->AdvanceExplosion())
+					{
+						KillTimer(m_hWnd, 2);
+						break;
+					}
 			}
 			break;
 
@@ -350,13 +564,41 @@ bool CGameApp::BuildObjects()
 	m_pEnemyBullet = {};
 
 
-	if(!m_imgBackground.LoadBitmapFromFile("data/background.bmp", GetDC(m_hWnd)))
+	g_Startup.BeginPhase("Background");
+	bool bBackground = m_imgBackground.LoadBitmapFromFile("data/background.bmp", GetDC(m_hWnd));
+	g_Startup.EndPhase();
+	if(!bBackground)
 		return false;
 
 	// Success!
 	return true;
 }
 
+//-----------------------------------------------------------------------------
+// Name : PreloadAssets () (Private)
+// Desc : Request every bitmap of the manifest. The loader cache keeps them,
+//		sprites created later share the loaded bitmaps. Sounds are decoded
+//		here while the bitmaps load, they are small.
+//-----------------------------------------------------------------------------
+void CGameApp::PreloadAssets()
+{
+	for (size_t i = 0; i < sizeof(s_PreloadManifest) / sizeof(s_PreloadManifest[0]); i++)
+	{
+		CBitmapAsset* pAsset = g_AssetLoader.AcquireBitmap(s_PreloadManifest[i].szFileName, s_PreloadManifest[i].crTransparent);
+		pAsset->Release();
+	}
+
+	for (size_t i = 0; i < sizeof(s_SoundManifest) / sizeof(s_SoundManifest[0]); i++)
+		g_SoundCache.Load(s_SoundManifest[i]);
+
+	sSoundCacheStats stats;
+	char szReport[192];
+	g_SoundCache.GetStats(stats);
+	sprintf_s(szReport, "Sound clips: %u, %u KB decoded from %u KB of files in %.1f ms, %u converted, %u from cache\n",
+		stats.uClips, stats.uPcmBytes / 1024, stats.uFileBytes / 1024, stats.fLoadMs, stats.uConverted, stats.uCacheHits);
+	OutputDebugString(szReport);
+}
+
 //-----------------------------------------------------------------------------
 // Name : SetupGameState ()
 // Desc : Sets up all the initial states required by the game.
@@ -399,36 +641,96 @@ void CGameApp::ReleaseObjects( )
 //-----------------------------------------------------------------------------
 void CGameApp::FrameAdvance()
 {
-	static TCHAR FrameRate[ 50 ];
 	static TCHAR TitleBuffer[ 255 ];
 
 	// Advance the timer
-	m_Timer.Tick( );
+	m_Timer.Tick( m_LockFPS );
 
 	// Skip if app is inactive
 	if ( !m_bActive ) return;
-	
-	// Get / Display the framerate
-	if ( m_LastFrameRate != m_Timer.GetFrameRate() )
+
+	// The frame timings go to the overlay, the title only changes with the
+	// lives and the score
+	if ( m_LastLives != m_pPlayer->getLife() || m_LastScore != m_pPlayer->getScore() )
 	{
-		m_LastFrameRate = m_Timer.GetFrameRate( FrameRate, 50 );
-		sprintf_s( TitleBuffer, _T("Game : %s     Lives: %d      Score: %d"), FrameRate, m_pPlayer->getLife(), m_pPlayer->getScore());
+		m_LastLives = m_pPlayer->getLife();
+		m_LastScore = m_pPlayer->getScore();
+		sprintf_s( TitleBuffer, _T("Game :     Lives: %d      Score: %d"), m_LastLives, m_LastScore );
 		SetWindowText( m_hWnd, TitleBuffer );
+	}
 
-	} // End if Frame Rate Altered
+	// Step the quality down when the slow frames miss the budget, back up
+	// once there is room again. Uncapped the budget is that of 60 fps.
+	sFrameStats Stats;
+	sLimiterStats Limiter;
+	m_Timer.GetFrameStats( Stats );
+	m_Timer.GetLimiterStats( Limiter );
+	float Budget = 1000.0f / ( m_LockFPS > 0.0f ? m_LockFPS : QUALITY_DEFAULT_FPS );
+	if ( m_Governor.Update( Stats, Limiter, Budget ) )
+		ApplyQuality();
+
+	// The overlay text is refreshed a few times a second
+	if ( m_Overlay.FrameStart( Budget ) )
+	{
+		char Info[ 128 ];
+		sprintf_s( Info, "%lu fps  p50 %.1f  p99 %.1f  max %.1f ms", m_Timer.GetFrameRate(), Stats.fP50, Stats.fP99, Stats.fMax );
+		m_Overlay.SetInfo( 0, Info );
+		sprintf_s( Info, "%s  jitter %.2f ms  CPU %.0f%%",
+			m_LockFPS == 0.0f ? "Uncapped" : (m_Timer.GetLimiterMode() == LIMITER_HYBRID ? "Sleep + spin" : "Spin"),
+			Limiter.fJitter, Limiter.fCpuPercent );
+		m_Overlay.SetInfo( 1, Info );
+		sprintf_s( Info, "Quality %d/%d%s  work p95 %.1f ms", QUALITY_LEVELS - m_Governor.GetLevel(), QUALITY_LEVELS,
+			m_Governor.IsEnabled() ? "" : " fixed", m_Governor.GetWorkTime() );
+		m_Overlay.SetInfo( 2, Info );
+		if ( m_IdleWakeups )
+		{
+			sprintf_s( Info, "Last idle: CPU %.1f%%, %.1f wakeups/s", m_IdleCpuPercent, m_IdleWakeupRate );
+			m_Overlay.SetInfo( 3, Info );
+		}
+	}
+	m_CollisionPairs = 0;
 
 	// Poll & Process input devices
 	ProcessInput();
+	m_Overlay.Lap( PERF_INPUT );
+
+	// Collisions, spawning and removal, also run by the idle steps
+	UpdateWorld();
+	m_Overlay.Lap( PERF_WORLD );
 
 	// Animate the game objects
 	AnimateObjects();
+	m_Overlay.Lap( PERF_ANIMATE );
+
+	// The game thread only copies the world, the autosave thread writes it
+	__int64 iTime = timeGetTime();
+	if (iTime - m_AutoSaveTime >= AUTOSAVE_INTERVAL)
+	{
+		m_AutoSaveTime = iTime;
+		SaveSnapshot(false);
+	}
+
+	// Swap in edited bitmaps before anything is drawn with them
+	ReloadChangedAssets();
+	m_Overlay.Lap( PERF_HOUSEKEEPING );
+
+	m_Overlay.AddCount( PERF_ENEMIES, (ULONG)m_pEnemy.size() );
+	m_Overlay.AddCount( PERF_BULLETS, (ULONG)m_pBullet.size() );
+	m_Overlay.AddCount( PERF_ENEMY_BULLETS, (ULONG)m_pEnemyBullet.size() );
+	m_Overlay.AddCount( PERF_CRATES, (ULONG)m_pCrate.size() );
+	m_Overlay.AddCount( PERF_HEARTS, (ULONG)m_pHeart.size() );
+	m_Overlay.AddCount( PERF_COLLISION_PAIRS, m_CollisionPairs );
 
 	// Drawing the game objects
 	DrawObjects();
+
+	// The startup report covers everything up to the first frame
+	g_Startup.FirstFrame();
 }
 void CGameApp::PlaneCollision()
 {
 	static UINT fTimer;
+	m_CollisionPairs++;
 	double distance = m_pPlayer->Position().Distance(m_pPlayer2->Position());
 	if (distance <= m_pPlayer->getWidth())
 	{
@@ -459,6 +761,7 @@ void CGameApp::CrateCollision()
 	static UINT fTimer;
 	for (int i = 0; i < m_pCrate.size(); i++)
 	{
+		m_CollisionPairs++;
 		double distance = m_pPlayer->Position().Distance(m_pCrate[i]->Position());
 		if (distance <= m_pPlayer->getWidth())
 		{
@@ -488,6 +791,7 @@ void CGameApp::HeartCollision()
 {
 	for (int i = 0; i < m_pHeart.size(); i++)
 	{
+		m_CollisionPairs++;
 		double distance = m_pPlayer->Position().Distance(m_pHeart[i]->Position());
 		if (distance <= m_pPlayer->getWidth())
 		{
@@ -498,6 +802,77 @@ void CGameApp::HeartCollision()
 		}
 	}
 }
+
+void CGameApp::BulletCollision()
+{
+	for (int i = 0; i < m_pEnemyBullet.size(); i++)
+	{
+		m_CollisionPairs++;
+		if (m_pPlayer->GetShotEnemy(*m_pEnemyBullet[i]))
+		{
+			static UINT			fTimer;
+			fTimer = SetTimer(m_hWnd, 1, 250, NULL);
+			m_pPlayer->Explode();
+			m_pPlayer->Position() = Vec2(200, 400);
+			m_pPlayer->ResetVelocity();
+			if (m_pPlayer->getLife() == 0)
+			{
+				MessageBox(m_hWnd, "Game ended", "Player 1 died", MB_OK);
+				PostQuitMessage(0);
+			}
+		}
+	}
+
+	for (int i = 0; i < m_pBullet.size(); i++)
+	{
+		/*if (m_pPlayer->GetShot(*m_pBullet[i]))
+		{
+
+			m_pPlayer->Explode();
+
+			m_pPlayer->Position() = Vec2(400, 400);
+			if (m_pPlayer->getLife() == 0)
+			{
+				MessageBox(m_hWnd, "Game ended", "Player 1 died", MB_OK);
+				PostQuitMessage(0);
+			}
+		}*/
+		m_CollisionPairs += 1 + (ULONG)m_pCrate.size() + (ULONG)m_pEnemy.size();
+		if (m_pPlayer2->GetShot(*m_pBullet[i]))
+		{
+			static UINT			fTimer;
+			fTimer = SetTimer(m_hWnd, 2, 250, NULL);
+			m_pPlayer2->Explode();
+			m_pPlayer2->Position() = Vec2(400, 400);
+			m_pPlayer2->ResetVelocity();
+			if (m_pPlayer2->getLife() == 0)
+			{
+				MessageBox(m_hWnd, "Game ended", "Player 2 died", MB_OK);
+				PostQuitMessage(0);
+			}
+		}
+		
+		for (int j = 0; j < m_pCrate.size(); j++)
+			if (m_pCrate[j]->GetShot(*m_pBullet[i]))
+			{
+				static UINT			fTimer;
+				fTimer = SetTimer(m_hWnd, 3, 250, NULL);
+				m_pCrate[j]->Explode();
+				m_pCrate[j]->AdvanceExplosion();
+				delete m_pCrate[j];
+				m_pPlayer->IncreaseScore();
+				m_pCrate.erase(m_pCrate.begin() + j);
+			}
+		for (int j = 0; j < m_pEnemy.size(); j++)
+			if (m_pEnemy[j]->GetShot(*m_pBullet[i]))
+			{
+				delete m_pEnemy[j];
+				m_pPlayer->IncreaseScore();
+				m_pEnemy.erase(m_pEnemy.begin() + j);
+			}
+	}
+}
+
 void CGameApp::Spawn()
 {
 	__int64 m_Time = timeGetTime();
@@ -506,13 +881,13 @@ void CGameApp::Spawn()
 	{
 		m_CrateShootTime = m_Time;
 		m_pCrate.push_back(new Crate(m_pBBuffer));
-		m_pCrate.back()->Position() = Vec2(rand() % 800, 32);
+		m_pCrate.back()->Position() = Vec2((int)(Random() % 800), 32);
 	}
 	if (m_Time - m_HeartShootTime >= 4000) //intervalul la care apare o viata
 	{
 		m_HeartShootTime = m_Time;
 		m_pHeart.push_back(new Heart(m_pBBuffer));
-		m_pHeart.back()->Position() = Vec2(rand() % 800, 32);
+		m_pHeart.back()->Position() = Vec2((int)(Random() % 800), 32);
 	}
 	if (m_Time - m_EnemySpawnTime >= 10000) //intervalul la care apare un inamic
 	{
@@ -574,6 +949,226 @@ void CGameApp::Delete()
 	}
 	
 }
+
+//-----------------------------------------------------------------------------
+// Name : Random () (Private)
+// Desc : xorshift generator for spawn positions, its state is part of the
+//		saved world so a loaded game spawns the same way.
+//-----------------------------------------------------------------------------
+UINT CGameApp::Random()
+{
+	m_uRandomState ^= m_uRandomState << 13;
+	m_uRandomState ^= m_uRandomState >> 17;
+	m_uRandomState ^= m_uRandomState << 5;
+	return m_uRandomState;
+}
+
+//-----------------------------------------------------------------------------
+// Snapshot helpers, one entity class per list
+//-----------------------------------------------------------------------------
+template <class T>
+static sEntityRecord* StoreList(const std::vector<T*>& list, sEntityRecord* pRecord)
+{
+	for (size_t i = 0; i < list.size(); i++)
+		list[i]->SaveState(*pRecord++);
+	return pRecord;
+}
+
+template <class T>
+static const sEntityRecord* RestoreList(std::vector<T*>& list, UINT uCount, const sEntityRecord* pRecord, const BackBuffer* pBackBuffer)
+{
+	// live objects are reused, only the difference is created or deleted
+	while (list.size() > uCount)
+	{
+		delete list.back();
+		list.pop_back();
+	}
+	// only the first of a kind asks the loader for its bitmaps, the others
+	// are copies sharing them
+	list.reserve(uCount);
+	while (list.size() < uCount)
+		list.push_back(list.empty() ? new T(pBackBuffer) : new T(*list.front()));
+
+	for (size_t i = 0; i < list.size(); i++)
+		list[i]->LoadState(*pRecord++);
+	return pRecord;
+}
+
+//-----------------------------------------------------------------------------
+// Name : BuildSnapshot () (Private)
+// Desc : Store the whole world in buffer: header, then every entity list.
+//-----------------------------------------------------------------------------
+void CGameApp::BuildSnapshot(std::vector<BYTE>& buffer)
+{
+	size_t uRecords = m_pBullet.size() + m_pCrate.size() + m_pHeart.size() + m_pEnemy.size() + m_pEnemyBullet.size();
+	buffer.resize(sizeof(sSnapshotHeader) + uRecords * sizeof(sEntityRecord));
+
+	sSnapshotHeader* pHeader = (sSnapshotHeader*)&buffer[0];
+	ZeroMemory(pHeader, sizeof(sSnapshotHeader));
+	pHeader->uMagic = SNAPSHOT_MAGIC;
+	pHeader->uVersion = SNAPSHOT_VERSION;
+	pHeader->uSize = (uint32_t)buffer.size();
+	pHeader->uRandomState = m_uRandomState;
+
+	// timers are stored as ages so they keep their phase on load
+	__int64 iTime = timeGetTime();
+	pHeader->iTimerAge[SNAP_TIMER_BULLET] = iTime - m_BulletShootTime;
+	pHeader->iTimerAge[SNAP_TIMER_CRATE] = iTime - m_CrateShootTime;
+	pHeader->iTimerAge[SNAP_TIMER_HEART] = iTime - m_HeartShootTime;
+	pHeader->iTimerAge[SNAP_TIMER_ENEMYSPAWN] = iTime - m_EnemySpawnTime;
+	pHeader->iTimerAge[SNAP_TIMER_ENEMYSHOOT] = iTime - m_EnemyShootTime;
+
+	pHeader->uCounts[SNAP_BULLETS] = (uint32_t)m_pBullet.size();
+	pHeader->uCounts[SNAP_CRATES] = (uint32_t)m_pCrate.size();
+	pHeader->uCounts[SNAP_HEARTS] = (uint32_t)m_pHeart.size();
+	pHeader->uCounts[SNAP_ENEMIES] = (uint32_t)m_pEnemy.size();
+	pHeader->uCounts[SNAP_ENEMYBULLETS] = (uint32_t)m_pEnemyBullet.size();
+
+	m_pPlayer->SaveState(pHeader->player1);
+	m_pPlayer2->SaveState(pHeader->player2);
+
+	sEntityRecord* pRecord = (sEntityRecord*)(pHeader + 1);
+	pRecord = StoreList(m_pBullet, pRecord);
+	pRecord = StoreList(m_pCrate, pRecord);
+	pRecord = StoreList(m_pHeart, pRecord);
+	pRecord = StoreList(m_pEnemy, pRecord);
+	pRecord = StoreList(m_pEnemyBullet, pRecord);
+}
+
+//-----------------------------------------------------------------------------
+// Name : ApplySnapshot () (Private)
+// Desc : Validate a snapshot and restore the world from it.
+//-----------------------------------------------------------------------------
+bool CGameApp::ApplySnapshot(const BYTE* pData, size_t uSize)
+{
+	const sSnapshotHeader* pHeader = (const sSnapshotHeader*)pData;
+
+	if (uSize < sizeof(sSnapshotHeader) || pHeader->uMagic != SNAPSHOT_MAGIC ||
+		pHeader->uVersion != SNAPSHOT_VERSION || pHeader->uSize != uSize)
+		return false;
+
+	size_t uRecords = 0;
+	for (int i = 0; i < SNAP_LIST_COUNT; i++)
+		uRecords += pHeader->uCounts[i];
+	if (uRecords != (uSize - sizeof(sSnapshotHeader)) / sizeof(sEntityRecord) ||
+		sizeof(sSnapshotHeader) + uRecords * sizeof(sEntityRecord) != uSize)
+		return false;
+
+	m_uRandomState = pHeader->uRandomState ? pHeader->uRandomState : 2463534242;
+
+	__int64 iTime = timeGetTime();
+	m_BulletShootTime = iTime - pHeader->iTimerAge[SNAP_TIMER_BULLET];
+	m_CrateShootTime = iTime - pHeader->iTimerAge[SNAP_TIMER_CRATE];
+	m_HeartShootTime = iTime - pHeader->iTimerAge[SNAP_TIMER_HEART];
+	m_EnemySpawnTime = iTime - pHeader->iTimerAge[SNAP_TIMER_ENEMYSPAWN];
+	m_EnemyShootTime = iTime - pHeader->iTimerAge[SNAP_TIMER_ENEMYSHOOT];
+
+	m_pPlayer->LoadState(pHeader->player1);
+	m_pPlayer2->LoadState(pHeader->player2);
+
+	// restart the explosion animations that were running
+	if (pHeader->player1.entity.bExplosion)
+		SetTimer(m_hWnd, 1, 250, NULL);
+	if (pHeader->player2.entity.bExplosion)
+		SetTimer(m_hWnd, 2, 250, NULL);
+
+	const sEntityRecord* pRecord = (const sEntityRecord*)(pHeader + 1);
+	pRecord = RestoreList(m_pBullet, pHeader->uCounts[SNAP_BULLETS], pRecord, m_pBBuffer);
+	pRecord = RestoreList(m_pCrate, pHeader->uCounts[SNAP_CRATES], pRecord, m_pBBuffer);
+	pRecord = RestoreList(m_pHeart, pHeader->uCounts[SNAP_HEARTS], pRecord, m_pBBuffer);
+	pRecord = RestoreList(m_pEnemy, pHeader->uCounts[SNAP_ENEMIES], pRecord, m_pBBuffer);
+	pRecord = RestoreList(m_pEnemyBullet, pHeader->uCounts[SNAP_ENEMYBULLETS], pRecord, m_pBBuffer);
+
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Name : SaveSnapshot () / LoadSnapshot () (Private)
+// Desc : Saving only builds the snapshot and hands it to the autosave thread,
+//		bFull asks for a full save instead of a delta. Loading waits for
+//		queued saves and reads the save with its delta applied.
+//-----------------------------------------------------------------------------
+bool CGameApp::SaveSnapshot(bool bFull)
+{
+	BuildSnapshot(m_SaveBuffer);
+
+	return m_AutoSave.Submit(m_SaveBuffer, bFull);
+}
+
+bool CGameApp::LoadSnapshot()
+{
+	std::vector<BYTE> image;
+
+	m_AutoSave.Flush();
+	if (!CAutoSave::Read(SNAPSHOT_FILE, image))
+		return false;
+
+	return ApplySnapshot(&image[0], image.size());
+}
+
+//-----------------------------------------------------------------------------
+// Name : ReloadChangedAssets () (Private)
+// Desc : Queues the bitmaps the watcher reported for decoding again and swaps
+//		in the ones the loader has finished. The background is not a loader
+//		asset and is read again here.
+//-----------------------------------------------------------------------------
+void CGameApp::ReloadChangedAssets()
+{
+	if (m_AssetWatcher.Poll(m_ChangedFiles))
+	{
+		for (size_t i = 0; i < m_ChangedFiles.size(); i++)
+		{
+			if (m_ChangedFiles[i] == "data/background.bmp")
+			{
+				m_imgBackground.Reload(m_pBBuffer->getDC());
+				ApplyQuality();
+			}
+			else
+				g_AssetLoader.Reload(m_ChangedFiles[i].c_str());
+		}
+	}
+
+	g_AssetLoader.ApplyReloads();
+}
+
+//-----------------------------------------------------------------------------
+// Name : ApplyQuality () (Private)
+// Desc : Puts the settings of the governor's current level in place.
+//-----------------------------------------------------------------------------
+void CGameApp::ApplyQuality()
+{
+	const sQualitySettings & Settings = m_Governor.GetSettings();
+
+	g_AudioMixer.SetVoiceBudget( Settings.iVoiceBudget );
+
+	// Rebuilt whenever the level or the background changes
+	if ( Settings.iBackgroundScale > 1 )
+		m_imgBackgroundSmall.CreateReduced( m_imgBackground, Settings.iBackgroundScale );
+}
+
+//-----------------------------------------------------------------------------
+// Name : UpdateWorld () (Private)
+// Desc : Enemy steering, collisions, spawning and removal of the objects,
+//		once per step. Only the keys are left to ProcessInput.
+//-----------------------------------------------------------------------------
+void CGameApp::UpdateWorld()
+{
+	for (int i = 0; i < m_pEnemy.size(); i++)
+	{
+		if (m_pEnemy[i]->Position().x < 400)
+			m_pEnemy[i]->PositiveXVelocity();
+		if (m_pEnemy[i]->Position().x > 400)
+			m_pEnemy[i]->NegativeXVelocity();
+	}
+
+	PlaneCollision();
+	CrateCollision();
+	HeartCollision();
+	BulletCollision();
+	Spawn();
+	Delete();
+}
+
 //-----------------------------------------------------------------------------
 // Name : ProcessInput () (Private)
 // Desc : Simply polls the input devices and performs basic input operations
@@ -610,20 +1205,6 @@ void CGameApp::ProcessInput( )
 	// Move the player
 	m_pPlayer->Move(Direction);
 	m_pPlayer2->Move(Direction2);
-	for (int i = 0; i < m_pEnemy.size(); i++)
-	{
-		if (m_pEnemy[i]->Position().x < 400)
-			m_pEnemy[i]->PositiveXVelocity();
-		if (m_pEnemy[i]->Position().x > 400)
-			m_pEnemy[i]->NegativeXVelocity();
-	}
-	
-	PlaneCollision();
-	CrateCollision();
-	HeartCollision();
-	Spawn();
-	Delete();
-
 
 	__int64 m_Time = timeGetTime();
 	if (pKeyBuffer[VK_SPACE] & 0xF0)
@@ -636,80 +1217,6 @@ void CGameApp::ProcessInput( )
 
 		}
 	}
-	
-
-
-
-
-	
-
-
-	for (int i = 0; i < m_pEnemyBullet.size(); i++)
-	{
-		if (m_pPlayer->GetShotEnemy(*m_pEnemyBullet[i]))
-		{
-			static UINT			fTimer;
-			fTimer = SetTimer(m_hWnd, 1, 250, NULL);
-			m_pPlayer->Explode();
-			m_pPlayer->Position() = Vec2(200, 400);
-			m_pPlayer->ResetVelocity();
-			if (m_pPlayer->getLife() == 0)
-			{
-				MessageBox(m_hWnd, "Game ended", "Player 1 died", MB_OK);
-				PostQuitMessage(0);
-			}
-		}
-	}
-
-	for (int i = 0; i < m_pBullet.size(); i++)
-	{
-		/*if (m_pPlayer->GetShot(*m_pBullet[i]))
-		{
-
-			m_pPlayer->Explode();
-
-			m_pPlayer->Position() = Vec2(400, 400);
-			if (m_pPlayer->getLife() == 0)
-			{
-				MessageBox(m_hWnd, "Game ended", "Player 1 died", MB_OK);
-				PostQuitMessage(0);
-			}
-		}*/
-		if (m_pPlayer2->GetShot(*m_pBullet[i]))
-		{
-			static UINT			fTimer;
-			fTimer = SetTimer(m_hWnd, 2, 250, NULL);
-			m_pPlayer2->Explode();
-			m_pPlayer2->Position() = Vec2(400, 400);
-			m_pPlayer2->ResetVelocity();
-			if (m_pPlayer2->getLife() == 0)
-			{
-				MessageBox(m_hWnd, "Game ended", "Player 2 died", MB_OK);
-				PostQuitMessage(0);
-			}
-		}
-		
-		for (int j = 0; j < m_pCrate.size(); j++)
-			if (m_pCrate[j]->GetShot(*m_pBullet[i]))
-			{
-				static UINT			fTimer;
-				fTimer = SetTimer(m_hWnd, 3, 250, NULL);
-				m_pCrate[j]->Explode();
-				m_pCrate[j]->AdvanceExplosion();
-				delete m_pCrate[j];
-				m_pPlayer->IncreaseScore();
-				m_pCrate.erase(m_pCrate.begin() + j);
-			}
-		for (int j = 0; j < m_pEnemy.size(); j++)
-			if (m_pEnemy[j]->GetShot(*m_pBullet[i]))
-			{
-				delete m_pEnemy[j];
-				m_pPlayer->IncreaseScore();
-				m_pEnemy.erase(m_pEnemy.begin() + j);
-			}
-	}
-
-
 
 	// Now process the mouse (if the button is pressed)
 	if ( GetCapture() == m_hWnd )
@@ -757,6 +1264,7 @@ void CGameApp::DrawObjects()
 
 	//m_imgBackground.Paint(m_pBBuffer->getDC(), 0, 0);
 	DrawBackground();
+	m_Overlay.Lap( PERF_BACKGROUND );
 
 	m_pPlayer->Draw();
 
@@ -772,8 +1280,13 @@ void CGameApp::DrawObjects()
 		m_pHeart[i]->Draw();
 	for (int i = 0; i < m_pEnemyBullet.size(); i++)
 		m_pEnemyBullet[i]->Draw();
+	m_Overlay.Lap( PERF_SPRITES );
+
+	m_Overlay.Draw( m_pBBuffer->getDC(), 0, 0 );
+	m_Overlay.Lap( PERF_OVERLAY );
 
 	m_pBBuffer->present();
+	m_Overlay.Lap( PERF_PRESENT );
 
 
 }
@@ -792,7 +1305,12 @@ void CGameApp::DrawBackground()
 			currentY = m_imgBackground.Height();
 	}
 
-	m_imgBackground.Paint(m_pBBuffer->getDC(), 0, currentY);
+	// The lower quality levels upload a quarter of the pixels and stretch them
+	int iScale = m_Governor.GetSettings().iBackgroundScale;
+	if (iScale > 1 && m_imgBackgroundSmall.Pixels())
+		m_imgBackgroundSmall.PaintScaled(m_pBBuffer->getDC(), 0, currentY / iScale, iScale);
+	else
+		m_imgBackground.Paint(m_pBBuffer->getDC(), 0, currentY);
 	//m_imgBackground.Paint(m_pBBuffer->getDC(), currentY, 0);
 
 }
@@ -12,7 +12,25 @@
 //-----------------------------------------------------------------------------
 #include "CPlayer.h"
 #include "CGameApp.h"
+#include "SoundCache.h"
 extern CGameApp g_App;
+
+// Orientations in the order Rotate steps through them
+static const char* const s_szRotationFiles[4] =
+{
+	"data/planeimgandmask.bmp",
+	"data/PlaneImgAndMaskLeft.bmp",
+	"data/planeimgandmaskk.bmp",
+	"data/PlaneImgAndMaskRight.bmp"
+};
+static const CPlayer::DIRECTION s_eRotationDirs[4] =
+{
+	CPlayer::DIR_FORWARD,
+	CPlayer::DIR_LEFT,
+	CPlayer::DIR_BACKWARD,
+	CPlayer::DIR_RIGHT
+};
+
 //-----------------------------------------------------------------------------
 // Name : CPlayer () (Constructor)
 // Desc : CPlayer Class Constructor
@@ -20,8 +38,14 @@ extern CGameApp g_App;
 CPlayer::CPlayer(const BackBuffer *pBackBuffer) : rotateDirection(DIRECTION::DIR_FORWARD)
 {
 	//m_pSprite = new Sprite("data/planeimg.bmp", "data/planemask.bmp");
-	m_pSprite = new Sprite("data/planeimgandmask.bmp", RGB(0xff,0x00, 0xff));
-	m_pSprite->setBackBuffer( pBackBuffer );
+	// Every orientation is loaded up front, rotating only picks another one
+	for (int i = 0; i < 4; i++)
+	{
+		m_pRotations[i] = new Sprite(s_szRotationFiles[i], RGB(0xff, 0x00, 0xff));
+		m_pRotations[i]->setBackBuffer( pBackBuffer );
+	}
+	m_iRotation = 0;
+	m_pSprite = m_pRotations[0];
 	m_eSpeedState = SPEED_STOP;
 	m_fTimer = 0;
 
@@ -45,7 +69,8 @@ CPlayer::CPlayer(const BackBuffer *pBackBuffer) : rotateDirection(DIRECTION::DIR
 //-----------------------------------------------------------------------------
 CPlayer::~CPlayer()
 {
-	delete m_pSprite;
+	for (int i = 0; i < 4; i++)
+		delete m_pRotations[i];
 	delete m_pExplosionSprite;
 }
 
@@ -58,10 +83,9 @@ void CPlayer::Update(float dt)
 	// Get velocity
 	double v = m_pSprite->mVelocity.Magnitude();
 
-	// NOTE: for each async sound played Windows creates a thread for you
-	// but only one, so you cannot play multiple sounds at once.
-	// This creation/destruction of threads also leads to bad performance
-	// so this method is not recommanded to be used in complex projects.
+	// NOTE: sounds go through the software mixer (see AudioMixer.h), which
+	// plays them on top of each other from a single audio thread. PlaySound
+	// is only the fallback when there is no sound device.
 
 	// update internal time counter used in sound handling (not to overlap sounds)
 	m_fTimer += dt;
@@ -73,7 +97,7 @@ void CPlayer::Update(float dt)
 		if(v > 35.0f)
 		{
 			m_eSpeedState = SPEED_START;
-			PlaySound("data/jet-start.wav", NULL, SND_FILENAME | SND_ASYNC);
+			PlayAssetSound("data/jet-start.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 			m_fTimer = 0;
 		}
 		break;
@@ -81,13 +105,13 @@ void CPlayer::Update(float dt)
 		if(v < 25.0f)
 		{
 			m_eSpeedState = SPEED_STOP;
-			PlaySound("data/jet-stop.wav", NULL, SND_FILENAME | SND_ASYNC);
+			PlayAssetSound("data/jet-stop.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 			m_fTimer = 0;
 		}
 		else
 			if(m_fTimer > 1.f)
 			{
-				PlaySound("data/jet-cabin.wav", NULL, SND_FILENAME | SND_ASYNC);
+				PlayAssetSound("data/jet-cabin.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 				m_fTimer = 0;
 			}
 		break;
@@ -196,7 +220,7 @@ void CPlayer::Explode()
 {
 	m_pExplosionSprite->mPosition = m_pSprite->mPosition;
 	m_pExplosionSprite->SetFrame(0);
-	PlaySound("data/explosion.wav", NULL, SND_FILENAME | SND_ASYNC);
+	PlayAssetSound("data/explosion.wav", SND_ASYNC, SOUND_PRIORITY_HIGH, m_pSprite->mPosition);
 	m_bExplosion = true;
 	
 	
@@ -275,31 +299,42 @@ bool CPlayer::AreIntersecting(const RECT& aFirst, const RECT& aSecond)
 
 void CPlayer::Rotate()
 {
-	auto position = m_pSprite->mPosition;
-	auto velocity = m_pSprite->mVelocity;
+	SetRotation((m_iRotation + 1) % 4);
+}
 
-	switch (rotateDirection)
-	{
-	case CPlayer::DIR_FORWARD:
-		m_pSprite = new Sprite("data/PlaneImgAndMaskLeft.bmp", RGB(0xff, 0x00, 0xff));
+void CPlayer::SetRotation(int iIndex)
+{
+	Sprite* pSprite = m_pRotations[iIndex];
 
-		rotateDirection = CPlayer::DIR_LEFT;
-		break;
-	case CPlayer::DIR_BACKWARD:
-		m_pSprite = new Sprite("data/PlaneImgAndMaskRight.bmp", RGB(0xff, 0x00, 0xff));
-		rotateDirection = CPlayer::DIR_RIGHT;
-		break;
-	case CPlayer::DIR_LEFT:
-		rotateDirection = CPlayer::DIR_BACKWARD;
-		m_pSprite = new Sprite("data/planeimgandmaskk.bmp", RGB(0xff, 0x00, 0xff));
-		break;
-	case CPlayer::DIR_RIGHT:
-		m_pSprite = new Sprite("data/planeimgandmask.bmp", RGB(0xff, 0x00, 0xff));
-		rotateDirection = CPlayer::DIR_FORWARD;
-		break;
-	}
+	pSprite->mPosition = m_pSprite->mPosition;
+	pSprite->mVelocity = m_pSprite->mVelocity;
+	m_pSprite = pSprite;
+	m_iRotation = iIndex;
+	rotateDirection = s_eRotationDirs[iIndex];
+}
+
+//-----------------------------------------------------------------------------
+// Name : SaveState () / LoadState ()
+// Desc : Copy the player state to / from a world snapshot record
+//-----------------------------------------------------------------------------
+void CPlayer::SaveState(sPlayerRecord& rec) const
+{
+	ZeroMemory(&rec, sizeof(rec));
+	SaveEntityState(rec.entity, m_pSprite, m_fTimer, m_eSpeedState, m_iExplosionFrame, m_bExplosion, false);
+	rec.iLife = life;
+	rec.iScore = score;
+	rec.iRotation = rotateDirection;
+}
+
+void CPlayer::LoadState(const sPlayerRecord& rec)
+{
+	// turn the plane first, that swaps the sprite
+	for (int i = 0; i < 4; i++)
+		if (s_eRotationDirs[i] == rec.iRotation)
+			SetRotation(i);
+
+	m_eSpeedState = LoadEntityState(rec.entity, m_pSprite, m_pExplosionSprite, m_fTimer, SPEED_START, m_iExplosionFrame, m_bExplosion, NULL) ? SPEED_START : SPEED_STOP;
 
-	m_pSprite->mPosition = position;
-	m_pSprite->mVelocity = velocity;
-	m_pSprite->setBackBuffer(g_App.m_pBBuffer);
-}
\ No newline at end of file
+	life = rec.iLife;
+	score = rec.iScore;
+}
@@ -11,6 +11,7 @@
 // CPlayer Specific Includes
 //-----------------------------------------------------------------------------
 #include "CPlayer2.h"
+#include "SoundCache.h"
 
 //-----------------------------------------------------------------------------
 // Name : CPlayer () (Constructor)
@@ -57,10 +58,9 @@ void CPlayer2::Update(float dt)
 	// Get velocity
 	double v = m_pSprite->mVelocity.Magnitude();
 
-	// NOTE: for each async sound played Windows creates a thread for you
-	// but only one, so you cannot play multiple sounds at once.
-	// This creation/destruction of threads also leads to bad performance
-	// so this method is not recommanded to be used in complex projects.
+	// NOTE: sounds go through the software mixer (see AudioMixer.h), which
+	// plays them on top of each other from a single audio thread. PlaySound
+	// is only the fallback when there is no sound device.
 
 	// update internal time counter used in sound handling (not to overlap sounds)
 	m_fTimer += dt;
@@ -72,7 +72,7 @@ void CPlayer2::Update(float dt)
 		if (v > 35.0f)
 		{
 			m_eSpeedState = SPEED_START;
-			PlaySound("data/jet-start.wav", NULL, SND_FILENAME | SND_ASYNC);
+			PlayAssetSound("data/jet-start.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 			m_fTimer = 0;
 		}
 		break;
@@ -80,13 +80,13 @@ void CPlayer2::Update(float dt)
 		if (v < 25.0f)
 		{
 			m_eSpeedState = SPEED_STOP;
-			PlaySound("data/jet-stop.wav", NULL, SND_FILENAME | SND_ASYNC);
+			PlayAssetSound("data/jet-stop.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 			m_fTimer = 0;
 		}
 		else
 			if (m_fTimer > 1.f)
 			{
-				PlaySound("data/jet-cabin.wav", NULL, SND_FILENAME | SND_ASYNC);
+				PlayAssetSound("data/jet-cabin.wav", SND_ASYNC, SOUND_PRIORITY_NORMAL, m_pSprite->mPosition);
 				m_fTimer = 0;
 			}
 		break;
@@ -174,7 +174,7 @@ void CPlayer2::Explode()
 {
 	m_pExplosionSprite->mPosition = m_pSprite->mPosition;
 	m_pExplosionSprite->SetFrame(0);
-	PlaySound("data/explosion.wav", NULL, SND_FILENAME | SND_ASYNC);
+	PlayAssetSound("data/explosion.wav", SND_ASYNC, SOUND_PRIORITY_HIGH, m_pSprite->mPosition);
 	m_bExplosion = true;
 }
 
@@ -227,3 +227,21 @@ bool CPlayer2::AreIntersecting(const RECT& aFirst, const RECT& aSecond)
 
 	return true;
 }
+
+//-----------------------------------------------------------------------------
+// Name : SaveState () / LoadState ()
+// Desc : Copy the player state to / from a world snapshot record
+//-----------------------------------------------------------------------------
+void CPlayer2::SaveState(sPlayerRecord& rec) const
+{
+	ZeroMemory(&rec, sizeof(rec));
+	SaveEntityState(rec.entity, m_pSprite, m_fTimer, m_eSpeedState, m_iExplosionFrame, m_bExplosion, false);
+	rec.iLife = life;
+}
+
+void CPlayer2::LoadState(const sPlayerRecord& rec)
+{
+	m_eSpeedState = LoadEntityState(rec.entity, m_pSprite, m_pExplosionSprite, m_fTimer, SPEED_START, m_iExplosionFrame, m_bExplosion, NULL) ? SPEED_START : SPEED_STOP;
+
+	life = rec.iLife;
+}
@@ -39,9 +39,39 @@ CTimer::CTimer()
 
 	// Clear any needed values
 	m_SampleCount		= 0;
+	m_SampleIndex		= 0;
+	m_SampleSum			= 0.0f;
 	m_FrameRate			= 0;
 	m_FPSFrameCount		= 0;
 	m_FPSTimeElapsed	= 0.0f;
+
+	m_HistoryCount		= 0;
+	SetStatsWindow( 300 );
+
+	// A high resolution timer wakes within a fraction of a millisecond, older
+	// systems need the timer period lowered for waits shorter than 15 ms
+	m_LimiterMode		= LIMITER_HYBRID;
+	m_bTimerPeriod		= false;
+	m_hWaitTimer		= CreateWaitableTimerEx( NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS );
+	if ( !m_hWaitTimer )
+	{
+		m_hWaitTimer	= CreateWaitableTimer( NULL, FALSE, NULL );
+		m_bTimerPeriod	= timeBeginPeriod( 1 ) == TIMERR_NOERROR;
+	}
+
+	m_SleepMargin		= 0.001f;
+	m_OversleepAvg		= 0.0005f;
+	m_OversleepDev		= 0.0001f;
+	m_LastFrameTime		= 0.0f;
+	m_SecTime			= 0.0f;
+	m_SecSleep			= 0.0f;
+	m_SecSpin			= 0.0f;
+	m_SecOversleep		= 0.0f;
+	m_SecJitter			= 0.0f;
+	m_SecFrames			= 0;
+	m_SecSleeps			= 0;
+	m_SecCpuTime		= 0;
+	ZeroMemory( &m_LimiterStats, sizeof(m_LimiterStats) );
 }
 
 //-----------------------------------------------------------------------------
@@ -50,31 +80,68 @@ CTimer::CTimer()
 //-----------------------------------------------------------------------------
 CTimer::~CTimer()
 {
+	if ( m_hWaitTimer ) CloseHandle( m_hWaitTimer );
+	if ( m_bTimerPeriod ) timeEndPeriod( 1 );
 }
 
 //-----------------------------------------------------------------------------
-// Name : Tick () 
-// Desc : Function which signals that frame has advanced
-// Note : You can specify a number of frames per second to lock the frame rate
-//			to. This will simply soak up the remaining time to hit that target.
+// Name : QueryTime () (Private)
+// Desc : Reads the performance counter, or timeGetTime without one.
 //-----------------------------------------------------------------------------
-void CTimer::Tick( float fLockFPS )
+__int64 CTimer::QueryTime( ) const
 {
-	float fTimeElapsed; 
+	__int64 Time;
 
 	// Is performance hardware available?
 	if ( m_PerfHardware ) 
 	{
 		// Query high-resolution performance hardware
-		QueryPerformanceCounter((LARGE_INTEGER *)&m_CurrentTime);
+		QueryPerformanceCounter((LARGE_INTEGER *)&Time);
 	} 
 	else 
 	{
 		// Fall back to less accurate timer
-		m_CurrentTime = timeGetTime();
+		Time = timeGetTime();
 
 	} // End If no hardware available
 
+	return Time;
+}
+
+//-----------------------------------------------------------------------------
+// Name : SleepFor () (Private)
+// Desc : Blocks the thread for about fSeconds, it may wake up late.
+//-----------------------------------------------------------------------------
+void CTimer::SleepFor( float fSeconds )
+{
+	if ( m_hWaitTimer )
+	{
+		// Negative due times are relative, in 100 ns units
+		LARGE_INTEGER Due;
+		Due.QuadPart = -(LONGLONG)(fSeconds * 10000000.0f);
+		if ( SetWaitableTimer( m_hWaitTimer, &Due, 0, NULL, NULL, FALSE ) )
+		{
+			WaitForSingleObject( m_hWaitTimer, INFINITE );
+			return;
+		}
+	}
+
+	Sleep( (DWORD)(fSeconds * 1000.0f) );
+}
+
+//-----------------------------------------------------------------------------
+// Name : Tick () 
+// Desc : Function which signals that frame has advanced
+// Note : You can specify a number of frames per second to lock the frame rate
+//			to. The remaining time is slept away or spun away, depending on the
+//			limiter mode.
+//-----------------------------------------------------------------------------
+void CTimer::Tick( float fLockFPS )
+{
+	float fTimeElapsed; 
+
+	m_CurrentTime = QueryTime();
+
 	// Calculate elapsed time in seconds
 	fTimeElapsed = (m_CurrentTime - m_LastTime) * m_TimeScale;
 
@@ -84,37 +151,68 @@ void CTimer::Tick( float fLockFPS )
 	// Should we lock the frame rate ?
 	if ( fLockFPS > 0.0f )
 	{
-		while ( fTimeElapsed < (1.0f / fLockFPS))
+		float fFrameTime = 1.0f / fLockFPS;
+
+		// Sleep through most of the wait, the margin left covers how late
+		// the sleeps have been waking up and adapts to it
+		float fSleep = fFrameTime - fTimeElapsed - m_SleepMargin;
+		if ( m_LimiterMode == LIMITER_HYBRID && fSleep > 0.0f )
 		{
-			// Is performance hardware available?
-			if ( m_PerfHardware ) 
-			{
-				// Query high-resolution performance hardware
-				QueryPerformanceCounter((LARGE_INTEGER*)&m_CurrentTime);
-			} 
-			else 
-			{
-				// Fall back to less accurate timer
-				m_CurrentTime = timeGetTime();
-
-			} // End If no hardware available
-
-			// Calculate elapsed time in seconds
+			__int64 SleepStart = m_CurrentTime;
+			SleepFor( fSleep );
+			m_CurrentTime = QueryTime();
+
+			float fSlept = (m_CurrentTime - SleepStart) * m_TimeScale;
+			float fOversleep = fSlept - fSleep;
+			m_OversleepAvg += (fOversleep - m_OversleepAvg) * 0.1f;
+			m_OversleepDev += (fabsf(fOversleep - m_OversleepAvg) - m_OversleepDev) * 0.1f;
+			m_SleepMargin = m_OversleepAvg + 4.0f * m_OversleepDev;
+			if ( m_SleepMargin < MIN_SLEEP_MARGIN ) m_SleepMargin = MIN_SLEEP_MARGIN;
+			if ( m_SleepMargin > MAX_SLEEP_MARGIN ) m_SleepMargin = MAX_SLEEP_MARGIN;
+
+			m_SecSleep += fSlept;
+			m_SecOversleep += fOversleep;
+			m_SecSleeps++;
+
+			fTimeElapsed = (m_CurrentTime - m_LastTime) * m_TimeScale;
+
+		} // End if sleeping
+
+		// Spin for whatever is left
+		__int64 SpinStart = m_CurrentTime;
+		while ( fTimeElapsed < fFrameTime )
+		{
+			m_CurrentTime = QueryTime();
 			fTimeElapsed = (m_CurrentTime - m_LastTime) * m_TimeScale;
 
 		} // End While
+		m_SecSpin += (m_CurrentTime - SpinStart) * m_TimeScale;
+
 	} // End If
 
 	// Save current frame time
 	m_LastTime = m_CurrentTime;
 
+	// The statistics see every frame, stutters included
+	RecordFrame( (ULONG)(fTimeElapsed * 1000000.0f) );
+	UpdateLimiterStats( fTimeElapsed );
+
 	// Filter out values wildly different from current average
 	if ( fabsf(fTimeElapsed - m_TimeElapsed) < 1.0f  )
 	{
-		// Wrap FIFO frame time buffer.
-		memmove( &m_FrameTime[1], m_FrameTime, (MAX_SAMPLE_COUNT - 1) * sizeof(float) );
-		m_FrameTime[ 0 ] = fTimeElapsed;
+		// Replace the oldest sample in the ring and keep the sum up to date
 		if ( m_SampleCount < MAX_SAMPLE_COUNT ) m_SampleCount++;
+		else m_SampleSum -= m_FrameTime[ m_SampleIndex ];
+		m_FrameTime[ m_SampleIndex ] = fTimeElapsed;
+		m_SampleSum += fTimeElapsed;
+
+		// Add it up from scratch once per lap so rounding errors do not build up
+		if ( ++m_SampleIndex == MAX_SAMPLE_COUNT )
+		{
+			m_SampleIndex = 0;
+			m_SampleSum = 0.0f;
+			for ( ULONG i = 0; i < m_SampleCount; i++ ) m_SampleSum += m_FrameTime[ i ];
+		}
 
 	} // End if
 	
@@ -129,11 +227,157 @@ void CTimer::Tick( float fLockFPS )
 		m_FPSTimeElapsed	= 0.0f;
 	} // End If Second Elapsed
 
-	// Count up the new average elapsed time
-	m_TimeElapsed = 0.0f;
-	for ( ULONG i = 0; i < m_SampleCount; i++ ) m_TimeElapsed += m_FrameTime[ i ];
-	if ( m_SampleCount > 0 ) m_TimeElapsed /= m_SampleCount;
+	// The new average elapsed time
+	if ( m_SampleCount > 0 ) m_TimeElapsed = m_SampleSum / m_SampleCount;
+
+}
+
+//-----------------------------------------------------------------------------
+// Name : Resume () 
+// Desc : Restarts frame timing after the game loop was paused. The time
+//		that passed is neither a frame nor part of the average, which starts
+//		over from the next frame.
+//-----------------------------------------------------------------------------
+void CTimer::Resume( )
+{
+	m_LastTime		= QueryTime();
+	m_SampleCount	= 0;
+	m_SampleIndex	= 0;
+	m_SampleSum		= 0.0f;
+}
+
+//-----------------------------------------------------------------------------
+// Name : RecordFrame () (Private)
+// Desc : Adds a frame time to the history, the histogram and the running
+//		maximum of the statistics window, dropping the frame that leaves it.
+//-----------------------------------------------------------------------------
+void CTimer::RecordFrame( ULONG nTime )
+{
+	ULONG nFrame = m_HistoryCount;
+
+	if ( m_WindowFrames == m_StatsWindow )
+	{
+		ULONG nOld = m_History[ (nFrame - m_StatsWindow) % FRAME_HISTORY ];
+		m_Buckets[ min(nOld / FRAME_BUCKET_US, FRAME_BUCKETS) ]--;
+		m_WindowSum -= nOld;
+		m_WindowFrames--;
+		if ( m_MaxQueue[ m_MaxHead % FRAME_HISTORY ] == nFrame - m_StatsWindow ) m_MaxHead++;
+
+	} // End if window full
+
+	m_History[ nFrame % FRAME_HISTORY ] = nTime;
+	m_Buckets[ min(nTime / FRAME_BUCKET_US, FRAME_BUCKETS) ]++;
+	m_WindowSum += nTime;
+	m_WindowFrames++;
+
+	// Frames no slower than this one can never be the maximum again
+	while ( m_MaxTail != m_MaxHead && m_History[ m_MaxQueue[ (m_MaxTail - 1) % FRAME_HISTORY ] % FRAME_HISTORY ] <= nTime ) m_MaxTail--;
+	m_MaxQueue[ m_MaxTail++ % FRAME_HISTORY ] = nFrame;
+
+	m_HistoryCount++;
+}
+
+//-----------------------------------------------------------------------------
+// Name : UpdateLimiterStats () (Private)
+// Desc : Adds up the frame limiter figures and publishes them once a second,
+//		with the CPU time the calling thread used meanwhile.
+//-----------------------------------------------------------------------------
+void CTimer::UpdateLimiterStats( float fTimeElapsed )
+{
+	m_SecJitter += fabsf( fTimeElapsed - m_LastFrameTime );
+	m_LastFrameTime = fTimeElapsed;
+	m_SecTime += fTimeElapsed;
+	m_SecFrames++;
+	if ( m_SecTime < 1.0f ) return;
+
+	FILETIME Creation, Exit, Kernel, User;
+	__int64 CpuTime = 0;
+	if ( GetThreadTimes( GetCurrentThread(), &Creation, &Exit, &Kernel, &User ) )
+	{
+		CpuTime = ((__int64)Kernel.dwHighDateTime << 32 | Kernel.dwLowDateTime) +
+				  ((__int64)User.dwHighDateTime << 32 | User.dwLowDateTime);
+	}
+
+	// The thread times advance in scheduler ticks, a second holds enough of them
+	m_LimiterStats.fCpuPercent	= m_SecCpuTime ? (CpuTime - m_SecCpuTime) / 100000.0f / m_SecTime : 0.0f;
+	m_LimiterStats.fSleep		= m_SecSleep * 1000.0f / m_SecFrames;
+	m_LimiterStats.fSpin		= m_SecSpin * 1000.0f / m_SecFrames;
+	m_LimiterStats.fMargin		= m_SleepMargin * 1000.0f;
+	m_LimiterStats.fOversleep	= m_SecSleeps ? m_SecOversleep * 1000.0f / m_SecSleeps : 0.0f;
+	m_LimiterStats.fJitter		= m_SecJitter * 1000.0f / m_SecFrames;
 
+	m_SecCpuTime	= CpuTime;
+	m_SecTime		= 0.0f;
+	m_SecSleep		= 0.0f;
+	m_SecSpin		= 0.0f;
+	m_SecOversleep	= 0.0f;
+	m_SecJitter		= 0.0f;
+	m_SecFrames		= 0;
+	m_SecSleeps		= 0;
+}
+
+//-----------------------------------------------------------------------------
+// Name : SetStatsWindow () 
+// Desc : Sets how many of the latest frames the statistics cover. The
+//		frames already recorded are counted again for the new window.
+//-----------------------------------------------------------------------------
+void CTimer::SetStatsWindow( ULONG nFrames )
+{
+	if ( nFrames < 1 ) nFrames = 1;
+	if ( nFrames > FRAME_HISTORY ) nFrames = FRAME_HISTORY;
+
+	ULONG nRecorded = m_HistoryCount;
+	ULONG nReplay = min(min(nRecorded, nFrames), FRAME_HISTORY);
+
+	m_StatsWindow	= nFrames;
+	m_WindowFrames	= 0;
+	m_WindowSum		= 0;
+	m_MaxHead		= 0;
+	m_MaxTail		= 0;
+	ZeroMemory( m_Buckets, sizeof(m_Buckets) );
+
+	// RecordFrame writes the slot it reads, so replay in order from the oldest
+	m_HistoryCount = nRecorded - nReplay;
+	for ( ULONG i = 0; i < nReplay; i++ ) RecordFrame( m_History[ m_HistoryCount % FRAME_HISTORY ] );
+}
+
+//-----------------------------------------------------------------------------
+// Name : GetPercentile () 
+// Desc : Frame time in milliseconds that fPercent of the frames in the
+//		window did not exceed.
+//-----------------------------------------------------------------------------
+float CTimer::GetPercentile( float fPercent ) const
+{
+	if ( m_WindowFrames == 0 ) return 0.0f;
+
+	float fMax = m_History[ m_MaxQueue[ m_MaxHead % FRAME_HISTORY ] % FRAME_HISTORY ] / 1000.0f;
+	ULONG nRank = (ULONG)ceil( fPercent * m_WindowFrames / 100.0 );
+	if ( nRank < 1 ) nRank = 1;
+
+	ULONG nCount = 0;
+	for ( ULONG i = 0; i < FRAME_BUCKETS; i++ )
+	{
+		nCount += m_Buckets[ i ];
+		if ( nCount >= nRank ) return min((i + 1) * FRAME_BUCKET_US / 1000.0f, fMax);
+
+	} // Next bucket
+
+	// Among the frames slower than the histogram goes
+	return fMax;
+}
+
+//-----------------------------------------------------------------------------
+// Name : GetFrameStats () 
+// Desc : Mean, percentiles and maximum frame time over the window.
+//-----------------------------------------------------------------------------
+void CTimer::GetFrameStats( sFrameStats & Stats ) const
+{
+	Stats.nFrames	= m_WindowFrames;
+	Stats.fMean		= m_WindowFrames ? (float)(m_WindowSum / 1000.0 / m_WindowFrames) : 0.0f;
+	Stats.fP50		= GetPercentile( 50.0f );
+	Stats.fP95		= GetPercentile( 95.0f );
+	Stats.fP99		= GetPercentile( 99.0f );
+	Stats.fMax		= m_WindowFrames ? m_History[ m_MaxQueue[ m_MaxHead % FRAME_HISTORY ] % FRAME_HISTORY ] / 1000.0f : 0.0f;
 }
 
 //-----------------------------------------------------------------------------
@@ -0,0 +1,401 @@
+#include "Convolution.h"
+
+// Width (in pixels) of the column tiles used by the vertical pass
+#define CONV_TILE_WIDTH 64
+
+static inline __m128 LoadPixel(const RGBQUAD *p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i v = _mm_cvtsi32_si128(*(const int*)p);
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(v, zero), zero));
+}
+
+static inline void StorePixel(RGBQUAD *p, __m128 v)
+{
+	// round, then saturate to [0, 255] while packing
+	__m128i i = _mm_cvtps_epi32(v);
+	i = _mm_packs_epi32(i, i);
+	*(int*)p = _mm_cvtsi128_si32(_mm_packus_epi16(i, i));
+}
+
+CConvolution::CConvolution(int iThreads)
+{
+#ifdef _WIN32
+	if(iThreads <= 0)
+	{
+		SYSTEM_INFO si;
+		GetSystemInfo(&si);
+		iThreads = si.dwNumberOfProcessors;
+	}
+#else
+	iThreads = 1;
+#endif
+
+	m_iThreads = min(max(iThreads, 1), 16);
+	m_iBands = 0;
+	m_bQuit = false;
+	m_pPixels = NULL;
+	m_iWidth = m_iHeight = m_iRadius = 0;
+	m_fAmount = 0;
+	m_eMode = MODE_FILTER;
+	m_ePhase = PHASE_ROWS;
+
+	m_pBands = new sBand[m_iThreads];
+	m_phDone = new HANDLE[m_iThreads];
+
+	for(int i = 0; i < m_iThreads; i++)
+	{
+		sBand &band = m_pBands[i];
+		ZeroMemory(&band, sizeof(sBand));
+		band.pEngine = this;
+		band.iIndex = i;
+
+		// band 0 runs on the calling thread
+#ifdef _WIN32
+		if(i > 0)
+		{
+			band.hStart = CreateEvent(NULL, FALSE, FALSE, NULL);
+			band.hDone = CreateEvent(NULL, FALSE, FALSE, NULL);
+			band.hThread = CreateThread(NULL, 0, WorkerProc, &band, 0, NULL);
+			m_phDone[i - 1] = band.hDone;
+		}
+#endif
+	}
+}
+
+CConvolution::~CConvolution()
+{
+	m_bQuit = true;
+
+#ifdef _WIN32
+	for(int i = 1; i < m_iThreads; i++)
+	{
+		SetEvent(m_pBands[i].hStart);
+		WaitForSingleObject(m_pBands[i].hThread, INFINITE);
+		CloseHandle(m_pBands[i].hThread);
+		CloseHandle(m_pBands[i].hStart);
+		CloseHandle(m_pBands[i].hDone);
+	}
+#endif
+
+	for(int i = 0; i < m_iThreads; i++)
+	{
+		_mm_free(m_pBands[i].pRows);
+		_mm_free(m_pBands[i].pRowsY);
+		_mm_free(m_pBands[i].pLine);
+	}
+
+	delete[] m_pBands;
+	delete[] m_phDone;
+}
+
+#ifdef _WIN32
+DWORD WINAPI CConvolution::WorkerProc(LPVOID lpParam)
+{
+	sBand *pBand = (sBand*)lpParam;
+	CConvolution *pEngine = pBand->pEngine;
+
+	while(true)
+	{
+		WaitForSingleObject(pBand->hStart, INFINITE);
+		if(pEngine->m_bQuit)
+			break;
+
+		pEngine->ProcessBand(pBand->iIndex);
+		SetEvent(pBand->hDone);
+	}
+
+	return 0;
+}
+#endif
+
+int CConvolution::BuildGaussian(float fSigma, float *pKernel)
+{
+	int iRadius = (int)ceil(3.0f * fSigma);
+	iRadius = min(max(iRadius, 1), CONV_MAX_RADIUS);
+
+	float fSum = 0;
+	for(int i = -iRadius; i <= iRadius; i++)
+	{
+		pKernel[i + iRadius] = expf(-(i * i) / (2.0f * fSigma * fSigma));
+		fSum += pKernel[i + iRadius];
+	}
+
+	for(int i = 0; i <= 2 * iRadius; i++)
+		pKernel[i] /= fSum;
+
+	return iRadius;
+}
+
+void CConvolution::GaussianBlur(CImageFile &img, float fSigma)
+{
+	if(fSigma <= 0)
+		return;
+
+	int iRadius = BuildGaussian(fSigma, m_RowKernel);
+	memcpy(m_ColKernel, m_RowKernel, sizeof(float) * (2 * iRadius + 1));
+	Run(img, MODE_FILTER, iRadius);
+}
+
+void CConvolution::BoxBlur(CImageFile &img, int iRadius)
+{
+	iRadius = min(iRadius, CONV_MAX_RADIUS);
+	if(iRadius <= 0)
+		return;
+
+	for(int i = 0; i <= 2 * iRadius; i++)
+		m_RowKernel[i] = m_ColKernel[i] = 1.0f / (2 * iRadius + 1);
+
+	Run(img, MODE_FILTER, iRadius);
+}
+
+void CConvolution::Sharpen(CImageFile &img, float fAmount, float fSigma)
+{
+	if(fSigma <= 0)
+		return;
+
+	int iRadius = BuildGaussian(fSigma, m_RowKernel);
+	memcpy(m_ColKernel, m_RowKernel, sizeof(float) * (2 * iRadius + 1));
+	m_fAmount = fAmount;
+	Run(img, MODE_SHARPEN, iRadius);
+}
+
+void CConvolution::Sobel(CImageFile &img)
+{
+	// Gx = [1 2 1]' * [-1 0 1], Gy = [-1 0 1]' * [1 2 1]
+	static const float smooth[3] = { 1.f, 2.f, 1.f };
+	static const float deriv[3] = { -1.f, 0.f, 1.f };
+
+	memcpy(m_RowKernel, deriv, sizeof(deriv));
+	memcpy(m_ColKernel, smooth, sizeof(smooth));
+	memcpy(m_RowKernelY, smooth, sizeof(smooth));
+	memcpy(m_ColKernelY, deriv, sizeof(deriv));
+	Run(img, MODE_SOBEL, 1);
+}
+
+void CConvolution::Convolve(CImageFile &img, const float *pRowKernel, const float *pColKernel, int iRadius)
+{
+	iRadius = min(iRadius, CONV_MAX_RADIUS);
+	if(iRadius <= 0)
+		return;
+
+	memcpy(m_RowKernel, pRowKernel, sizeof(float) * (2 * iRadius + 1));
+	memcpy(m_ColKernel, pColKernel, sizeof(float) * (2 * iRadius + 1));
+	Run(img, MODE_FILTER, iRadius);
+}
+
+void CConvolution::Run(CImageFile &img, EMode eMode, int iRadius)
+{
+	m_pPixels = img.Pixels();
+	m_iWidth = img.Width();
+	m_iHeight = img.Height();
+
+	if(!m_pPixels || m_iWidth <= 0 || m_iHeight <= 0)
+		return;
+
+	m_eMode = eMode;
+	m_iRadius = iRadius;
+	m_iBands = min(m_iThreads, m_iHeight);
+	PrepareTaps();
+
+	// every band must finish reading the source rows (and their halo)
+	// before any band writes its result back in place
+	Dispatch(PHASE_ROWS);
+	Dispatch(PHASE_COLS);
+}
+
+void CConvolution::PrepareTaps()
+{
+	int taps = 2 * m_iRadius + 1;
+
+	m_bRowSymmetric = m_bColSymmetric = true;
+	for(int k = 0; k < taps; k++)
+	{
+		_mm_storeu_ps(m_RowTaps[k], _mm_set1_ps(m_RowKernel[k]));
+		_mm_storeu_ps(m_ColTaps[k], _mm_set1_ps(m_ColKernel[k]));
+		_mm_storeu_ps(m_RowTapsY[k], _mm_set1_ps(m_RowKernelY[k]));
+		_mm_storeu_ps(m_ColTapsY[k], _mm_set1_ps(m_ColKernelY[k]));
+
+		if(m_RowKernel[k] != m_RowKernel[taps - 1 - k])
+			m_bRowSymmetric = false;
+		if(m_ColKernel[k] != m_ColKernel[taps - 1 - k])
+			m_bColSymmetric = false;
+	}
+}
+
+void CConvolution::Dispatch(EPhase ePhase)
+{
+	m_ePhase = ePhase;
+
+#ifdef _WIN32
+	for(int i = 1; i < m_iBands; i++)
+		SetEvent(m_pBands[i].hStart);
+#endif
+
+	ProcessBand(0);
+
+#ifdef _WIN32
+	if(m_iBands > 1)
+		WaitForMultipleObjects(m_iBands - 1, m_phDone, TRUE, INFINITE);
+#endif
+}
+
+void CConvolution::ProcessBand(int iIndex)
+{
+	int y0 = iIndex * m_iHeight / m_iBands;
+	int y1 = (iIndex + 1) * m_iHeight / m_iBands;
+
+	if(m_ePhase == PHASE_ROWS)
+		FilterRows(m_pBands[iIndex], y0, y1);
+	else
+		FilterCols(m_pBands[iIndex], y0, y1);
+}
+
+void CConvolution::Reserve(sBand &band, int iRows)
+{
+	size_t uRows = (size_t)iRows * m_iWidth;
+	size_t uLine = (size_t)m_iWidth + 2 * CONV_MAX_RADIUS;
+
+	// buffers only grow, steady state frames never allocate
+	if(uRows > band.uRowsSize)
+	{
+		_mm_free(band.pRows);
+		_mm_free(band.pRowsY);
+		band.pRows = (__m128*)_mm_malloc(uRows * sizeof(__m128), 16);
+		band.pRowsY = NULL;
+		band.uRowsSize = uRows;
+	}
+
+	if(m_eMode == MODE_SOBEL && !band.pRowsY)
+		band.pRowsY = (__m128*)_mm_malloc(band.uRowsSize * sizeof(__m128), 16);
+
+	if(uLine > band.uLineSize)
+	{
+		_mm_free(band.pLine);
+		band.pLine = (__m128*)_mm_malloc(uLine * sizeof(__m128), 16);
+		band.uLineSize = uLine;
+	}
+}
+
+void CConvolution::FilterRows(sBand &band, int y0, int y1)
+{
+	int r = m_iRadius;
+	int w = m_iWidth;
+	int taps = 2 * r + 1;
+
+	Reserve(band, y1 - y0 + 2 * r);
+
+	// rows y0 - r .. y1 + r - 1 of the image, edges are replicated
+	for(int yy = y0 - r, t = 0; yy < y1 + r; yy++, t++)
+	{
+		const RGBQUAD *pSrc = &m_pPixels[min(max(yy, 0), m_iHeight - 1) * w];
+		__m128 *pLine = band.pLine;
+
+		// convert the row once, padded so the kernel loop needs no clamping
+		for(int x = 0; x < r; x++)
+			pLine[x] = LoadPixel(&pSrc[0]);
+		for(int x = 0; x < w; x++)
+			pLine[x + r] = LoadPixel(&pSrc[x]);
+		for(int x = 0; x < r; x++)
+			pLine[w + r + x] = LoadPixel(&pSrc[w - 1]);
+
+		__m128 *pDst = &band.pRows[t * w];
+		if(m_bRowSymmetric)
+		{
+			// symmetric kernels (blurs) fold the mirrored taps: half the multiplies
+			for(int x = 0; x < w; x++)
+			{
+				const __m128 *p = &pLine[x + r];
+				__m128 acc = _mm_mul_ps(_mm_loadu_ps(m_RowTaps[r]), p[0]);
+				for(int k = 1; k <= r; k++)
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(m_RowTaps[r + k]), _mm_add_ps(p[-k], p[k])));
+				pDst[x] = acc;
+			}
+		}
+		else
+		{
+			for(int x = 0; x < w; x++)
+			{
+				__m128 acc = _mm_setzero_ps();
+				for(int k = 0; k < taps; k++)
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(m_RowTaps[k]), pLine[x + k]));
+				pDst[x] = acc;
+			}
+		}
+
+		if(m_eMode == MODE_SOBEL)
+		{
+			__m128 *pDstY = &band.pRowsY[t * w];
+			for(int x = 0; x < w; x++)
+			{
+				__m128 acc = _mm_setzero_ps();
+				for(int k = 0; k < taps; k++)
+					acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(m_RowTapsY[k]), pLine[x + k]));
+				pDstY[x] = acc;
+			}
+		}
+	}
+}
+
+void CConvolution::FilterCols(sBand &band, int y0, int y1)
+{
+	int r = m_iRadius;
+	int w = m_iWidth;
+	int taps = 2 * r + 1;
+	__m128 amount = _mm_set1_ps(m_fAmount);
+
+	for(int x0 = 0; x0 < w; x0 += CONV_TILE_WIDTH)
+	{
+		int x1 = min(x0 + CONV_TILE_WIDTH, w);
+
+		for(int y = y0; y < y1; y++)
+		{
+			// band row t holds image row y0 - r + t, so the window of y starts at y - y0
+			const __m128 *pWin = &band.pRows[(y - y0) * w];
+			const __m128 *pWinY = band.pRowsY ? &band.pRowsY[(y - y0) * w] : NULL;
+			RGBQUAD *pDst = &m_pPixels[y * w];
+
+			for(int x = x0; x < x1; x++)
+			{
+				__m128 acc;
+				if(m_bColSymmetric)
+				{
+					const __m128 *p = &pWin[r * w + x];
+					acc = _mm_mul_ps(_mm_loadu_ps(m_ColTaps[r]), p[0]);
+					for(int k = 1; k <= r; k++)
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(m_ColTaps[r + k]), _mm_add_ps(p[-k * w], p[k * w])));
+				}
+				else
+				{
+					acc = _mm_setzero_ps();
+					for(int k = 0; k < taps; k++)
+						acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(m_ColTaps[k]), pWin[k * w + x]));
+				}
+
+				switch(m_eMode)
+				{
+				case MODE_SHARPEN:
+					{
+						__m128 src = LoadPixel(&pDst[x]);
+						acc = _mm_add_ps(src, _mm_mul_ps(amount, _mm_sub_ps(src, acc)));
+					}
+					break;
+
+				case MODE_SOBEL:
+					{
+						__m128 gy = _mm_setzero_ps();
+						for(int k = 0; k < taps; k++)
+							gy = _mm_add_ps(gy, _mm_mul_ps(_mm_loadu_ps(m_ColTapsY[k]), pWinY[k * w + x]));
+						acc = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(acc, acc), _mm_mul_ps(gy, gy)));
+					}
+					break;
+
+				default:
+					break;
+				}
+
+				StorePixel(&pDst[x], acc);
+			}
+		}
+	}
+}
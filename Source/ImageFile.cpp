@@ -2,23 +2,56 @@
 // by Mihai Popescu
 // March 2009
 #include "ImageFile.h"
+#include "MappedFile.h"
+#include "BmpDecoder.h"
+#include <emmintrin.h>
+
+#ifdef _WIN32
+#include "AssetPack.h"
 
 extern HINSTANCE g_hInst;
+extern CAssetPack g_AssetPack;
+#endif
 
 
 CImageFile::CImageFile() : height(m_biInfo.biHeight), width(m_biInfo.biWidth)
 {
 	m_hBMP = 0;
 	m_pRGB = NULL;
+	m_szFileName[0] = '\0';
 	ZeroMemory(&m_biInfo, sizeof(BITMAPINFOHEADER));
 }
 
-bool CImageFile::LoadBitmapFromFile(const char *szFileName, HDC hdc)
+bool CImageFile::LoadBitmapFromFile(const char *szFileName, HDC hdc, bool bUsePack)
 {
-	BYTE *pData;
-	HDC mdc = CreateCompatibleDC(hdc);
+	CMappedFile file;
+	CBmpDecoder bmp;
+
+	// Reload passes our own name back in
+	if(szFileName != m_szFileName)
+		strcpy_s(m_szFileName, MAX_PATH, szFileName);
+
+	// Decode the packed copy or a mapping of the file straight into the 32 bit buffer
+	// NOTE: We keep our own copy of the bits in order to modify them
+	// applying different filters or other image processing algorithms in real time 
+	// such as blur effect (denoising) or other convolutions.
+	const uint8_t *pData;
+	size_t uSize;
+#ifdef _WIN32
+	// the headless builds off Windows have no pack and always read the file
+	if(!bUsePack || !g_AssetPack.Find(szFileName, &pData, &uSize))
+#endif
+	{
+		if(!file.Open(szFileName))
+			return false;
+		pData = file.Data();
+		uSize = file.Size();
+	}
 
-	strcpy_s(m_szFileName, MAX_PATH, szFileName);
+	// a file that does not parse, or is still being written, keeps the
+	// current image
+	if(!bmp.Parse(pData, uSize))
+		return false;
 
 	// release previously loaded file data
 	if(m_pRGB)
@@ -33,62 +66,65 @@ bool CImageFile::LoadBitmapFromFile(const char *szFileName, HDC hdc)
 		m_hBMP = 0;
 	}
 
-	// Loads the image.
-	m_hBMP = (HBITMAP)LoadImage(g_hInst, szFileName, IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION | LR_LOADFROMFILE);	
-
-	if(!m_hBMP)
-		return false;
-
-	ZeroMemory(&m_biInfo, sizeof(BITMAPINFO));
-	m_biInfo.biSize=sizeof(BITMAPINFOHEADER);
-
-	// send NULL to bits to get the bitmap info
-	GetDIBits(mdc, m_hBMP, 0, 0, NULL, (BITMAPINFO*)&m_biInfo, DIB_RGB_COLORS);
+	ZeroMemory(&m_biInfo, sizeof(BITMAPINFOHEADER));
+	m_biInfo.biSize = sizeof(BITMAPINFOHEADER);
+	m_biInfo.biWidth = bmp.Width();
+	m_biInfo.biHeight = bmp.Height();
+	m_biInfo.biPlanes = 1;
+	m_biInfo.biBitCount = 32;
+	m_biInfo.biCompression = BI_RGB;
+	m_biInfo.biSizeImage = width * height * sizeof(RGBQUAD);
 
-	pData = new BYTE[m_biInfo.biSizeImage];
+	m_pRGB = new RGBQUAD[width * height];
+	bmp.Decode((uint32_t*)m_pRGB);
 
-	// read the bitmap data
-	// NOTE: We use this method to access the bitmap bits in order to modify them
-	// applying different filters or other image processing algorithms in real time 
-	// such as blur effect (denoising) or other convolutions.
-	GetDIBits(mdc, m_hBMP, 0, height, pData, (BITMAPINFO*)&m_biInfo, DIB_RGB_COLORS);
+	return true;
+}
 
-	m_pRGB = new RGBQUAD[width * height];
+bool CImageFile::Create(LONG lWidth, LONG lHeight)
+{
+	if(lWidth <= 0 || lHeight <= 0)
+		return false;
 
-	// Fill RGB image on 32 bit in order to display it
-	if(m_biInfo.biBitCount == 24)
+	// release previously loaded file data
+	if(m_pRGB)
 	{
-		int size = width * height;
-		unsigned char *data = pData;
-		RGBQUAD *c = m_pRGB;
-
-		for(int i=0;i<size;i++)
-		{
-			c->rgbBlue = *data++;
-			c->rgbGreen = *data++;
-			c->rgbRed = *data++;
-			c->rgbReserved = 0;
-			c++;
-		}
+		delete[] m_pRGB;
+		m_pRGB = NULL;
 	}
 
-	m_biInfo.biBitCount = 32;
+	if(m_hBMP)
+	{
+		DeleteObject(m_hBMP);
+		m_hBMP = 0;
+	}
 
-	DeleteObject(m_hBMP);
-	m_hBMP = 0;
+	m_szFileName[0] = '\0';
 
-	DeleteDC(mdc);
+	ZeroMemory(&m_biInfo, sizeof(BITMAPINFOHEADER));
+	m_biInfo.biSize = sizeof(BITMAPINFOHEADER);
+	m_biInfo.biWidth = lWidth;
+	m_biInfo.biHeight = lHeight;
+	m_biInfo.biPlanes = 1;
+	m_biInfo.biBitCount = 32;
+	m_biInfo.biCompression = BI_RGB;
+	m_biInfo.biSizeImage = lWidth * lHeight * sizeof(RGBQUAD);
 
-	delete[] pData;
+	m_pRGB = new RGBQUAD[lWidth * lHeight];
+	Clear();
 
 	return true;
 }
 
 void CImageFile::Reload(HDC hdc)
 {
-	LoadBitmapFromFile(m_szFileName, hdc);
+	// images built in memory have no file to reload from. The file on disk
+	// is the one being edited, the packed copy is not looked at.
+	if(m_szFileName[0])
+		LoadBitmapFromFile(m_szFileName, hdc, false);
 }
 
+#ifdef _WIN32
 void CImageFile::Paint(HDC hdc, int x, int y)
 {
 	if (!m_pRGB)
@@ -108,6 +144,84 @@ void CImageFile::Paint(HDC hdc, int x, int y)
 
 	DeleteDC(mdc);
 }
+#else
+void CImageFile::Paint(HDC, int, int)
+{
+}
+#endif
+
+bool CImageFile::CreateReduced(const CImageFile &source, int iFactor)
+{
+	if(!source.m_pRGB || iFactor < 1)
+		return false;
+
+	// rounded up, the blocks on the far edges are partial
+	LONG lWidth = (source.width + iFactor - 1) / iFactor;
+	LONG lHeight = (source.height + iFactor - 1) / iFactor;
+	if(!Create(lWidth, lHeight))
+		return false;
+
+	for(LONG y = 0; y < lHeight; y++)
+	{
+		LONG y0 = y * iFactor;
+		LONG y1 = min(y0 + iFactor, source.height);
+
+		for(LONG x = 0; x < lWidth; x++)
+		{
+			LONG x0 = x * iFactor;
+			LONG x1 = min(x0 + iFactor, source.width);
+			UINT r = 0, g = 0, b = 0;
+
+			for(LONG sy = y0; sy < y1; sy++)
+			{
+				const RGBQUAD *pRow = source.m_pRGB + sy * source.width;
+				for(LONG sx = x0; sx < x1; sx++)
+				{
+					r += pRow[sx].rgbRed;
+					g += pRow[sx].rgbGreen;
+					b += pRow[sx].rgbBlue;
+				}
+			}
+
+			UINT n = (y1 - y0) * (x1 - x0);
+			RGBQUAD &q = m_pRGB[y * lWidth + x];
+			q.rgbRed = (BYTE)((r + n / 2) / n);
+			q.rgbGreen = (BYTE)((g + n / 2) / n);
+			q.rgbBlue = (BYTE)((b + n / 2) / n);
+		}
+	}
+
+	return true;
+}
+
+#ifdef _WIN32
+void CImageFile::PaintScaled(HDC hdc, int x, int y, int iScale)
+{
+	if (!m_pRGB)
+		return;
+
+	if (!m_hBMP)
+		m_hBMP = CreateCompatibleBitmap(hdc, width, height);
+
+	HDC mdc = CreateCompatibleDC(hdc);
+
+	SelectObject(mdc, m_hBMP);
+
+	SetDIBits(mdc, m_hBMP, 0, height, m_pRGB, (BITMAPINFO*)&m_biInfo, DIB_RGB_COLORS);
+
+	// plain pixel replication, no filtering on the way up
+	int iMode = SetStretchBltMode(hdc, COLORONCOLOR);
+	StretchBlt(hdc, x * iScale, 0, width * iScale, (height - y) * iScale, mdc, x, y, width, height - y, SRCCOPY);
+	StretchBlt(hdc, x * iScale, (height - y) * iScale, width * iScale, y * iScale, mdc, x, 0, width, y, SRCCOPY);
+	SetStretchBltMode(hdc, iMode);
+
+	DeleteDC(mdc);
+}
+#else
+void CImageFile::PaintScaled(HDC, int, int, int)
+{
+}
+#endif
 
 
 CImageFile::~CImageFile(void)
@@ -118,182 +232,286 @@ CImageFile::~CImageFile(void)
 	DeleteObject(m_hBMP);
 }
 
-BYTE* CImageFile::CopyMonoImage(EColorChannel chn, const RECT* rc)
+//-----------------------------------------------------------------------------
+// Per pixel HSL helpers, used for the pixels left over by the SSE2 kernels
+//-----------------------------------------------------------------------------
+static inline BYTE HueOf(const RGBQUAD &q)
 {
-	int imgHeight = rc? rc->bottom - rc->top + 1 : height;
-	int imgWidth = rc? rc->right - rc->left + 1 : width;
-	int x = rc? rc->left : 0;
-	int y = rc? rc->top : 0;
+	float r = q.rgbRed/255.0f;
+	float g = q.rgbGreen/255.0f;
+	float b = q.rgbBlue/255.0f;
 
-	BYTE *img = new BYTE[imgHeight * imgWidth];
+	float u = max(r, g);
+	u = max(b, u);
+	float d = min(r, g);
+	d = min(b, d);
 
-	switch(chn)
+	if(fabsf(u-d)<EPS)
+		return 0;
+
+	float f = 1/(u-d);
+
+	if(fabsf(u-r)<EPS)
+	{
+		f *= (g-b)*60.f;
+	}
+	else
+	if(fabsf(u-g)<EPS)
+	{
+		f *= (b-r)*60.f;
+		f += 120;
+	}
+	else
 	{
+		f *= (r-g)*60.f;
+		f += 240;
+	}
 
-	case ECC_RED:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				img[i*imgWidth + j] = m_pRGB[(i+y)*width + j + x].rgbRed;
-		break;
+	// red dominant pixels with more blue than green wrap around the hue circle
+	if(f < 0)
+		f += 360;
+
+	return (BYTE)(f*255.f/360.f);
+}
+
+static inline BYTE SaturationOf(const RGBQUAD &q)
+{
+	float r = q.rgbRed/255.0f;
+	float g = q.rgbGreen/255.0f;
+	float b = q.rgbBlue/255.0f;
+
+	float u = max(r, g);
+	u = max(b, u);
+	float d = min(r, g);
+	d = min(b, d);
+
+	if(fabsf(u-d)<EPS)
+		return 0;
+
+	float l = (u+d)/2;
+	float f = (u-d);
+
+	if(l<=0.5f)
+		f /= u+d;
+	else
+		f /= 2-u-d;
+
+	return (BYTE)(f*255.f);
+}
 
+static inline BYTE LuminosityOf(const RGBQUAD &q)
+{
+	float r = q.rgbRed/255.0f;
+	float g = q.rgbGreen/255.0f;
+	float b = q.rgbBlue/255.0f;
+
+	float u = max(r, g);
+	u = max(b, u);
+	float d = min(r, g);
+	d = min(b, d);
+
+	if(fabsf(u-d)<EPS)
+		return 0;
+
+	return (BYTE)((u+d)/2*255.f);
+}
+
+// bit position of a colour channel inside a RGBQUAD read as a DWORD
+static inline int ChannelShift(EColorChannel chn)
+{
+	switch(chn)
+	{
+	case ECC_RED:
+	case ECC_EXCLUSIVERED:
+		return 16;
 	case ECC_GREEN:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				img[i*imgWidth + j] = m_pRGB[(i+y)*width + j + x].rgbGreen;
-		break;
-
-	case ECC_BLUE:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				img[i*imgWidth + j] = m_pRGB[(i+y)*width + j + x].rgbBlue;
-		break;
-
-	case ECC_HUE:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-			{
-				RGBQUAD &q = m_pRGB[(i+y)*width + j + x];
-				float r = q.rgbRed/255.0f;
-				float g = q.rgbGreen/255.0f;
-				float b = q.rgbBlue/255.0f;
+	case ECC_EXCLUSIVEGREEN:
+		return 8;
+	default:
+		return 0;
+	}
+}
 
-				float u = max(r, g);
-				u = max(b, u);
-				float d = min(r, g);
-				d = min(b, d);
+// Extract one plane of a row of pixels. R, G and B are unpacked 16 pixels per
+// step, H, S and L are computed in single precision 4 pixels per step with the
+// same operations as the scalar helpers, so both paths give identical bytes.
+static void ExtractRow(const RGBQUAD *src, BYTE *dst, int n, EColorChannel chn)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xFF);
+	int j = 0;
 
-				BYTE v;
+	if(chn != ECC_HUE && chn != ECC_SATURATION && chn != ECC_LUMINOSITY)
+	{
+		__m128i shift = _mm_cvtsi32_si128(ChannelShift(chn));
 
-				if(fabsf(u-d)<EPS)
-					v=0;
-				else
-				{
-					float f = 1/(u-d);
-
-					if(fabsf(u-r)<EPS)
-					{
-						f *= (g-b)*60.f;
-					}
-					else
-					if(fabsf(u-g)<EPS)
-					{
-						f *= (b-r)*60.f;
-						f += 120;
-					}
-					else
-					if(fabsf(u-b)<EPS)
-					{
-						f *= (r-g)*60.f;
-						f += 240;
-					}
-
-					v = (BYTE)(f*255.f/360.f);
-				}
+		for(; j + 16 <= n; j += 16)
+		{
+			__m128i c0 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)(src + j)), shift), byteMask);
+			__m128i c1 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)(src + j + 4)), shift), byteMask);
+			__m128i c2 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)(src + j + 8)), shift), byteMask);
+			__m128i c3 = _mm_and_si128(_mm_srl_epi32(_mm_loadu_si128((const __m128i*)(src + j + 12)), shift), byteMask);
 
-				img[i*imgWidth + j] = v;
-			}
+			_mm_storeu_si128((__m128i*)(dst + j), _mm_packus_epi16(_mm_packs_epi32(c0, c1), _mm_packs_epi32(c2, c3)));
+		}
 
-	case ECC_SATURATION:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-			{
-				RGBQUAD &q = m_pRGB[(i+y)*width + j + x];
-				float r = q.rgbRed/255.0f;
-				float g = q.rgbGreen/255.0f;
-				float b = q.rgbBlue/255.0f;
+		int s = ChannelShift(chn);
+		for(; j < n; j++)
+			dst[j] = (BYTE)(*(const DWORD*)&src[j] >> s);
 
-				float u = max(r, g);
-				u = max(b, u);
-				float d = min(r, g);
-				d = min(b, d);
+		return;
+	}
 
-				BYTE v;
+	const __m128 k255 = _mm_set1_ps(255.f);
+	const __m128 kZero = _mm_setzero_ps();
+	const __m128 kEps = _mm_set1_ps((float)EPS);
+	const __m128 kHalf = _mm_set1_ps(0.5f);
+	const __m128 kOne = _mm_set1_ps(1.f);
+	const __m128 kTwo = _mm_set1_ps(2.f);
+	const __m128 k60 = _mm_set1_ps(60.f);
+	const __m128 k120 = _mm_set1_ps(120.f);
+	const __m128 k240 = _mm_set1_ps(240.f);
+	const __m128 k360 = _mm_set1_ps(360.f);
+
+	for(; j + 4 <= n; j += 4)
+	{
+		__m128i p = _mm_loadu_si128((const __m128i*)(src + j));
+		__m128 r = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 16), byteMask)), k255);
+		__m128 g = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(p, 8), byteMask)), k255);
+		__m128 b = _mm_div_ps(_mm_cvtepi32_ps(_mm_and_si128(p, byteMask)), k255);
 
-				if(fabsf(u-d)<EPS)
-					v=0;
-				else
-				{
-					float l = (u+d)/2;
-					float f = (u-d);
+		__m128 u = _mm_max_ps(b, _mm_max_ps(r, g));
+		__m128 d = _mm_min_ps(b, _mm_min_ps(r, g));
+		__m128 delta = _mm_sub_ps(u, d);
 
-					if(l<=0.5f)
-						f /= u+d;
-					else
-						f /= 2-u-d;
+		// grey pixels give 0 on every plane
+		__m128 chroma = _mm_cmpge_ps(delta, kEps);
+		__m128 f;
 
-					v = (BYTE)(f*255.f);
-				}
+		if(chn == ECC_HUE)
+		{
+			__m128 inv = _mm_div_ps(kOne, delta);
+			__m128 hr = _mm_mul_ps(inv, _mm_mul_ps(_mm_sub_ps(g, b), k60));
+			__m128 hg = _mm_add_ps(_mm_mul_ps(inv, _mm_mul_ps(_mm_sub_ps(b, r), k60)), k120);
+			__m128 hb = _mm_add_ps(_mm_mul_ps(inv, _mm_mul_ps(_mm_sub_ps(r, g), k60)), k240);
+
+			// same priority as the scalar code: red, then green, then blue
+			__m128 isR = _mm_cmpeq_ps(u, r);
+			__m128 isG = _mm_andnot_ps(isR, _mm_cmpeq_ps(u, g));
+			__m128 isB = _mm_andnot_ps(_mm_or_ps(isR, isG), chroma);
+
+			f = _mm_or_ps(_mm_or_ps(_mm_and_ps(isR, hr), _mm_and_ps(isG, hg)), _mm_and_ps(isB, hb));
+			f = _mm_add_ps(f, _mm_and_ps(_mm_cmplt_ps(f, kZero), k360));
+			f = _mm_div_ps(_mm_mul_ps(f, k255), k360);
+		}
+		else
+		if(chn == ECC_SATURATION)
+		{
+			__m128 sum = _mm_add_ps(u, d);
+			__m128 l = _mm_div_ps(sum, kTwo);
+			__m128 low = _mm_cmple_ps(l, kHalf);
+			__m128 den = _mm_or_ps(_mm_and_ps(low, sum), _mm_andnot_ps(low, _mm_sub_ps(_mm_sub_ps(kTwo, u), d)));
+			f = _mm_mul_ps(_mm_div_ps(delta, den), k255);
+		}
+		else
+		{
+			f = _mm_mul_ps(_mm_div_ps(_mm_add_ps(u, d), kTwo), k255);
+		}
 
-				img[i*imgWidth + j] = v;
-			}
-		break;
+		__m128i v = _mm_and_si128(_mm_cvttps_epi32(f), _mm_castps_si128(chroma));
+		v = _mm_packus_epi16(_mm_packs_epi32(v, v), v);
+		*(int*)(dst + j) = _mm_cvtsi128_si32(v);
+	}
 
-	case ECC_LUMINOSITY:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-			{
-				RGBQUAD &q = m_pRGB[(i+y)*width + j + x];
-				float r = q.rgbRed/255.0f;
-				float g = q.rgbGreen/255.0f;
-				float b = q.rgbBlue/255.0f;
+	for(; j < n; j++)
+	{
+		switch(chn)
+		{
+		case ECC_HUE:
+			dst[j] = HueOf(src[j]);
+			break;
+		case ECC_SATURATION:
+			dst[j] = SaturationOf(src[j]);
+			break;
+		default:
+			dst[j] = LuminosityOf(src[j]);
+			break;
+		}
+	}
+}
 
-				float u = max(r, g);
-				u = max(b, u);
-				float d = min(r, g);
-				d = min(b, d);
+// Write one plane of a row of pixels, the other channels are left untouched
+static void InsertRow(const BYTE *src, RGBQUAD *dst, int n, EColorChannel chn)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int s = ChannelShift(chn);
+	__m128i shift = _mm_cvtsi32_si128(s);
+	__m128i keep = _mm_set1_epi32(~(0xFF << s));
+	int j = 0;
 
-				BYTE v;
+	for(; j + 16 <= n; j += 16)
+	{
+		__m128i bytes = _mm_loadu_si128((const __m128i*)(src + j));
+		__m128i lo = _mm_unpacklo_epi8(bytes, zero);
+		__m128i hi = _mm_unpackhi_epi8(bytes, zero);
+		__m128i v[4];
 
-				if(fabsf(u-d)<EPS)
-					v=0;
-				else
-				{
-					float f = (u+d)/2;
-					v = (BYTE)(f*255.f);
-				}
+		v[0] = _mm_unpacklo_epi16(lo, zero);
+		v[1] = _mm_unpackhi_epi16(lo, zero);
+		v[2] = _mm_unpacklo_epi16(hi, zero);
+		v[3] = _mm_unpackhi_epi16(hi, zero);
 
-				img[i*imgWidth + j] = v;
-			}
-		break;
+		for(int k = 0; k < 4; k++)
+		{
+			__m128i *p = (__m128i*)(dst + j + 4 * k);
+			__m128i px = _mm_and_si128(_mm_loadu_si128(p), keep);
+			_mm_storeu_si128(p, _mm_or_si128(px, _mm_sll_epi32(v[k], shift)));
+		}
+	}
+
+	for(; j < n; j++)
+	{
+		DWORD *px = (DWORD*)&dst[j];
+		*px = (*px & ~(0xFF << s)) | ((DWORD)src[j] << s);
 	}
+}
+
+BYTE* CImageFile::CopyMonoImage(EColorChannel chn, const RECT* rc)
+{
+	int imgHeight = rc? rc->bottom - rc->top + 1 : height;
+	int imgWidth = rc? rc->right - rc->left + 1 : width;
+
+	BYTE *img = new BYTE[imgHeight * imgWidth];
+
+	CopyMonoImage(img, chn, rc);
 
 	return img;
 }
 
-void CImageFile::PasteMonoImage(const BYTE *img, EColorChannel chn, const RECT* rc)
+void CImageFile::CopyMonoImage(BYTE *img, EColorChannel chn, const RECT* rc) const
 {
 	int imgHeight = rc? rc->bottom - rc->top + 1 : height;
 	int imgWidth = rc? rc->right - rc->left + 1 : width;
 	int x = rc? rc->left : 0;
 	int y = rc? rc->top : 0;
 
-	if(chn >= ECC_EXCLUSIVERED)
-		Clear();
+	for(int i=0;i<imgHeight;i++)
+		ExtractRow(&m_pRGB[(i+y)*width + x], &img[i*imgWidth], imgWidth, chn);
+}
 
-	switch(chn)
-	{
+void CImageFile::PasteMonoImage(const BYTE *img, EColorChannel chn, const RECT* rc)
+{
+	int imgHeight = rc? rc->bottom - rc->top + 1 : height;
+	int imgWidth = rc? rc->right - rc->left + 1 : width;
+	int x = rc? rc->left : 0;
+	int y = rc? rc->top : 0;
 
-	case ECC_EXCLUSIVERED:
-	case ECC_RED:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				m_pRGB[(i+y)*width + j + x].rgbRed = img[i*imgWidth + j];
-		break;
+	// only colour planes can be pasted back
+	if(chn == ECC_HUE || chn == ECC_SATURATION || chn == ECC_LUMINOSITY)
+		return;
 
-	case ECC_EXCLUSIVEGREEN:
-	case ECC_GREEN:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				m_pRGB[(i+y)*width + j + x].rgbGreen = img[i*imgWidth + j];
-		break;
-
-	case ECC_EXCLUSIVEBLUE:
-	case ECC_BLUE:
-		for(int i=0;i<imgHeight;i++)
-			for(int j=0;j<imgWidth;j++)
-				m_pRGB[(i+y)*width + j + x].rgbBlue = img[i*imgWidth + j];
-		break;
-	}
+	if(chn >= ECC_EXCLUSIVERED)
+		Clear();
 
+	for(int i=0;i<imgHeight;i++)
+		InsertRow(&img[i*imgWidth], &m_pRGB[(i+y)*width + x], imgWidth, chn);
 }
-
@@ -11,12 +11,41 @@
 //-----------------------------------------------------------------------------
 #include "Main.h"
 #include "CGameApp.h"
+#include "ResizeBenchmark.h"
+#include "SpscQueueTest.h"
+#include "AssetPack.h"
+#include "AssetLoader.h"
+#include "StartupProfiler.h"
+#include "SoundCache.h"
+#include "AudioMixer.h"
 
 //-----------------------------------------------------------------------------
 // Global Variable Definitions
 //-----------------------------------------------------------------------------
 CGameApp	g_App;	  // Core game application processing engine
 HINSTANCE	g_hInst;	// Global instance
+CAssetPack	g_AssetPack;	// Game data, mapped for the whole run
+CAssetLoader	g_AssetLoader;	// Background sprite loading
+CStartupProfiler	g_Startup;	// Startup timeline, written to startup.txt
+CSoundCache	g_SoundCache;	// Decoded sound clips
+CAudioMixer	g_AudioMixer;	// Plays the clips, on its own thread
+
+//-----------------------------------------------------------------------------
+// Name : FindSwitch() (Static)
+// Desc : Finds a switch on the command line as a whole word, so that
+//		-nosound is not found inside -nosoundcache. Returns NULL when absent.
+//-----------------------------------------------------------------------------
+static LPCTSTR FindSwitch( LPCTSTR lpCmdLine, LPCTSTR lpSwitch )
+{
+	size_t nLength = _tcslen( lpSwitch );
+	for ( LPCTSTR lpFound = _tcsstr( lpCmdLine, lpSwitch ); lpFound; lpFound = _tcsstr( lpFound + 1, lpSwitch ) )
+	{
+		bool bStart = lpFound == lpCmdLine || lpFound[-1] == _T(' ');
+		bool bEnd = lpFound[nLength] == _T('\0') || lpFound[nLength] == _T(' ');
+		if ( bStart && bEnd ) return lpFound;
+	}
+	return NULL;
+}
 
 //-----------------------------------------------------------------------------
 // Name : WinMain() (Application Entry Point)
@@ -31,6 +60,71 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdLi
 
 	// initialize global instance
 	g_hInst = hInstance;
+	g_Startup.Start();
+
+	// Headless resize engine benchmark: -benchresize [report file]
+	LPCTSTR lpBench = FindSwitch( lpCmdLine, _T("-benchresize") );
+	if ( lpBench )
+	{
+		TCHAR szReport[MAX_PATH] = _T("resize_bench.txt");
+		lpBench += _tcslen( _T("-benchresize") );
+		while ( *lpBench == _T(' ') ) lpBench++;
+		if ( *lpBench ) _tcscpy_s( szReport, MAX_PATH, lpBench );
+
+		return RunResizeBenchmark( szReport ) ? 0 : 1;
+	}
+
+	// Headless stress test of the mixer's command queue: -testspscqueue [report file]
+	LPCTSTR lpTest = FindSwitch( lpCmdLine, _T("-testspscqueue") );
+	if ( lpTest )
+	{
+		TCHAR szReport[MAX_PATH] = _T("spsc_test.txt");
+		lpTest += _tcslen( _T("-testspscqueue") );
+		while ( *lpTest == _T(' ') ) lpTest++;
+		if ( *lpTest ) _tcscpy_s( szReport, MAX_PATH, lpTest );
+
+		return RunSpscQueueTest( szReport ) ? 0 : 1;
+	}
+
+	// Pack the data folder and exit, run by the post build step
+	if ( FindSwitch( lpCmdLine, _T("-buildpack") ) )
+	{
+		// -quantize also reduces bitmaps with more than 256 colours to 8 bpp
+		EPackIndexing eIndexing = FindSwitch( lpCmdLine, _T("-quantize") ) ? PACK_INDEX_QUANTIZE : PACK_INDEX_LOSSLESS;
+		return CAssetPack::Build( PACK_DEFAULT_DIR, PACK_DEFAULT_FILE, eIndexing ) ? 0 : 1;
+	}
+
+	// Without a pack every asset is loaded from the data folder
+	g_Startup.BeginPhase("OpenAssetPack");
+	g_AssetPack.Open( PACK_DEFAULT_FILE );
+	g_Startup.EndPhase();
+
+	g_Startup.BeginPhase("StartLoader");
+	g_AssetLoader.Start();
+	g_Startup.EndPhase();
+
+	// Sound output: -nosound mixes into nothing, -soundfile <file> records the
+	// mix to a WAV file. Without a working device sounds go to PlaySound.
+	// Clips for the mixer are converted to its rate as they load and kept
+	// converted on disk, -nosoundcache converts them on every run.
+	g_Startup.BeginPhase("StartMixer");
+	IAudioSink *pSink;
+	LPCTSTR lpSoundFile = FindSwitch( lpCmdLine, _T("-soundfile") );
+	if ( lpSoundFile )
+	{
+		TCHAR szSoundFile[MAX_PATH] = _T("sound.wav");
+		lpSoundFile += _tcslen( _T("-soundfile") );
+		while ( *lpSoundFile == _T(' ') ) lpSoundFile++;
+		if ( *lpSoundFile ) _tcscpy_s( szSoundFile, MAX_PATH, lpSoundFile );
+		pSink = new CWavFileSink( szSoundFile );
+	}
+	else if ( FindSwitch( lpCmdLine, _T("-nosound") ) )
+		pSink = new CNullSink();
+	else
+		pSink = new CWaveOutSink();
+	if ( g_AudioMixer.Start( pSink ) )
+		g_SoundCache.SetConversion( MIXER_RATE, FindSwitch( lpCmdLine, _T("-nosoundcache") ) ? NULL : SOUND_CACHE_DIR );
+	g_Startup.EndPhase();
 
 	// Initialise the engine.
 	if (!g_App.InitInstance( lpCmdLine, iCmdShow )) return 1;
@@ -41,6 +135,11 @@ int WINAPI WinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPTSTR lpCmdLi
 	// Shut down the engine, just to be polite, before exiting.
 	if ( !g_App.ShutDown() )  MessageBox( 0, _T("Failed to shut system down correctly, please check file named 'debug.txt'.\r\n\r\nIf the problem persists, please contact technical support."), _T("Non-Fatal Error"), MB_OK | MB_ICONEXCLAMATION );
 
+	// Stop the loader threads once nothing can request assets any more
+	g_AssetLoader.Shutdown();
+	g_AudioMixer.Shutdown();
+	g_SoundCache.Clear();
+
 	// Return the correct exit code.
 	return retCode;
 }
\ No newline at end of file
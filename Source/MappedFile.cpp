@@ -0,0 +1,92 @@
+// MappedFile.cpp
+// Read only view of a whole file mapped into memory.
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+CMappedFile::CMappedFile()
+{
+	m_pData = NULL;
+	m_uSize = 0;
+}
+
+CMappedFile::~CMappedFile()
+{
+	Close();
+}
+
+bool CMappedFile::Open(const char *szFileName)
+{
+	Close();
+
+	// The file and mapping handles are closed right away, the view keeps
+	// the mapping alive until it is unmapped.
+#ifdef _WIN32
+	HANDLE hFile = CreateFile(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if(hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER liSize;
+	if(!GetFileSizeEx(hFile, &liSize) || liSize.QuadPart == 0 || (ULONGLONG)liSize.QuadPart > (size_t)-1)
+	{
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(hFile);
+	if(!hMapping)
+		return false;
+
+	m_pData = (const uint8_t*)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(hMapping);
+	if(!m_pData)
+		return false;
+
+	m_uSize = (size_t)liSize.QuadPart;
+#else
+	int fd = open(szFileName, O_RDONLY);
+	if(fd < 0)
+		return false;
+
+	struct stat st;
+	if(fstat(fd, &st) || st.st_size <= 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void *pView = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(pView == MAP_FAILED)
+		return false;
+
+	m_pData = (const uint8_t*)pView;
+	m_uSize = (size_t)st.st_size;
+#endif
+
+	return true;
+}
+
+void CMappedFile::Close()
+{
+	if(!m_pData)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pData);
+#else
+	munmap((void*)m_pData, m_uSize);
+#endif
+
+	m_pData = NULL;
+	m_uSize = 0;
+}
@@ -0,0 +1,361 @@
+// PerfOverlay.cpp
+// Performance panel drawn into the back buffer
+#include "PerfOverlay.h"
+#include "AllocCounter.h"
+
+#define PERF_MARGIN			4		// pixels around the text and the graph
+#define PERF_TEXT_LINES		(PERF_INFO_LINES + 2 + (PERF_STAGES + 1) / 2 + (PERF_COUNTERS + 1) / 2)
+
+#define PERF_COLOR_BACK		0x00181818
+#define PERF_COLOR_TEXT		0x00E0E0E0
+#define PERF_COLOR_GOOD		0x0040C040
+#define PERF_COLOR_LATE		0x00E0C020		// over the budget
+#define PERF_COLOR_MISSED	0x00E04020		// over one and a half budgets
+#define PERF_COLOR_BUDGET	0x00808080
+
+static const char *s_szStage[PERF_STAGES] =
+{
+	"Wait", "Input", "World", "Animate", "Save/reload", "Background", "Sprites", "Overlay", "Present"
+};
+
+static const char *s_szCounter[PERF_COUNTERS] =
+{
+	"Enemies", "Bullets", "Enemy bullets", "Crates", "Hearts", "Pairs tested", "Allocations"
+};
+
+CPerfOverlay::CPerfOverlay()
+{
+	LARGE_INTEGER Frequency;
+	QueryPerformanceFrequency(&Frequency);
+	m_iFrequency = Frequency.QuadPart;
+
+	m_bVisible = false;
+	m_iLastLap = 0;
+	m_iFrameStart = 0;
+	m_iRefreshTime = 0;
+	m_fBudget = 0.0f;
+	m_lAllocations = GetAllocationCount();
+	m_fFrame = 0.0f;
+	ZeroMemory(m_fStage, sizeof(m_fStage));
+	ZeroMemory(m_fCount, sizeof(m_fCount));
+	ZeroMemory(m_szInfo, sizeof(m_szInfo));
+	m_bTextDirty = true;
+	m_uGraphNext = 0;
+	m_iCharWidth = 0;
+	m_iCharHeight = 0;
+	m_hPanelDC = NULL;
+	m_hPanel = 0;
+	m_hOldPanel = NULL;
+	m_pPanel = NULL;
+	m_iPanelWidth = 0;
+	m_iPanelHeight = 0;
+	m_iTextHeight = 0;
+	ResetSums();
+}
+
+CPerfOverlay::~CPerfOverlay()
+{
+	SetVisible(false);
+	ReleasePanel();
+}
+
+void CPerfOverlay::SetVisible(bool bVisible)
+{
+	if(bVisible == m_bVisible)
+		return;
+
+	// the figures shown first are from frames it was shown for
+	ResetSums();
+	m_iRefreshTime = Now();
+	m_bVisible = bVisible;
+}
+
+__int64 CPerfOverlay::Now() const
+{
+	LARGE_INTEGER Counter;
+	QueryPerformanceCounter(&Counter);
+	return Counter.QuadPart;
+}
+
+void CPerfOverlay::ResetSums()
+{
+	ZeroMemory(m_iStage, sizeof(m_iStage));
+	ZeroMemory(m_nCount, sizeof(m_nCount));
+	m_nFrames = 0;
+}
+
+bool CPerfOverlay::FrameStart(float fBudgetMs)
+{
+	__int64 iNow = Now();
+	m_fBudget = fBudgetMs;
+
+	if(m_iFrameStart)
+	{
+		m_iStage[PERF_WAIT] += iNow - m_iLastLap;
+		m_nFrames++;
+
+		if(!m_Graph.empty())
+		{
+			m_Graph[m_uGraphNext] = (float)(iNow - m_iFrameStart) * 1000.0f / m_iFrequency;
+			m_uGraphNext = (m_uGraphNext + 1) % m_Graph.size();
+		}
+	}
+	m_iFrameStart = iNow;
+	m_iLastLap = iNow;
+
+	// every thread's, the mixer and the loaders included
+	LONG lAllocations = GetAllocationCount();
+	m_nCount[PERF_ALLOCATIONS] += (ULONG)(lAllocations - m_lAllocations);
+	m_lAllocations = lAllocations;
+
+	if(iNow - m_iRefreshTime < m_iFrequency * PERF_REFRESH_MS / 1000 || !m_nFrames)
+		return false;
+
+	// averages per frame since the last refresh
+	m_fFrame = 0.0f;
+	for(int i = 0; i < PERF_STAGES; i++)
+	{
+		m_fStage[i] = (float)m_iStage[i] * 1000.0f / m_iFrequency / m_nFrames;
+		m_fFrame += m_fStage[i];
+	}
+	for(int i = 0; i < PERF_COUNTERS; i++)
+		m_fCount[i] = (float)m_nCount[i] / m_nFrames;
+
+	ResetSums();
+	m_iRefreshTime = iNow;
+	m_bTextDirty = true;
+
+	return m_bVisible;
+}
+
+void CPerfOverlay::Lap(EPerfStage stage)
+{
+	__int64 iNow = Now();
+	m_iStage[stage] += iNow - m_iLastLap;
+	m_iLastLap = iNow;
+}
+
+void CPerfOverlay::Resume()
+{
+	// the next frame start opens a frame without closing one
+	m_iFrameStart = 0;
+	ResetSums();
+	m_iRefreshTime = Now();
+}
+
+void CPerfOverlay::SetInfo(int iLine, const char *szText)
+{
+	if(iLine < 0 || iLine >= PERF_INFO_LINES)
+		return;
+
+	strncpy_s(m_szInfo[iLine], PERF_LINE_CHARS + 1, szText ? szText : "", _TRUNCATE);
+}
+
+bool CPerfOverlay::CreatePanel()
+{
+	HDC hdc = CreateCompatibleDC(NULL);
+	if(!hdc)
+		return false;
+
+	// the glyphs are rendered once, white on black, and kept as a mask
+	TEXTMETRIC tm;
+	HGDIOBJ hOldFont = SelectObject(hdc, GetStockObject(ANSI_FIXED_FONT));
+	GetTextMetrics(hdc, &tm);
+	m_iCharWidth = tm.tmAveCharWidth;
+	m_iCharHeight = tm.tmHeight;
+
+	BITMAPINFO bmi;
+	ZeroMemory(&bmi, sizeof(bmi));
+	bmi.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+	bmi.bmiHeader.biWidth = m_iCharWidth * PERF_GLYPHS;
+	bmi.bmiHeader.biHeight = -m_iCharHeight;
+	bmi.bmiHeader.biPlanes = 1;
+	bmi.bmiHeader.biBitCount = 32;
+	bmi.bmiHeader.biCompression = BI_RGB;
+
+	DWORD *pBits = NULL;
+	HBITMAP hGlyphs = m_iCharWidth > 0 && m_iCharHeight > 0 ?
+		CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void**)&pBits, NULL, 0) : 0;
+	if(hGlyphs)
+	{
+		char szGlyphs[PERF_GLYPHS];
+		for(int i = 0; i < PERF_GLYPHS; i++)
+			szGlyphs[i] = (char)(' ' + i);
+
+		HGDIOBJ hOldBitmap = SelectObject(hdc, hGlyphs);
+		SetTextColor(hdc, RGB(255, 255, 255));
+		SetBkColor(hdc, RGB(0, 0, 0));
+		SetBkMode(hdc, OPAQUE);
+		TextOut(hdc, 0, 0, szGlyphs, PERF_GLYPHS);
+		GdiFlush();
+
+		m_Glyphs.resize(m_iCharWidth * PERF_GLYPHS * m_iCharHeight);
+		for(size_t i = 0; i < m_Glyphs.size(); i++)
+			m_Glyphs[i] = (pBits[i] & 0xFF) >= 0x80;
+
+		SelectObject(hdc, hOldBitmap);
+		DeleteObject(hGlyphs);
+	}
+	SelectObject(hdc, hOldFont);
+
+	if(!hGlyphs)
+	{
+		DeleteDC(hdc);
+		return false;
+	}
+
+	m_iPanelWidth = PERF_LINE_CHARS * m_iCharWidth + 2 * PERF_MARGIN;
+	m_iTextHeight = PERF_TEXT_LINES * m_iCharHeight + PERF_MARGIN;
+	m_iPanelHeight = m_iTextHeight + PERF_GRAPH_HEIGHT + 2 * PERF_MARGIN;
+
+	bmi.bmiHeader.biWidth = m_iPanelWidth;
+	bmi.bmiHeader.biHeight = -m_iPanelHeight;
+	m_hPanel = CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, (void**)&m_pPanel, NULL, 0);
+	if(!m_hPanel)
+	{
+		DeleteDC(hdc);
+		return false;
+	}
+
+	m_hPanelDC = hdc;
+	m_hOldPanel = SelectObject(m_hPanelDC, m_hPanel);
+
+	for(int i = 0; i < m_iPanelWidth * m_iPanelHeight; i++)
+		m_pPanel[i] = PERF_COLOR_BACK;
+
+	m_Graph.assign(m_iPanelWidth - 2 * PERF_MARGIN, 0.0f);
+	m_uGraphNext = 0;
+	m_bTextDirty = true;
+
+	return true;
+}
+
+void CPerfOverlay::ReleasePanel()
+{
+	if(m_hPanelDC)
+	{
+		SelectObject(m_hPanelDC, m_hOldPanel);
+		DeleteDC(m_hPanelDC);
+		m_hPanelDC = NULL;
+	}
+
+	if(m_hPanel)
+	{
+		DeleteObject(m_hPanel);
+		m_hPanel = 0;
+		m_pPanel = NULL;
+	}
+}
+
+void CPerfOverlay::PaintText()
+{
+	char szLines[PERF_TEXT_LINES][PERF_LINE_CHARS + 1];
+	int iLines = 0;
+
+	for(int i = 0; i < PERF_INFO_LINES; i++)
+		if(m_szInfo[i][0])
+			strcpy_s(szLines[iLines++], PERF_LINE_CHARS + 1, m_szInfo[i]);
+
+	// two stages, then two counters to a line
+	sprintf_s(szLines[iLines++], PERF_LINE_CHARS + 1, "Stages, ms per frame (%.2f)", m_fFrame);
+	for(int i = 0; i < PERF_STAGES; i += 2)
+	{
+		if(i + 1 < PERF_STAGES)
+			sprintf_s(szLines[iLines++], PERF_LINE_CHARS + 1, "%-12s%7.2f    %-12s%7.2f",
+				s_szStage[i], m_fStage[i], s_szStage[i + 1], m_fStage[i + 1]);
+		else
+			sprintf_s(szLines[iLines++], PERF_LINE_CHARS + 1, "%-12s%7.2f", s_szStage[i], m_fStage[i]);
+	}
+
+	strcpy_s(szLines[iLines++], PERF_LINE_CHARS + 1, "Per frame");
+	for(int i = 0; i < PERF_COUNTERS; i += 2)
+	{
+		char szValue[2][16];
+		for(int j = 0; j < 2 && i + j < PERF_COUNTERS; j++)
+			sprintf_s(szValue[j], 16, "%.1f", m_fCount[i + j]);
+
+		if(i + 1 < PERF_COUNTERS)
+			sprintf_s(szLines[iLines++], PERF_LINE_CHARS + 1, "%-14s%5s    %-14s%5s",
+				s_szCounter[i], szValue[0], s_szCounter[i + 1], szValue[1]);
+		else
+			sprintf_s(szLines[iLines++], PERF_LINE_CHARS + 1, "%-14s%5s", s_szCounter[i], szValue[0]);
+	}
+
+	for(int y = 0; y < m_iTextHeight; y++)
+		for(int x = 0; x < m_iPanelWidth; x++)
+			m_pPanel[y * m_iPanelWidth + x] = PERF_COLOR_BACK;
+
+	int iAtlasWidth = m_iCharWidth * PERF_GLYPHS;
+
+	for(int l = 0; l < iLines; l++)
+	{
+		DWORD *pLine = m_pPanel + (PERF_MARGIN + l * m_iCharHeight) * m_iPanelWidth + PERF_MARGIN;
+
+		for(int c = 0; c < PERF_LINE_CHARS && szLines[l][c]; c++)
+		{
+			int iGlyph = (BYTE)szLines[l][c] - ' ';
+			if(iGlyph <= 0 || iGlyph >= PERF_GLYPHS)
+				continue;
+
+			const BYTE *pGlyph = &m_Glyphs[iGlyph * m_iCharWidth];
+			DWORD *pCell = pLine + c * m_iCharWidth;
+
+			for(int y = 0; y < m_iCharHeight; y++)
+				for(int x = 0; x < m_iCharWidth; x++)
+					if(pGlyph[y * iAtlasWidth + x])
+						pCell[y * m_iPanelWidth + x] = PERF_COLOR_TEXT;
+		}
+	}
+
+	m_bTextDirty = false;
+}
+
+void CPerfOverlay::PaintGraph()
+{
+	// the newest frame on the right, the budget half way up
+	int iColumns = (int)m_Graph.size();
+	int iBudgetRow = PERF_GRAPH_HEIGHT / 2;
+	float fScale = m_fBudget > 0.0f ? PERF_GRAPH_HEIGHT / (2.0f * m_fBudget) : 0.0f;
+	DWORD *pTop = m_pPanel + (m_iTextHeight + PERF_MARGIN) * m_iPanelWidth + PERF_MARGIN;
+
+	for(int x = 0; x < iColumns; x++)
+	{
+		float fTime = m_Graph[(m_uGraphNext + x) % iColumns];
+		int iBar = (int)(fTime * fScale + 0.5f);
+		if(iBar > PERF_GRAPH_HEIGHT)
+			iBar = PERF_GRAPH_HEIGHT;
+
+		DWORD uColor = fTime <= m_fBudget ? PERF_COLOR_GOOD : (fTime <= m_fBudget * 1.5f ? PERF_COLOR_LATE : PERF_COLOR_MISSED);
+
+		for(int y = 0; y < PERF_GRAPH_HEIGHT; y++)
+		{
+			int iHeight = PERF_GRAPH_HEIGHT - y;
+			DWORD *pPixel = pTop + y * m_iPanelWidth + x;
+
+			if(iHeight <= iBar)
+				*pPixel = uColor;
+			else if(iHeight == iBudgetRow && (x & 2))
+				*pPixel = PERF_COLOR_BUDGET;
+			else
+				*pPixel = PERF_COLOR_BACK;
+		}
+	}
+}
+
+void CPerfOverlay::Draw(HDC hdc, int x, int y)
+{
+	if(!m_bVisible)
+		return;
+
+	if(!m_hPanel && !CreatePanel())
+		return;
+
+	// GDI may not have finished with the panel from the last frame
+	GdiFlush();
+
+	if(m_bTextDirty)
+		PaintText();
+	PaintGraph();
+
+	BitBlt(hdc, x, y, m_iPanelWidth, m_iPanelHeight, m_hPanelDC, 0, 0, SRCCOPY);
+}
@@ -0,0 +1,80 @@
+// QualityGovernor.cpp
+// Frame budget driven quality levels
+#include "QualityGovernor.h"
+
+static const sQualitySettings s_Levels[QUALITY_LEVELS] =
+{
+	{ 1, 1, 64 },
+	{ 2, 1, 32 },
+	{ 2, 2, 16 },
+	{ 4, 2, 8 }
+};
+
+CQualityGovernor::CQualityGovernor()
+{
+	m_bEnabled = true;
+	m_iLevel = 0;
+	m_nFrames = 0;
+	m_iCalm = 0;
+	m_fWork = 0.0f;
+}
+
+bool CQualityGovernor::Update(const sFrameStats &frame, const sLimiterStats &limiter, float fBudgetMs)
+{
+	if(!m_bEnabled || fBudgetMs <= 0.0f)
+		return false;
+
+	// wait until a full window holds no frames from before the last
+	// decision, a part filled one is too few frames to go by
+	if(++m_nFrames < QUALITY_WINDOW || frame.nFrames < QUALITY_WINDOW)
+		return false;
+	m_nFrames = 0;
+
+	// a capped frame is mostly the limiter waiting, only the rest is work
+	m_fWork = frame.fP95 - (limiter.fSleep + limiter.fSpin);
+	if(m_fWork < 0.0f)
+		m_fWork = 0.0f;
+
+	int iLevel = m_iLevel;
+
+	if(m_fWork > fBudgetMs)
+	{
+		m_iCalm = 0;
+		if(iLevel < QUALITY_LEVELS - 1)
+			iLevel++;
+	}
+	else if(m_fWork < fBudgetMs * QUALITY_HEADROOM)
+	{
+		if(++m_iCalm >= QUALITY_CALM_WINDOWS && iLevel > 0)
+		{
+			m_iCalm = 0;
+			iLevel--;
+		}
+	}
+	else
+		m_iCalm = 0;
+
+	if(iLevel == m_iLevel)
+		return false;
+
+	m_iLevel = iLevel;
+	return true;
+}
+
+void CQualityGovernor::Restart()
+{
+	m_nFrames = 0;
+	m_iCalm = 0;
+}
+
+void CQualityGovernor::SetEnabled(bool bEnabled)
+{
+	m_bEnabled = bEnabled;
+	m_iLevel = 0;
+	Restart();
+}
+
+const sQualitySettings &CQualityGovernor::GetSettings() const
+{
+	return s_Levels[m_iLevel];
+}
@@ -0,0 +1,156 @@
+// Resampler.cpp
+// Polyphase sample rate conversion of sound clips
+#include "Resampler.h"
+#include <emmintrin.h>
+
+CResampler::CResampler()
+{
+	m_uInRate = 0;
+	m_uOutRate = 0;
+	m_iStep = 0;
+}
+
+bool CResampler::Init(UINT uInRate, UINT uOutRate)
+{
+	if(!uInRate || !uOutRate)
+		return false;
+
+	m_uInRate = uInRate;
+	m_uOutRate = uOutRate;
+	m_iStep = ((__int64)uInRate << 32) / uOutRate;
+
+	double dCutoff = RESAMPLE_CUTOFF * (uOutRate < uInRate ? (double)uOutRate / uInRate : 1.0);
+	m_Taps.resize((RESAMPLE_PHASES + 1) * RESAMPLE_TAPS);
+
+	// Row p is the filter for an output RESAMPLE_PHASES-th p of the way
+	// between two input samples, tap k weighs input sample k - TAPS / 2 + 1
+	// counted from the first of them. Blackman windowed sinc, each row sums
+	// to one so the level does not depend on the phase.
+	for(int p = 0; p <= RESAMPLE_PHASES; p++)
+	{
+		float *pRow = &m_Taps[p * RESAMPLE_TAPS];
+		double dSum = 0;
+
+		for(int k = 0; k < RESAMPLE_TAPS; k++)
+		{
+			double d = k - RESAMPLE_TAPS / 2 + 1 - (double)p / RESAMPLE_PHASES;
+			double x = PI * dCutoff * d;
+			double dSinc = fabs(x) < 1e-9 ? 1.0 : sin(x) / x;
+			double w = 2.0 * PI * d / RESAMPLE_TAPS;
+			double dWindow = 0.42 + 0.5 * cos(w) + 0.08 * cos(2.0 * w);
+
+			pRow[k] = (float)(dSinc * dWindow);
+			dSum += pRow[k];
+		}
+
+		for(int k = 0; k < RESAMPLE_TAPS; k++)
+			pRow[k] = (float)(pRow[k] / dSum);
+	}
+
+	return true;
+}
+
+UINT CResampler::OutputFrames(UINT uInFrames) const
+{
+	if(!m_uInRate)
+		return 0;
+
+	return (UINT)(((__int64)uInFrames * m_uOutRate + m_uInRate - 1) / m_uInRate);
+}
+
+void CResampler::Process(const float *pIn, UINT uInFrames, float *pOut, UINT uOutStride)
+{
+	// the filter reaches TAPS / 2 - 1 samples back and TAPS / 2 ahead
+	m_Padded.assign(uInFrames + RESAMPLE_TAPS, 0.0f);
+	if(uInFrames)
+		memcpy(&m_Padded[RESAMPLE_TAPS / 2 - 1], pIn, uInFrames * sizeof(float));
+
+	UINT uOutFrames = OutputFrames(uInFrames);
+	__int64 iPos = 0;
+
+	for(UINT n = 0; n < uOutFrames; n++, iPos += m_iStep)
+	{
+		const float *pSrc = &m_Padded[(UINT)(iPos >> 32)];
+
+		// the phase and how far it is towards the next one
+		UINT uFrac = (UINT)iPos;
+		UINT uPhase = uFrac >> (32 - RESAMPLE_PHASE_BITS);
+		UINT uBetween = uFrac & ((1 << (32 - RESAMPLE_PHASE_BITS)) - 1);
+		__m128 frac = _mm_set1_ps(uBetween * (1.0f / (1 << (32 - RESAMPLE_PHASE_BITS))));
+		const float *pLo = &m_Taps[uPhase * RESAMPLE_TAPS];
+		const float *pHi = pLo + RESAMPLE_TAPS;
+
+		__m128 acc = _mm_setzero_ps();
+		for(int k = 0; k < RESAMPLE_TAPS; k += 4)
+		{
+			__m128 lo = _mm_loadu_ps(pLo + k);
+			__m128 c = _mm_add_ps(lo, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(pHi + k), lo), frac));
+			acc = _mm_add_ps(acc, _mm_mul_ps(c, _mm_loadu_ps(pSrc + k)));
+		}
+
+		// horizontal sum of the four lanes
+		acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+		acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+		pOut[n * uOutStride] = _mm_cvtss_f32(acc);
+	}
+}
+
+void ShortToFloat(const short *pIn, float *pOut, UINT uSamples)
+{
+	UINT i = 0;
+
+	for(; i + 8 <= uSamples; i += 8)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*)(pIn + i));
+		// sign extend by moving each sample to the top half and shifting back
+		_mm_storeu_ps(pOut + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)));
+		_mm_storeu_ps(pOut + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)));
+	}
+
+	for(; i < uSamples; i++)
+		pOut[i] = pIn[i];
+}
+
+void ByteToFloat(const BYTE *pIn, float *pOut, UINT uSamples)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bias = _mm_set1_epi16(128);
+	const __m128 scale = _mm_set1_ps(256.0f);
+	UINT i = 0;
+
+	for(; i + 16 <= uSamples; i += 16)
+	{
+		__m128i b = _mm_loadu_si128((const __m128i*)(pIn + i));
+		__m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(b, zero), bias);
+		__m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(b, zero), bias);
+
+		_mm_storeu_ps(pOut + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16)), scale));
+		_mm_storeu_ps(pOut + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16)), scale));
+		_mm_storeu_ps(pOut + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16)), scale));
+		_mm_storeu_ps(pOut + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16)), scale));
+	}
+
+	for(; i < uSamples; i++)
+		pOut[i] = ((int)pIn[i] - 128) * 256.0f;
+}
+
+void FloatToShort(const float *pIn, short *pOut, UINT uSamples)
+{
+	// clamped first, out of range values would otherwise convert to 0x80000000
+	const __m128 lo = _mm_set1_ps(-32768.0f);
+	const __m128 hi = _mm_set1_ps(32767.0f);
+	UINT i = 0;
+
+	for(; i + 8 <= uSamples; i += 8)
+	{
+		__m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i), lo), hi));
+		__m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(pIn + i + 4), lo), hi));
+		_mm_storeu_si128((__m128i*)(pOut + i), _mm_packs_epi32(a, b));
+	}
+
+	for(; i < uSamples; i++)
+	{
+		float f = pIn[i] < -32768.0f ? -32768.0f : (pIn[i] > 32767.0f ? 32767.0f : pIn[i]);
+		pOut[i] = (short)(f < 0 ? f - 0.5f : f + 0.5f);
+	}
+}
@@ -0,0 +1,13 @@
+// ResizeBenchMain.cpp
+// Entry point of the resize benchmark as a console program, for the headless
+// builds off Windows (see CMakeLists.txt). The game runs the same suite with
+// the -benchresize switch.
+#include "ResizeBenchmark.h"
+
+// resize_bench [report file]
+int main(int argc, char *argv[])
+{
+	const char *szReport = argc > 1 ? argv[1] : "resize_bench.txt";
+
+	return RunResizeBenchmark(szReport) ? 0 : 1;
+}
@@ -0,0 +1,216 @@
+// ResizeBenchmark.cpp
+// Timing suite for CResizableImage::Resample and the CConvolution filters
+#include "ResizeBenchmark.h"
+#include "Convolution.h"
+
+typedef struct
+{
+	const char *szName;
+	unsigned int uSrcWidth, uSrcHeight;
+	unsigned int uDstWidth, uDstHeight;
+} sBenchCase;
+
+static const sBenchCase g_BenchCases[] =
+{
+	{ "sprite up",			  64,   64,  128,  128 },
+	{ "sprite down",		  64,   64,   32,   32 },
+	{ "sprite aspect",		  64,   64,   96,   48 },
+	{ "sprite identity",	  64,   64,   64,   64 },
+	{ "screen up",			 800,  600, 1600, 1200 },
+	{ "screen down",		 800,  600,  400,  300 },
+	{ "screen down 3x",		 800,  600,  266,  200 },
+	{ "screen aspect",		 800,  600, 1024,  400 },
+	{ "screen identity",	 800,  600,  800,  600 },
+	{ "1080p to 4K",		1920, 1080, 3840, 2160 },
+	{ "4K to 8K",			3840, 2160, 7680, 4320 },
+	{ "8K to 1080p",		7680, 4320, 1920, 1080 },
+	{ "8K aspect",			7680, 4320, 4320, 4320 },
+	{ "8K identity",		7680, 4320, 7680, 4320 },
+};
+
+// the convolution filters are timed at the sizes they are used on
+typedef struct
+{
+	const char *szName;
+	unsigned int uWidth, uHeight;
+} sConvCase;
+
+static const sConvCase g_ConvCases[] =
+{
+	{ "sprite",		  64,   64 },
+	{ "screen",		 800,  600 },
+	{ "1080p",		1920, 1080 },
+	{ "4K",			3840, 2160 },
+};
+
+static const char *g_szConvFilters[] = { "gauss 1", "gauss 3", "box 2", "box 8", "sharpen", "sobel" };
+
+// minimum measuring time and iteration bounds of each case
+#define BENCH_MIN_SECONDS	0.5
+#define BENCH_MIN_RUNS		1
+#define BENCH_MAX_RUNS		20
+
+// Fill the image with a gradient plus noise so every filter tap does real work
+static void FillTestImage(CImageFile &img, unsigned int uSeed)
+{
+	RGBQUAD *p = img.Pixels();
+	LONG w = img.Width();
+	LONG h = img.Height();
+
+	for(LONG y = 0; y < h; y++)
+	{
+		for(LONG x = 0; x < w; x++, p++)
+		{
+			uSeed = uSeed * 1664525 + 1013904223;
+			p->rgbRed = (BYTE)(x * 255 / w);
+			p->rgbGreen = (BYTE)(y * 255 / h);
+			p->rgbBlue = (BYTE)(uSeed >> 24);
+			p->rgbReserved = 0;
+		}
+	}
+}
+
+// Run the iFilter-th entry of g_szConvFilters in place on img
+static void RunConvFilter(CConvolution &conv, CImageFile &img, int iFilter)
+{
+	switch(iFilter)
+	{
+	case 0:
+		conv.GaussianBlur(img, 1.0f);
+		break;
+	case 1:
+		conv.GaussianBlur(img, 3.0f);
+		break;
+	case 2:
+		conv.BoxBlur(img, 2);
+		break;
+	case 3:
+		conv.BoxBlur(img, 8);
+		break;
+	case 4:
+		conv.Sharpen(img, 1.0f);
+		break;
+	default:
+		conv.Sobel(img);
+		break;
+	}
+}
+
+bool RunResizeBenchmark(const char *szReportFile)
+{
+	FILE *fout = NULL;
+	if(fopen_s(&fout, szReportFile, "w") || !fout)
+		return false;
+
+	CBoxFilter box;
+	CBilinearFilter bilinear;
+	CBicubicFilter bicubic;
+	CLanczos3Filter lanczos;
+	CBSplineFilter bspline;
+
+	CGenericFilter *pFilters[] = { &box, &bilinear, &bicubic, &lanczos, &bspline };
+	const char *szFilters[] = { "box", "bilinear", "bicubic", "lanczos3", "bspline" };
+
+	__int64 freq;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+
+	fprintf(fout, "%-10s %-16s %11s %11s %6s %10s %10s %10s\n",
+		"filter", "case", "source", "result", "runs", "best ms", "MP/s", "peak MB");
+
+	for(int f = 0; f < sizeof(pFilters) / sizeof(pFilters[0]); f++)
+	{
+		for(int c = 0; c < sizeof(g_BenchCases) / sizeof(g_BenchCases[0]); c++)
+		{
+			const sBenchCase &bc = g_BenchCases[c];
+			CResizableImage img;
+			double dBest = 0, dTotal = 0;
+			size_t uPeak = 0;
+			int iRuns = 0;
+
+			img.SetFilter(pFilters[f]);
+
+			while(iRuns < BENCH_MAX_RUNS && (iRuns < BENCH_MIN_RUNS || dTotal < BENCH_MIN_SECONDS))
+			{
+				// Resample works in place, start every run from a fresh source
+				if(!img.Create(bc.uSrcWidth, bc.uSrcHeight))
+				{
+					fclose(fout);
+					return false;
+				}
+				FillTestImage(img, c);
+
+				__int64 t0, t1;
+				QueryPerformanceCounter((LARGE_INTEGER*)&t0);
+				img.Resample(bc.uDstWidth, bc.uDstHeight);
+				QueryPerformanceCounter((LARGE_INTEGER*)&t1);
+
+				double dTime = double(t1 - t0) / freq;
+				dBest = iRuns ? min(dBest, dTime) : dTime;
+				dTotal += dTime;
+				uPeak = max(uPeak, img.GetPeakBytes());
+				iRuns++;
+			}
+
+			// throughput is measured in result megapixels
+			double dMPixels = double(bc.uDstWidth) * bc.uDstHeight / 1e6;
+			char szSrc[32], szDst[32];
+			sprintf_s(szSrc, "%ux%u", bc.uSrcWidth, bc.uSrcHeight);
+			sprintf_s(szDst, "%ux%u", bc.uDstWidth, bc.uDstHeight);
+
+			fprintf(fout, "%-10s %-16s %11s %11s %6d %10.3f %10.2f %10.2f\n",
+				szFilters[f], bc.szName, szSrc, szDst, iRuns, dBest * 1000.0,
+				dBest > 0 ? dMPixels / dBest : 0.0, uPeak / (1024.0 * 1024.0));
+			fflush(fout);
+		}
+	}
+
+	// the engine keeps its threads and band buffers between runs, as it does in a frame loop
+	CConvolution conv;
+
+	fprintf(fout, "\n%-10s %-16s %11s %6s %10s %10s\n",
+		"filter", "case", "image", "runs", "best ms", "MP/s");
+
+	for(int f = 0; f < sizeof(g_szConvFilters) / sizeof(g_szConvFilters[0]); f++)
+	{
+		for(int c = 0; c < sizeof(g_ConvCases) / sizeof(g_ConvCases[0]); c++)
+		{
+			const sConvCase &cc = g_ConvCases[c];
+			CImageFile img;
+			double dBest = 0, dTotal = 0;
+			int iRuns = 0;
+
+			if(!img.Create(cc.uWidth, cc.uHeight))
+			{
+				fclose(fout);
+				return false;
+			}
+			FillTestImage(img, c);
+
+			// the filters work in place, every run starts from the previous result
+			while(iRuns < BENCH_MAX_RUNS && (iRuns < BENCH_MIN_RUNS || dTotal < BENCH_MIN_SECONDS))
+			{
+				__int64 t0, t1;
+				QueryPerformanceCounter((LARGE_INTEGER*)&t0);
+				RunConvFilter(conv, img, f);
+				QueryPerformanceCounter((LARGE_INTEGER*)&t1);
+
+				double dTime = double(t1 - t0) / freq;
+				dBest = iRuns ? min(dBest, dTime) : dTime;
+				dTotal += dTime;
+				iRuns++;
+			}
+
+			double dMPixels = double(cc.uWidth) * cc.uHeight / 1e6;
+			char szSize[32];
+			sprintf_s(szSize, "%ux%u", cc.uWidth, cc.uHeight);
+
+			fprintf(fout, "%-10s %-16s %11s %6d %10.3f %10.2f\n",
+				g_szConvFilters[f], cc.szName, szSize, iRuns, dBest * 1000.0,
+				dBest > 0 ? dMPixels / dBest : 0.0);
+			fflush(fout);
+		}
+	}
+
+	fclose(fout);
+	return true;
+}
@@ -1,4 +1,7 @@
 #include "ResizeEngine.h"
+#include "MappedFile.h"
+#include "BmpDecoder.h"
+#include <emmintrin.h>
 
 CWeightsTable::CWeightsTable(CGenericFilter *pFilter, DWORD uDstSize, DWORD uSrcSize) 
 {
@@ -132,6 +135,7 @@ void CResizableImage::HorizontalFilter(unsigned int dst_width, unsigned int dst_
 	}
 	
 	m_pWeights = new CWeightsTable(m_pFilter, dst_width, width);
+	TrackAlloc(m_pWeights->getMemorySize());
 
 	for (UINT u = 0; u < dst_height; u++)
 	{
@@ -139,6 +143,7 @@ void CResizableImage::HorizontalFilter(unsigned int dst_width, unsigned int dst_
 		ScaleRow (dst_width, dst_width, u);	// Scale each row 
 	}
 
+	TrackFree(m_pWeights->getMemorySize());
 	delete m_pWeights;
 }
 
@@ -180,6 +185,7 @@ void CResizableImage::VerticalFilter(unsigned int dst_width, unsigned int dst_he
 	}
 	
 	m_pWeights = new CWeightsTable(m_pFilter, dst_height, height);
+	TrackAlloc(m_pWeights->getMemorySize());
 
 	for (UINT u = 0; u < dst_width; u++)
 	{
@@ -187,43 +193,302 @@ void CResizableImage::VerticalFilter(unsigned int dst_width, unsigned int dst_he
 		ScaleCol(dst_width, dst_height, u);   // Scale each column
 	}
 
+	TrackFree(m_pWeights->getMemorySize());
 	delete m_pWeights;
 }
 
+// Average 2x2 blocks of two source rows into one destination row
+static void HalveRows(const RGBQUAD *pRow0, const RGBQUAD *pRow1, unsigned int src_width, RGBQUAD *pDst, unsigned int dst_width)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(2);
+	UINT x = 0;
+
+	// 8 source pixels from each row give 4 destination pixels per step
+	for (; x + 4 <= dst_width; x += 4)
+	{
+		__m128i a0 = _mm_loadu_si128((const __m128i*)(pRow0 + 2 * x));
+		__m128i a1 = _mm_loadu_si128((const __m128i*)(pRow0 + 2 * x + 4));
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x));
+		__m128i b1 = _mm_loadu_si128((const __m128i*)(pRow1 + 2 * x + 4));
+
+		// vertical sums with 16 bits per channel, two pixels per register
+		__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero), _mm_unpacklo_epi8(b0, zero));
+		__m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero));
+		__m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero), _mm_unpacklo_epi8(b1, zero));
+		__m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero));
+
+		// horizontal sums of neighbouring pixels
+		__m128i d01 = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+		__m128i d23 = _mm_add_epi16(_mm_unpacklo_epi64(s2, s3), _mm_unpackhi_epi64(s2, s3));
+
+		d01 = _mm_srli_epi16(_mm_add_epi16(d01, round), 2);
+		d23 = _mm_srli_epi16(_mm_add_epi16(d23, round), 2);
+
+		_mm_storeu_si128((__m128i*)(pDst + x), _mm_packus_epi16(d01, d23));
+	}
+
+	// remaining pixels, clamping at the right edge of 1 pixel wide images
+	for (; x < dst_width; x++)
+	{
+		UINT x0 = 2 * x;
+		UINT x1 = min(x0 + 1, src_width - 1);
+		pDst[x].rgbBlue = (BYTE)((pRow0[x0].rgbBlue + pRow0[x1].rgbBlue + pRow1[x0].rgbBlue + pRow1[x1].rgbBlue + 2) >> 2);
+		pDst[x].rgbGreen = (BYTE)((pRow0[x0].rgbGreen + pRow0[x1].rgbGreen + pRow1[x0].rgbGreen + pRow1[x1].rgbGreen + 2) >> 2);
+		pDst[x].rgbRed = (BYTE)((pRow0[x0].rgbRed + pRow0[x1].rgbRed + pRow1[x0].rgbRed + pRow1[x1].rgbRed + 2) >> 2);
+		pDst[x].rgbReserved = (BYTE)((pRow0[x0].rgbReserved + pRow0[x1].rgbReserved + pRow1[x0].rgbReserved + pRow1[x1].rgbReserved + 2) >> 2);
+	}
+}
+
+void CResizableImage::HalveImage(const RGBQUAD *pSrc, unsigned int width, unsigned int height, RGBQUAD *pDst)
+{
+	UINT dst_width = max(1u, width / 2);
+	UINT dst_height = max(1u, height / 2);
+
+	for (UINT y = 0; y < dst_height; y++)
+	{
+		UINT y0 = 2 * y;
+		UINT y1 = min(y0 + 1, height - 1);
+		HalveRows(&pSrc[y0 * width], &pSrc[y1 * width], width, &pDst[y * dst_width], dst_width);
+	}
+}
+
+void CResizableImage::BoxDownsample(unsigned int ratio)
+{
+	// 4x and 8x are successive 2x reductions, each one reading a quarter of the previous data
+	for (; ratio > 1; ratio /= 2)
+	{
+		UINT dst_width = width / 2;
+		UINT dst_height = height / 2;
+
+		m_pResImg = new RGBQUAD[dst_width * dst_height];
+		TrackAlloc(sizeof(RGBQUAD) * dst_width * dst_height);
+		HalveImage(m_pRGB, width, height, m_pResImg);
+
+		delete[] m_pRGB;
+		TrackFree(sizeof(RGBQUAD) * width * height);
+		m_pRGB = m_pResImg;
+		width = dst_width;
+		height = dst_height;
+	}
+
+	m_biInfo.biSizeImage = width * height * sizeof(RGBQUAD);
+
+	DeleteObject(m_hBMP);
+	m_hBMP = 0;
+}
+
+int CResizableImage::GenerateMipChain(CResizableImage **ppLevels, int iMaxLevels) const
+{
+	const CResizableImage *pPrev = this;
+	int iLevels = 0;
+
+	if (!m_pRGB)
+		return 0;
+
+	while (iLevels < iMaxLevels && (pPrev->width > 1 || pPrev->height > 1))
+	{
+		CResizableImage *pLevel = new CResizableImage();
+		pLevel->SetFilter(m_pFilter);
+		pLevel->Create(max(1L, (long)pPrev->width / 2), max(1L, (long)pPrev->height / 2));
+		HalveImage(pPrev->m_pRGB, pPrev->width, pPrev->height, pLevel->m_pRGB);
+
+		ppLevels[iLevels++] = pLevel;
+		pPrev = pLevel;
+	}
+
+	return iLevels;
+}
+
 void CResizableImage::Resample(unsigned dst_width, unsigned dst_height)
 {
+	// the source image is live for the whole call
+	m_uLiveBytes = m_uPeakBytes = 0;
+	TrackAlloc(sizeof(RGBQUAD) * width * height);
+
+	// integer ratio reductions with a box filter are plain block averages
+	unsigned ratio = dst_width ? width / dst_width : 0;
+	if ((ratio == 2 || ratio == 4 || ratio == 8) && dst_width * ratio == (unsigned)width && dst_height * ratio == (unsigned)height &&
+		(!m_pFilter || dynamic_cast<CBoxFilter*>(m_pFilter)))
+	{
+		BoxDownsample(ratio);
+		return;
+	}
+
 	// decide which filtering order (xy or yx) is faster for this mapping
 	if(dst_width * height <= dst_height * width) 
 	{
 		m_pResImg = new RGBQUAD[dst_width * height];
+		TrackAlloc(sizeof(RGBQUAD) * dst_width * height);
 
 		HorizontalFilter(dst_width, height);
 		
-		delete m_pRGB;
+		delete[] m_pRGB;
+		TrackFree(sizeof(RGBQUAD) * width * height);
 		m_pRGB = m_pResImg;
 		width = dst_width;
 		m_pResImg = new RGBQUAD[dst_width * dst_height];
+		TrackAlloc(sizeof(RGBQUAD) * dst_width * dst_height);
 
 		VerticalFilter(dst_width, dst_height);
 	} 
 	else 
 	{
 		m_pResImg = new RGBQUAD[width * dst_height];
+		TrackAlloc(sizeof(RGBQUAD) * width * dst_height);
 		VerticalFilter(width, dst_height);
 		
-		delete m_pRGB;
+		delete[] m_pRGB;
+		TrackFree(sizeof(RGBQUAD) * width * height);
 		m_pRGB = m_pResImg;
 		height = dst_height;
 		m_pResImg = new RGBQUAD[dst_width * dst_height];
+		TrackAlloc(sizeof(RGBQUAD) * dst_width * dst_height);
 
 		HorizontalFilter(dst_width, dst_height);
 	}
 
-	delete m_pRGB;
+	delete[] m_pRGB;
+	TrackFree(sizeof(RGBQUAD) * width * height);
 	m_pRGB = m_pResImg;
 	width = dst_width;
 	height = dst_height;
 
 	DeleteObject(m_hBMP);
 	m_hBMP = 0;
-}
\ No newline at end of file
+}
+
+void CResizableImage::FilterScanline(CWeightsTable *pWeights, const BYTE *pSrc, unsigned int bytes_per_pixel, unsigned int dst_width, float *pDst)
+{
+	for (UINT x = 0; x < dst_width; x++)
+	{
+		double b = 0, g = 0, r = 0;
+		int iLeft = pWeights->getLeftBoundary(x);
+		int iRight = pWeights->getRightBoundary(x);
+		for (int i = iLeft; i <= iRight; i++)
+		{
+			// BMP scanlines are stored as BGR(A)
+			const BYTE *px = pSrc + i * bytes_per_pixel;
+			double w = pWeights->getWeight(x, i - iLeft);
+			b += w * px[0];
+			g += w * px[1];
+			r += w * px[2];
+		}
+		pDst[x * 3 + 0] = (float)b;
+		pDst[x * 3 + 1] = (float)g;
+		pDst[x * 3 + 2] = (float)r;
+	}
+}
+
+static BYTE ClampToByte(float f)
+{
+	if (f <= 0.f)
+		return 0;
+	if (f >= 255.f)
+		return 255;
+	return (BYTE)(f + 0.5f);
+}
+
+bool CResizableImage::ResampleFile(const char *szSrcFile, const char *szDstFile, unsigned dst_width, unsigned dst_height)
+{
+	CMappedFile fin;
+	CBmpDecoder bmp;
+	FILE *fout = NULL;
+
+	if (!m_pFilter || !dst_width || !dst_height)
+		return false;
+
+	// the source is mapped, the OS pages in rows as they are decoded
+	if (!fin.Open(szSrcFile) || !bmp.Parse(fin.Data(), fin.Size()))
+		return false;
+
+	// the result is written next to the destination and renamed over it once
+	// complete, a failed run leaves no partial bitmap behind
+	char szTemp[MAX_PATH];
+	sprintf_s(szTemp, MAX_PATH, "%s.tmp", szDstFile);
+	if (fopen_s(&fout, szTemp, "wb") || !fout)
+		return false;
+
+	// rows are processed in file order, a top-down source gives a top-down result
+	unsigned int src_width = bmp.Width();
+	unsigned int src_height = bmp.Height();
+	unsigned int dst_stride = ((dst_width * 24 + 31) / 32) * 4;
+
+	BITMAPINFOHEADER biDst;
+	ZeroMemory(&biDst, sizeof(biDst));
+	biDst.biSize = sizeof(BITMAPINFOHEADER);
+	biDst.biWidth = dst_width;
+	biDst.biHeight = bmp.IsTopDown() ? -(LONG)dst_height : (LONG)dst_height;
+	biDst.biPlanes = 1;
+	biDst.biBitCount = 24;
+	biDst.biCompression = BI_RGB;
+	biDst.biSizeImage = dst_stride * dst_height;
+
+	BITMAPFILEHEADER bfDst;
+	ZeroMemory(&bfDst, sizeof(bfDst));
+	bfDst.bfType = 0x4D42;
+	bfDst.bfOffBits = sizeof(BITMAPFILEHEADER) + sizeof(BITMAPINFOHEADER);
+	bfDst.bfSize = bfDst.bfOffBits + biDst.biSizeImage;
+
+	bool bOk = fwrite(&bfDst, sizeof(bfDst), 1, fout) == 1 &&
+		fwrite(&biDst, sizeof(biDst), 1, fout) == 1;
+
+	CWeightsTable *pRowWeights = new CWeightsTable(m_pFilter, dst_width, src_width);
+	CWeightsTable *pColWeights = new CWeightsTable(m_pFilter, dst_height, src_height);
+
+	// sliding window of horizontally filtered source rows, indexed by row modulo window size
+	unsigned int window = pColWeights->getWindowSize();
+	float *pWindow = new float[window * dst_width * 3];
+	float *pAccum = new float[dst_width * 3];
+	uint32_t *pSrcRow = new uint32_t[src_width];
+	BYTE *pDstRow = new BYTE[dst_stride];
+	ZeroMemory(pDstRow, dst_stride);
+
+	int iNextRow = 0;	// next source row to be read from disk
+
+	for (UINT y = 0; y < dst_height && bOk; y++)
+	{
+		int iTop = pColWeights->getLeftBoundary(y);
+		int iBottom = pColWeights->getRightBoundary(y);
+
+		// decode source rows until the whole filter support is available
+		for (; iNextRow <= iBottom; iNextRow++)
+		{
+			bmp.DecodeRow(iNextRow, pSrcRow);
+			FilterScanline(pRowWeights, (const BYTE*)pSrcRow, sizeof(uint32_t), dst_width, &pWindow[(iNextRow % window) * dst_width * 3]);
+		}
+
+		ZeroMemory(pAccum, sizeof(float) * dst_width * 3);
+		for (int i = iTop; i <= iBottom; i++)
+		{
+			float w = (float)pColWeights->getWeight(y, i - iTop);
+			const float *pRow = &pWindow[(i % window) * dst_width * 3];
+			for (UINT x = 0; x < dst_width * 3; x++)
+				pAccum[x] += w * pRow[x];
+		}
+
+		// the destination scanline is complete, write it out
+		for (UINT x = 0; x < dst_width * 3; x++)
+			pDstRow[x] = ClampToByte(pAccum[x]);
+
+		if (fwrite(pDstRow, dst_stride, 1, fout) != 1)
+			bOk = false;
+	}
+
+	delete[] pDstRow;
+	delete[] pSrcRow;
+	delete[] pAccum;
+	delete[] pWindow;
+	delete pColWeights;
+	delete pRowWeights;
+
+	if (fclose(fout))
+		bOk = false;
+
+	if (bOk)
+		bOk = MoveFileEx(szTemp, szDstFile, MOVEFILE_REPLACE_EXISTING) != FALSE;
+	if (!bOk)
+		remove(szTemp);
+
+	return bOk;
+}
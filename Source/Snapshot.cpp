@@ -0,0 +1,50 @@
+//-----------------------------------------------------------------------------
+// File: Snapshot.cpp
+//
+// Desc: Entity state helpers of the world snapshot.
+//-----------------------------------------------------------------------------
+
+#include "Main.h"
+#include "Sprite.h"
+#include "Snapshot.h"
+
+//-----------------------------------------------------------------------------
+// Name : SaveEntityState () / LoadEntityState ()
+// Desc : Copy the state shared by every entity class to / from a record
+//-----------------------------------------------------------------------------
+void SaveEntityState(sEntityRecord& rec, const Sprite* pSprite, float fTimer, int iSpeedState,
+	int iExplosionFrame, bool bExplosion, bool bOut)
+{
+	ZeroMemory(&rec, sizeof(rec));
+	rec.dPosX = pSprite->mPosition.x;
+	rec.dPosY = pSprite->mPosition.y;
+	rec.dVelX = pSprite->mVelocity.x;
+	rec.dVelY = pSprite->mVelocity.y;
+	rec.fTimer = fTimer;
+	rec.iSpeedState = iSpeedState;
+	rec.iExplosionFrame = iExplosionFrame;
+	rec.bExplosion = bExplosion;
+	rec.bOut = bOut;
+}
+
+bool LoadEntityState(const sEntityRecord& rec, Sprite* pSprite, AnimatedSprite* pExplosionSprite, float& fTimer,
+	int iSpeedStart, int& iExplosionFrame, bool& bExplosion, bool* pbOut)
+{
+	pSprite->mPosition = Vec2(rec.dPosX, rec.dPosY);
+	pSprite->mVelocity = Vec2(rec.dVelX, rec.dVelY);
+	fTimer = rec.fTimer;
+	bExplosion = rec.bExplosion != 0;
+	iExplosionFrame = rec.iExplosionFrame;
+	if (iExplosionFrame < 0 || iExplosionFrame >= pExplosionSprite->GetFrameCount())
+		iExplosionFrame = 0;
+
+	// show the explosion frame that was on screen
+	pExplosionSprite->mPosition = pSprite->mPosition;
+	if (bExplosion)
+		pExplosionSprite->SetFrame(iExplosionFrame > 0 ? iExplosionFrame - 1 : 0);
+
+	if (pbOut)
+		*pbOut = rec.bOut != 0;
+
+	return rec.iSpeedState == iSpeedStart;
+}
@@ -0,0 +1,526 @@
+// SoundCache.cpp
+// Sound clips decoded once and played from memory
+#include "SoundCache.h"
+#include "AudioMixer.h"
+#include "AssetPack.h"
+#include "MappedFile.h"
+#include "Resampler.h"
+#include <ctype.h>
+#include <math.h>
+
+extern CAssetPack g_AssetPack;
+
+static const int s_iAdaptation[16] =
+{
+	230, 230, 230, 230, 307, 409, 512, 614,
+	768, 614, 512, 409, 307, 230, 230, 230
+};
+
+static UINT Read16(const BYTE *p) { return p[0] | (p[1] << 8); }
+static UINT Read32(const BYTE *p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((UINT)p[3] << 24); }
+
+static void Write16(BYTE *p, UINT v) { p[0] = (BYTE)v; p[1] = (BYTE)(v >> 8); }
+static void Write32(BYTE *p, UINT v) { Write16(p, v); Write16(p + 2, v >> 16); }
+
+static UINT HashBytes(const BYTE *pData, size_t uSize)
+{
+	UINT uHash = 2166136261u;
+	for(size_t i = 0; i < uSize; i++)
+		uHash = (uHash ^ pData[i]) * 16777619u;
+	return uHash;
+}
+
+// Expand MS ADPCM blocks to 16 bit samples. Each block starts with the
+// predictor, step and first two samples of every channel, the nibbles that
+// follow alternate between the channels. Returns the frames written.
+static UINT DecodeAdpcm(const BYTE *pSrc, UINT uSrcBytes, UINT uAlign, UINT uChannels, UINT uSamplesPerBlock,
+	const BYTE *pCoefs, UINT uCoefs, short *pDst, UINT uMaxFrames)
+{
+	UINT uHeader = 7 * uChannels;
+	UINT uFrames = 0;
+
+	while(uSrcBytes >= uHeader && uFrames < uMaxFrames)
+	{
+		UINT uBlock = uSrcBytes < uAlign ? uSrcBytes : uAlign;
+		int iCoef1[2], iCoef2[2], iDelta[2], iSample1[2], iSample2[2];
+
+		for(UINT c = 0; c < uChannels; c++)
+		{
+			UINT uPredictor = pSrc[c];
+			if(uPredictor >= uCoefs)
+				return uFrames;
+			iCoef1[c] = (short)Read16(pCoefs + uPredictor * 4);
+			iCoef2[c] = (short)Read16(pCoefs + uPredictor * 4 + 2);
+			iDelta[c] = (short)Read16(pSrc + uChannels + c * 2);
+			iSample1[c] = (short)Read16(pSrc + uChannels * 3 + c * 2);
+			iSample2[c] = (short)Read16(pSrc + uChannels * 5 + c * 2);
+		}
+
+		// the header samples come out oldest first
+		for(UINT f = 0; f < 2 && uFrames < uMaxFrames; f++, uFrames++)
+			for(UINT c = 0; c < uChannels; c++)
+				pDst[uFrames * uChannels + c] = (short)(f ? iSample1[c] : iSample2[c]);
+
+		UINT uBlockFrames = 2 + (uBlock - uHeader) * 2 / uChannels;
+		if(uBlockFrames > uSamplesPerBlock)
+			uBlockFrames = uSamplesPerBlock;
+
+		const BYTE *pNibbles = pSrc + uHeader;
+		UINT uNibble = 0;
+		for(UINT f = 2; f < uBlockFrames && uFrames < uMaxFrames; f++, uFrames++)
+		{
+			for(UINT c = 0; c < uChannels; c++, uNibble++)
+			{
+				int n = uNibble & 1 ? pNibbles[uNibble >> 1] & 15 : pNibbles[uNibble >> 1] >> 4;
+
+				int iSample = (iSample1[c] * iCoef1[c] + iSample2[c] * iCoef2[c]) >> 8;
+				iSample += ((n ^ 8) - 8) * iDelta[c];
+				if(iSample > 32767)
+					iSample = 32767;
+				else if(iSample < -32768)
+					iSample = -32768;
+
+				iSample2[c] = iSample1[c];
+				iSample1[c] = iSample;
+				iDelta[c] = (s_iAdaptation[n] * iDelta[c]) >> 8;
+				if(iDelta[c] < 16)
+					iDelta[c] = 16;
+
+				pDst[uFrames * uChannels + c] = (short)iSample;
+			}
+		}
+
+		pSrc += uBlock;
+		uSrcBytes -= uBlock;
+	}
+
+	return uFrames;
+}
+
+// RMS of all samples, the mixer ranks voices by it
+static UINT MeasureLoudness(const sSoundClip &clip)
+{
+	UINT uSamples = clip.uFrames * clip.wfx.nChannels;
+	double dSum = 0;
+
+	for(UINT i = 0; i < uSamples; i++)
+	{
+		int iSample = clip.wfx.wBitsPerSample == 8 ? ((int)clip.pPcm[i] - 128) * 256 : ((const short*)clip.pPcm)[i];
+		dSum += (double)iSample * iSample;
+	}
+
+	return uSamples ? (UINT)sqrt(dSum / uSamples) : 0;
+}
+
+// Fill in the format of the samples in clip.image and write the header that
+// makes the image a plain PCM file PlaySound can play from memory
+static void FinishClip(sSoundClip &clip, UINT uChannels, UINT uRate, UINT uBits, UINT uFrames)
+{
+	UINT uAlign = uChannels * uBits / 8;
+
+	ZeroMemory(&clip.wfx, sizeof(clip.wfx));
+	clip.wfx.wFormatTag = WAVE_FORMAT_PCM;
+	clip.wfx.nChannels = (WORD)uChannels;
+	clip.wfx.nSamplesPerSec = uRate;
+	clip.wfx.nBlockAlign = (WORD)uAlign;
+	clip.wfx.nAvgBytesPerSec = uRate * uAlign;
+	clip.wfx.wBitsPerSample = (WORD)uBits;
+
+	clip.uFrames = uFrames;
+	clip.uPcmBytes = uFrames * uAlign;
+	clip.pPcm = &clip.image[WAV_HEADER_SIZE];
+	clip.uLoudness = MeasureLoudness(clip);
+
+	BYTE *pHeader = &clip.image[0];
+	memcpy(pHeader, "RIFF", 4);
+	Write32(pHeader + 4, WAV_HEADER_SIZE - 8 + clip.uPcmBytes);
+	memcpy(pHeader + 8, "WAVEfmt ", 8);
+	Write32(pHeader + 16, 16);
+	Write16(pHeader + 20, WAVE_FORMAT_PCM);
+	Write16(pHeader + 22, uChannels);
+	Write32(pHeader + 24, uRate);
+	Write32(pHeader + 28, uRate * uAlign);
+	Write16(pHeader + 32, uAlign);
+	Write16(pHeader + 34, uBits);
+	memcpy(pHeader + 36, "data", 4);
+	Write32(pHeader + 40, clip.uPcmBytes);
+}
+
+bool CSoundCache::Decode(const BYTE *pData, size_t uSize, sSoundClip &clip)
+{
+	if(uSize < 12 || memcmp(pData, "RIFF", 4) || memcmp(pData + 8, "WAVE", 4))
+		return false;
+
+	const BYTE *pFmt = NULL;
+	const BYTE *pSamples = NULL;
+	UINT uFmtBytes = 0;
+	UINT uSampleBytes = 0;
+	UINT uFactFrames = 0;
+
+	// a chunk running past the end of a truncated file keeps what is there
+	for(size_t uPos = 12; uPos + 8 <= uSize; )
+	{
+		size_t uChunk = Read32(pData + uPos + 4);
+		const BYTE *pChunk = pData + uPos + 8;
+		if(uChunk > uSize - uPos - 8)
+			uChunk = uSize - uPos - 8;
+
+		if(!memcmp(pData + uPos, "fmt ", 4))
+		{
+			pFmt = pChunk;
+			uFmtBytes = (UINT)uChunk;
+		}
+		else if(!memcmp(pData + uPos, "data", 4))
+		{
+			pSamples = pChunk;
+			uSampleBytes = (UINT)uChunk;
+		}
+		else if(!memcmp(pData + uPos, "fact", 4) && uChunk >= 4)
+			uFactFrames = Read32(pChunk);
+
+		uPos += 8 + uChunk + (uChunk & 1);
+	}
+
+	if(!pFmt || uFmtBytes < 16 || !pSamples)
+		return false;
+
+	UINT uTag = Read16(pFmt);
+	UINT uChannels = Read16(pFmt + 2);
+	UINT uRate = Read32(pFmt + 4);
+	UINT uAlign = Read16(pFmt + 12);
+	UINT uBits = Read16(pFmt + 14);
+	if(uChannels < 1 || uChannels > 2 || !uRate || !uAlign)
+		return false;
+
+	UINT uFrames;
+	if(uTag == WAVE_FORMAT_PCM)
+	{
+		if((uBits != 8 && uBits != 16) || uAlign != uChannels * uBits / 8)
+			return false;
+
+		uFrames = uSampleBytes / uAlign;
+		clip.image.resize(WAV_HEADER_SIZE + uFrames * uAlign);
+		memcpy(&clip.image[WAV_HEADER_SIZE], pSamples, uFrames * uAlign);
+	}
+	else if(uTag == WAVE_FORMAT_ADPCM)
+	{
+		// cbSize, samples per block, the coefficient count and the coefficients
+		if(uFmtBytes < 22 || uAlign < 7 * uChannels)
+			return false;
+		UINT uSamplesPerBlock = Read16(pFmt + 18);
+		UINT uCoefs = Read16(pFmt + 20);
+		if(!uCoefs || uSamplesPerBlock < 2 || uFmtBytes < 22 + uCoefs * 4)
+			return false;
+
+		uBits = 16;
+		uFrames = (uSampleBytes + uAlign - 1) / uAlign * uSamplesPerBlock;
+		if(uFactFrames && uFactFrames < uFrames)
+			uFrames = uFactFrames;
+
+		clip.image.resize(WAV_HEADER_SIZE + uFrames * uChannels * 2);
+		uFrames = DecodeAdpcm(pSamples, uSampleBytes, uAlign, uChannels, uSamplesPerBlock, pFmt + 22, uCoefs,
+			(short*)&clip.image[WAV_HEADER_SIZE], uFrames);
+		uAlign = uChannels * 2;
+		clip.image.resize(WAV_HEADER_SIZE + uFrames * uAlign);
+	}
+	else
+		return false;
+
+	if(!uFrames)
+		return false;
+
+	FinishClip(clip, uChannels, uRate, uBits, uFrames);
+
+	return true;
+}
+
+bool CSoundCache::Convert(sSoundClip &clip, UINT uRate)
+{
+	UINT uChannels = clip.wfx.nChannels;
+	UINT uInFrames = clip.uFrames;
+	UINT uInRate = clip.wfx.nSamplesPerSec;
+	if(!uRate || !uInFrames)
+		return false;
+	if(uInRate == uRate && clip.wfx.wBitsPerSample == 16)
+		return true;
+
+	std::vector<float> in(uInFrames * uChannels);
+	if(clip.wfx.wBitsPerSample == 8)
+		ByteToFloat(clip.pPcm, &in[0], (UINT)in.size());
+	else
+		ShortToFloat((const short*)clip.pPcm, &in[0], (UINT)in.size());
+
+	// each channel on its own, written back interleaved
+	UINT uOutFrames = uInFrames;
+	std::vector<float> out;
+	if(uInRate == uRate)
+		out.swap(in);
+	else
+	{
+		CResampler resampler;
+		if(!resampler.Init(uInRate, uRate))
+			return false;
+
+		uOutFrames = resampler.OutputFrames(uInFrames);
+		out.resize(uOutFrames * uChannels);
+		std::vector<float> channel(uInFrames);
+
+		for(UINT c = 0; c < uChannels; c++)
+		{
+			for(UINT i = 0; i < uInFrames; i++)
+				channel[i] = in[i * uChannels + c];
+			resampler.Process(&channel[0], uInFrames, &out[c], uChannels);
+		}
+	}
+
+	std::vector<BYTE> image(WAV_HEADER_SIZE + uOutFrames * uChannels * sizeof(short));
+	FloatToShort(&out[0], (short*)&image[WAV_HEADER_SIZE], uOutFrames * uChannels);
+	clip.image.swap(image);
+	FinishClip(clip, uChannels, uRate, 16, uOutFrames);
+
+	return true;
+}
+
+CSoundCache::CSoundCache()
+{
+	ZeroMemory(&m_Stats, sizeof(m_Stats));
+	m_uRate = 0;
+	m_szCacheDir[0] = 0;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&m_iFrequency);
+}
+
+CSoundCache::~CSoundCache()
+{
+	Clear();
+}
+
+void CSoundCache::MakeKey(const char *szFileName, char *szKey)
+{
+	size_t i = 0;
+
+	for(; szFileName[i] && i < MAX_PATH - 1; i++)
+		szKey[i] = szFileName[i] == '\\' ? '/' : (char)tolower((unsigned char)szFileName[i]);
+	szKey[i] = 0;
+}
+
+void CSoundCache::SetConversion(UINT uRate, const char *szCacheDir)
+{
+	m_uRate = uRate;
+	strcpy_s(m_szCacheDir, MAX_PATH, szCacheDir ? szCacheDir : "");
+}
+
+// "data/explosion.wav" is cached as <dir>/data_explosion.wav.cache
+void CSoundCache::MakeCachePath(const char *szKey, char *szPath) const
+{
+	sprintf_s(szPath, MAX_PATH, "%s/%s.cache", m_szCacheDir, szKey);
+	for(char *p = szPath + strlen(m_szCacheDir) + 1; *p; p++)
+		if(*p == '/')
+			*p = '_';
+}
+
+// Decode a file and convert it to the conversion rate, or take the result of
+// an earlier run from the cache when the file has not changed since
+bool CSoundCache::LoadConverted(const char *szKey, const BYTE *pData, size_t uSize, sSoundClip &clip)
+{
+	sSoundCacheHeader header = { SOUND_CACHE_MAGIC, SOUND_CACHE_VERSION, m_uRate, (uint32_t)uSize, HashBytes(pData, uSize) };
+	char szPath[MAX_PATH];
+
+	if(m_szCacheDir[0])
+	{
+		MakeCachePath(szKey, szPath);
+
+		// the size check catches a file cut short while it was written
+		CMappedFile cache;
+		if(cache.Open(szPath) && cache.Size() > sizeof(header) && !memcmp(cache.Data(), &header, sizeof(header)) &&
+			Decode(cache.Data() + sizeof(header), cache.Size() - sizeof(header), clip) &&
+			clip.wfx.nSamplesPerSec == m_uRate && clip.wfx.wBitsPerSample == 16 &&
+			cache.Size() == sizeof(header) + clip.image.size())
+		{
+			m_Stats.uCacheHits++;
+			return true;
+		}
+	}
+
+	if(!Decode(pData, uSize, clip))
+		return false;
+	if(clip.wfx.nSamplesPerSec == m_uRate && clip.wfx.wBitsPerSample == 16)
+		return true;
+	if(!Convert(clip, m_uRate))
+		return false;
+	m_Stats.uConverted++;
+
+	// a failed write only means converting again next time
+	FILE *fout;
+	if(m_szCacheDir[0])
+	{
+		CreateDirectory(m_szCacheDir, NULL);
+		if(!fopen_s(&fout, szPath, "wb") && fout)
+		{
+			bool bOk = fwrite(&header, sizeof(header), 1, fout) == 1 &&
+				fwrite(&clip.image[0], 1, clip.image.size(), fout) == clip.image.size();
+			fclose(fout);
+			if(!bOk)
+				DeleteFile(szPath);
+		}
+	}
+
+	return true;
+}
+
+const sSoundClip* CSoundCache::Load(const char *szFileName)
+{
+	char szKey[MAX_PATH];
+	MakeKey(szFileName, szKey);
+
+	// files that failed stay in the map without a clip
+	std::map<std::string, sSoundClip*>::iterator it = m_Clips.find(szKey);
+	if(it != m_Clips.end())
+		return it->second;
+
+	__int64 iStart, iEnd;
+	QueryPerformanceCounter((LARGE_INTEGER*)&iStart);
+
+	const uint8_t *pData;
+	size_t uSize;
+	CMappedFile file;
+	sSoundClip *pClip = NULL;
+
+	bool bFound = g_AssetPack.Find(szFileName, &pData, &uSize);
+	if(!bFound && file.Open(szFileName))
+	{
+		pData = file.Data();
+		uSize = file.Size();
+		bFound = true;
+	}
+
+	if(bFound)
+	{
+		pClip = new sSoundClip;
+		if(m_uRate ? LoadConverted(szKey, pData, uSize, *pClip) : Decode(pData, uSize, *pClip))
+		{
+			strcpy_s(pClip->szName, MAX_PATH, szKey);
+			pClip->uFileBytes = (UINT)uSize;
+
+			m_Stats.uClips++;
+			m_Stats.uPcmBytes += (UINT)pClip->image.size();
+			m_Stats.uFileBytes += pClip->uFileBytes;
+		}
+		else
+		{
+			delete pClip;
+			pClip = NULL;
+		}
+	}
+
+	m_Clips[szKey] = pClip;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&iEnd);
+	m_Stats.fLoadMs += float((iEnd - iStart) * 1000.0 / m_iFrequency);
+
+	return pClip;
+}
+
+const sSoundClip* CSoundCache::Find(const char *szFileName) const
+{
+	char szKey[MAX_PATH];
+	MakeKey(szFileName, szKey);
+
+	std::map<std::string, sSoundClip*>::const_iterator it = m_Clips.find(szKey);
+	return it != m_Clips.end() ? it->second : NULL;
+}
+
+const sSoundClip* CSoundCache::Get(const char *szFileName)
+{
+	char szKey[MAX_PATH];
+	MakeKey(szFileName, szKey);
+
+	std::map<std::string, sSoundClip*>::iterator it = m_Clips.find(szKey);
+	if(it != m_Clips.end())
+		return it->second;
+
+	// not in the preload list, costs a file read this once
+	char szMessage[MAX_PATH + 32];
+	sprintf_s(szMessage, "Late sound load: %s\n", szFileName);
+	OutputDebugString(szMessage);
+
+	m_Stats.uLateLoads++;
+	return Load(szFileName);
+}
+
+BOOL CSoundCache::Play(const char *szFileName, DWORD fdwSound)
+{
+	const sSoundClip *pClip = Get(szFileName);
+
+	m_Stats.uPlays++;
+
+	// formats the decoder does not handle are left to PlaySound
+	if(!pClip)
+		return PlaySound(szFileName, NULL, SND_FILENAME | fdwSound);
+
+	return PlaySound((LPCSTR)&pClip->image[0], NULL, SND_MEMORY | fdwSound);
+}
+
+void CSoundCache::Clear()
+{
+	// an async sound may still be reading one of the clips
+	if(!m_Clips.empty())
+		PlaySound(NULL, NULL, 0);
+
+	for(std::map<std::string, sSoundClip*>::iterator it = m_Clips.begin(); it != m_Clips.end(); ++it)
+		delete it->second;
+	m_Clips.clear();
+
+	m_Stats.uClips = 0;
+	m_Stats.uPcmBytes = 0;
+	m_Stats.uFileBytes = 0;
+}
+
+void CSoundCache::GetStats(sSoundCacheStats &stats) const
+{
+	stats = m_Stats;
+}
+
+BOOL PlayAssetSound(const char *szFileName, DWORD fdwSound, int iPriority)
+{
+	// the mixer plays sounds on top of each other, PlaySound cuts off the
+	// last one and is only used when there is no mixer
+	if(g_AudioMixer.IsRunning())
+	{
+		const sSoundClip *pClip = g_SoundCache.Get(szFileName);
+		if(pClip)
+			return g_AudioMixer.Play(pClip, iPriority, (fdwSound & SND_LOOP) != 0);
+	}
+
+	return g_SoundCache.Play(szFileName, fdwSound);
+}
+
+static ULONG s_nStageWidth = 800;
+
+void SetSoundStage(ULONG nWidth)
+{
+	if(nWidth)
+		s_nStageWidth = nWidth;
+}
+
+BOOL PlayAssetSound(const char *szFileName, DWORD fdwSound, int iPriority, const Vec2 &position)
+{
+	if(!g_AudioMixer.IsRunning())
+		return g_SoundCache.Play(szFileName, fdwSound);
+
+	// -1 at the left edge to 1 at the right one, past an edge the sound
+	// fades out over half a screen
+	double dWidth = (double)s_nStageWidth;
+	double dPan = position.x / dWidth * 2.0 - 1.0;
+	double dOutside = position.x < 0 ? -position.x : position.x - dWidth;
+	double dGain = dOutside > 0 ? 1.0 - dOutside / (dWidth * 0.5) : 1.0;
+	if(dGain <= 0)
+		return TRUE;
+
+	// a clip that did not decode still plays, only without the panning
+	const sSoundClip *pClip = g_SoundCache.Get(szFileName);
+	if(!pClip)
+		return g_SoundCache.Play(szFileName, fdwSound);
+
+	return g_AudioMixer.Play(pClip, iPriority, (fdwSound & SND_LOOP) != 0,
+		(float)(dPan < -1.0 ? -1.0 : (dPan > 1.0 ? 1.0 : dPan)), (float)dGain);
+}
@@ -1,61 +1,62 @@
 #include "Sprite.h"
 
 extern HINSTANCE g_hInst;
+extern CAssetLoader g_AssetLoader;
 
 Sprite::Sprite(int imageID, int maskID)
 {
 	// Load the bitmap resources.
-	mhImage = LoadBitmap(g_hInst, MAKEINTRESOURCE(imageID));
-	mhMask = LoadBitmap(g_hInst, MAKEINTRESOURCE(maskID));
-
-	// Get the BITMAP structure for each of the bitmaps.
-	GetObject(mhImage, sizeof(BITMAP), &mImageBM);
-	GetObject(mhMask, sizeof(BITMAP), &mMaskBM);
+	mpImage = CBitmapAsset::FromBitmap(LoadBitmap(g_hInst, MAKEINTRESOURCE(imageID)));
+	mpMask = CBitmapAsset::FromBitmap(LoadBitmap(g_hInst, MAKEINTRESOURCE(maskID)));
 
 	// Image and Mask should be the same dimensions.
-	assert(mImageBM.bmWidth == mMaskBM.bmWidth);
-	assert(mImageBM.bmHeight == mMaskBM.bmHeight);	
+	assert(mpImage->Width() == mpMask->Width());
+	assert(mpImage->Height() == mpMask->Height());	
 
 	mcTransparentColor = 0;
-	mhSpriteDC = 0;
+	mpBackBuffer = NULL;
 }
 
 Sprite::Sprite(const char *szImageFile, const char *szMaskFile)
 {
-	mhImage = (HBITMAP)LoadImage(g_hInst, szImageFile, IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION | LR_LOADFROMFILE);
-	mhMask = (HBITMAP)LoadImage(g_hInst, szMaskFile, IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION | LR_LOADFROMFILE);
-
-	// Get the BITMAP structure for each of the bitmaps.
-	GetObject(mhImage, sizeof(BITMAP), &mImageBM);
-	GetObject(mhMask, sizeof(BITMAP), &mMaskBM);
-
-	// Image and Mask should be the same dimensions.
-	assert(mImageBM.bmWidth == mMaskBM.bmWidth);
-	assert(mImageBM.bmHeight == mMaskBM.bmHeight);
+	// Queue the bitmaps, they are decoded in the background
+	mpImage = g_AssetLoader.AcquireBitmap(szImageFile);
+	mpMask = g_AssetLoader.AcquireBitmap(szMaskFile);
 
 	mcTransparentColor = 0;
-	mhSpriteDC = 0;
+	mpBackBuffer = NULL;
 }
 
-Sprite::Sprite(const char *szImageFile, COLORREF crTransparentColor)
+Sprite::Sprite(const char *szImageFile, COLORREF crTransparentColor, int iStep, int iSteps)
 {
-	mhImage = (HBITMAP)LoadImage(g_hInst, szImageFile, IMAGE_BITMAP, 0, 0, LR_CREATEDIBSECTION | LR_LOADFROMFILE);
+	// Queue the bitmap, its transparency mask is built with it
+	mpImage = g_AssetLoader.AcquireBitmap(szImageFile, crTransparentColor, iStep, iSteps);
 
-	mhMask = 0;
-	mhSpriteDC = 0;
+	mpMask = NULL;
+	mpBackBuffer = NULL;
 	mcTransparentColor = crTransparentColor;
+}
 
-	// Get the BITMAP structure for the bitmap.
-	GetObject(mhImage, sizeof(BITMAP), &mImageBM);
+Sprite::Sprite(const Sprite& rhs)
+{
+	mpImage = rhs.mpImage;
+	mpImage->AddRef();
+	mpMask = rhs.mpMask;
+	if(mpMask)
+		mpMask->AddRef();
+
+	mPosition = rhs.mPosition;
+	mVelocity = rhs.mVelocity;
+	mpBackBuffer = rhs.mpBackBuffer;
+	mcTransparentColor = rhs.mcTransparentColor;
 }
 
 Sprite::~Sprite()
 {
 	// Free the resources we created in the constructor.
-	DeleteObject(mhImage);
-	DeleteObject(mhMask);
-
-	DeleteDC(mhSpriteDC);
+	mpImage->Release();
+	if(mpMask)
+		mpMask->Release();
 }
 
 void Sprite::update(float dt)
@@ -68,18 +69,18 @@ void Sprite::update(float dt)
 
 void Sprite::setBackBuffer(const BackBuffer *pBackBuffer)
 {
+	// the DCs the bitmaps are drawn from belong to the back buffer
 	mpBackBuffer = pBackBuffer;
-	if(mpBackBuffer)
-	{
-		DeleteDC(mhSpriteDC);
-		mhSpriteDC = CreateCompatibleDC(mpBackBuffer->getDC());
-	}
 }
 
 
 void Sprite::draw()
 {
-	if( mhMask != 0 )
+	// skip drawing until the bitmaps are loaded
+	if( !isLoaded() )
+		return;
+
+	if( mpMask != NULL )
 		drawMask();
 	else
 		drawTransparent();
@@ -91,6 +92,7 @@ void Sprite::drawMask()
 		return;
 
 	HDC hBackBufferDC = mpBackBuffer->getDC();
+	HDC hSpriteDC = mpBackBuffer->getSpriteDC();
 
 	// The position BitBlt wants is not the sprite's center
 	// position; rather, it wants the upper-left position,
@@ -106,24 +108,24 @@ void Sprite::drawMask()
 	// the backbuffer bitmap has been cleared to some
 	// non-zero value.
 	// Select the mask bitmap.
-	HGDIOBJ oldObj = SelectObject(mhSpriteDC, mhMask);
+	HGDIOBJ oldObj = SelectObject(hSpriteDC, mpMask->Bitmap());
 
 	// Draw the mask to the backbuffer with SRCAND. This
 	// only draws the black pixels in the mask to the backbuffer,
 	// thereby marking the pixels we want to draw the sprite
 	// image onto.
-	BitBlt(hBackBufferDC, x, y, w, h, mhSpriteDC, 0, 0, SRCAND);
+	BitBlt(hBackBufferDC, x, y, w, h, hSpriteDC, 0, 0, SRCAND);
 
 	// Now select the image bitmap.
-	SelectObject(mhSpriteDC, mhImage);
+	SelectObject(hSpriteDC, mpImage->Bitmap());
 
 	// Draw the image to the backbuffer with SRCPAINT. This
 	// will only draw the image onto the pixels that where previously
 	// marked black by the mask.
-	BitBlt(hBackBufferDC, x, y, w, h, mhSpriteDC, 0, 0, SRCPAINT);
+	BitBlt(hBackBufferDC, x, y, w, h, hSpriteDC, 0, 0, SRCPAINT);
 
 	// Restore the original bitmap object.
-	SelectObject(mhSpriteDC, oldObj);
+	SelectObject(hSpriteDC, oldObj);
 }
 
 void Sprite::drawTransparent()
@@ -142,36 +144,23 @@ void Sprite::drawTransparent()
 
 	COLORREF crOldBack = SetBkColor(hBackBuffer, RGB(255, 255, 255));
 	COLORREF crOldText = SetTextColor(hBackBuffer, RGB(0, 0, 0));
-	HDC dcImage, dcTrans;
-
-	// Create two memory dcs for the image and the mask
-	dcImage=CreateCompatibleDC(hBackBuffer);
-	dcTrans=CreateCompatibleDC(hBackBuffer);
 
-	// Select the image into the appropriate dc
-	SelectObject(dcImage, mhImage);
+	// The sprite dc holds the image, the mask dc the cached mask (built from
+	// the transparent colour when the bitmap was loaded)
+	HDC hSpriteDC = mpBackBuffer->getSpriteDC();
+	HDC dcTrans = mpBackBuffer->getMaskDC();
 
-	// Create the mask bitmap
-	BITMAP bitmap;
-	GetObject(mhImage, sizeof(BITMAP), &bitmap);
-	HBITMAP bitmapTrans = CreateBitmap(bitmap.bmWidth, bitmap.bmHeight, 1, 1, NULL);
-
-	// Select the mask bitmap into the appropriate dc
-	SelectObject(dcTrans, bitmapTrans);
-
-	// Build mask based on transparent color
-	SetBkColor(dcImage, mcTransparentColor);
-	BitBlt(dcTrans, 0, 0, bitmap.bmWidth, bitmap.bmHeight, dcImage, 0, 0, SRCCOPY);
+	HGDIOBJ oldImage = SelectObject(hSpriteDC, mpImage->Bitmap());
+	HGDIOBJ oldTrans = SelectObject(dcTrans, mpImage->TransparencyMask());
 
 	// Do the work - True Mask method - cool if not actual display
-	BitBlt(hBackBuffer, x, y, bitmap.bmWidth, bitmap.bmHeight, dcImage, 0, 0, SRCINVERT);
-	BitBlt(hBackBuffer, x, y, bitmap.bmWidth, bitmap.bmHeight, dcTrans, 0, 0, SRCAND);
-	BitBlt(hBackBuffer, x, y, bitmap.bmWidth, bitmap.bmHeight, dcImage, 0, 0, SRCINVERT);
+	BitBlt(hBackBuffer, x, y, w, h, hSpriteDC, 0, 0, SRCINVERT);
+	BitBlt(hBackBuffer, x, y, w, h, dcTrans, 0, 0, SRCAND);
+	BitBlt(hBackBuffer, x, y, w, h, hSpriteDC, 0, 0, SRCINVERT);
 
 	// free memory	
-	DeleteDC(dcImage);
-	DeleteDC(dcTrans);
-	DeleteObject(bitmapTrans);
+	SelectObject(hSpriteDC, oldImage);
+	SelectObject(dcTrans, oldTrans);
 
 	// Restore settings
 	SetBkColor(hBackBuffer, crOldBack);
@@ -203,7 +192,7 @@ void AnimatedSprite::SetFrame(int iIndex)
 
 void AnimatedSprite::draw()
 {
-	if( mpBackBuffer == NULL )
+	if( mpBackBuffer == NULL || !isLoaded() )
 		return;
 
 	// The position BitBlt wants is not the sprite's center
@@ -213,6 +202,7 @@ void AnimatedSprite::draw()
 	int h = miFrameHeight;
 
 	HDC hBackBufferDC = mpBackBuffer->getDC();
+	HDC hSpriteDC = mpBackBuffer->getSpriteDC();
 
 	// Upper-left corner.
 	int x = (int)mPosition.x - (w / 2);
@@ -222,24 +212,24 @@ void AnimatedSprite::draw()
 	// the backbuffer bitmap has been cleared to some
 	// non-zero value.
 	// Select the mask bitmap.
-	HGDIOBJ oldObj = SelectObject(mhSpriteDC, mhMask);
+	HGDIOBJ oldObj = SelectObject(hSpriteDC, mpMask->Bitmap());
 
 	// Draw the mask to the backbuffer with SRCAND. This
 	// only draws the black pixels in the mask to the backbuffer,
 	// thereby marking the pixels we want to draw the sprite
 	// image onto.
-	BitBlt(hBackBufferDC, x, y, w, h, mhSpriteDC, mptFrameCrop.x, mptFrameCrop.y, SRCAND);
+	BitBlt(hBackBufferDC, x, y, w, h, hSpriteDC, mptFrameCrop.x, mptFrameCrop.y, SRCAND);
 
 	// Now select the image bitmap.
-	SelectObject(mhSpriteDC, mhImage);
+	SelectObject(hSpriteDC, mpImage->Bitmap());
 
 	// Draw the image to the backbuffer with SRCPAINT. This
 	// will only draw the image onto the pixels that where previously
 	// marked black by the mask.
-	BitBlt(hBackBufferDC, x, y, w, h, mhSpriteDC, mptFrameCrop.x, mptFrameCrop.y, SRCPAINT);
+	BitBlt(hBackBufferDC, x, y, w, h, hSpriteDC, mptFrameCrop.x, mptFrameCrop.y, SRCPAINT);
 
 	// Restore the original bitmap object.
-	SelectObject(mhSpriteDC, oldObj);
+	SelectObject(hSpriteDC, oldObj);
 }
 
 
@@ -0,0 +1,124 @@
+// SpscQueueTest.cpp
+// Stress test of CSpscQueue
+#include "SpscQueueTest.h"
+#include "SpscQueue.h"
+#include "AllocCounter.h"
+#include "Main.h"
+
+#define SPSC_TEST_ITEMS		2000000
+#define SPSC_TEST_SIZE		256		// small, so the queue is full and empty often
+
+typedef struct
+{
+	CSpscQueue<UINT, SPSC_TEST_SIZE> Queue;
+	HANDLE hStart;			// manual reset, both threads begin together
+	UINT uOutOfOrder;
+	UINT uFirstBad;			// index of the first item out of order
+} sSpscTest;
+
+static DWORD WINAPI ProducerProc(LPVOID lpParam)
+{
+	sSpscTest *pTest = (sSpscTest*)lpParam;
+	WaitForSingleObject(pTest->hStart, INFINITE);
+
+	// a full or empty queue hands over the core, the two threads may share one
+	for(UINT i = 0; i < SPSC_TEST_ITEMS; i++)
+		while(!pTest->Queue.Push(i))
+			SwitchToThread();
+
+	return 0;
+}
+
+static DWORD WINAPI ConsumerProc(LPVOID lpParam)
+{
+	sSpscTest *pTest = (sSpscTest*)lpParam;
+	WaitForSingleObject(pTest->hStart, INFINITE);
+
+	for(UINT i = 0; i < SPSC_TEST_ITEMS; i++)
+	{
+		UINT uItem;
+		while(!pTest->Queue.Pop(uItem))
+			SwitchToThread();
+
+		if(uItem != i && !pTest->uOutOfOrder++)
+			pTest->uFirstBad = i;
+	}
+
+	return 0;
+}
+
+// static, the queue is too large for the stack and must not come from new
+static sSpscTest s_Test;
+
+bool RunSpscQueueTest(const char *szReportFile)
+{
+	FILE *fout = NULL;
+	if(fopen_s(&fout, szReportFile, "w") || !fout)
+		return false;
+
+	std::atomic<unsigned int> index(0);
+	bool bLockFree = index.is_lock_free();
+
+	s_Test.uOutOfOrder = 0;
+	s_Test.uFirstBad = 0;
+	s_Test.hStart = CreateEvent(NULL, TRUE, FALSE, NULL);
+	if(!s_Test.hStart)
+	{
+		fprintf(fout, "FAILED: could not create the start event\n");
+		fclose(fout);
+		return false;
+	}
+
+	// suspended, a thread without its partner would wait for it forever and
+	// is stopped before it has run
+	HANDLE hThreads[2];
+	hThreads[0] = CreateThread(NULL, 0, ProducerProc, &s_Test, CREATE_SUSPENDED, NULL);
+	hThreads[1] = CreateThread(NULL, 0, ConsumerProc, &s_Test, CREATE_SUSPENDED, NULL);
+	if(!hThreads[0] || !hThreads[1])
+	{
+		for(int i = 0; i < 2; i++)
+		{
+			if(!hThreads[i])
+				continue;
+			TerminateThread(hThreads[i], 1);
+			CloseHandle(hThreads[i]);
+		}
+		CloseHandle(s_Test.hStart);
+
+		fprintf(fout, "FAILED: could not start the threads\n");
+		fclose(fout);
+		return false;
+	}
+	ResumeThread(hThreads[0]);
+	ResumeThread(hThreads[1]);
+
+	// only the two threads run between the readings
+	__int64 freq, t0, t1;
+	QueryPerformanceFrequency((LARGE_INTEGER*)&freq);
+	LONG lAllocations = GetAllocationCount();
+	QueryPerformanceCounter((LARGE_INTEGER*)&t0);
+
+	SetEvent(s_Test.hStart);
+	WaitForMultipleObjects(2, hThreads, TRUE, INFINITE);
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&t1);
+	lAllocations = GetAllocationCount() - lAllocations;
+
+	CloseHandle(hThreads[0]);
+	CloseHandle(hThreads[1]);
+	CloseHandle(s_Test.hStart);
+
+	bool bPassed = bLockFree && !s_Test.uOutOfOrder && !lAllocations;
+
+	fprintf(fout, "items           %u through %u slots\n", SPSC_TEST_ITEMS, SPSC_TEST_SIZE);
+	fprintf(fout, "time            %.1f ms\n", double(t1 - t0) * 1000.0 / freq);
+	fprintf(fout, "lock free       %s\n", bLockFree ? "yes" : "no");
+	fprintf(fout, "out of order    %u", s_Test.uOutOfOrder);
+	if(s_Test.uOutOfOrder)
+		fprintf(fout, " (first at item %u)", s_Test.uFirstBad);
+	fprintf(fout, "\nallocations     %ld\n", lAllocations);
+	fprintf(fout, "%s\n", bPassed ? "PASSED" : "FAILED");
+
+	fclose(fout);
+	return bPassed;
+}
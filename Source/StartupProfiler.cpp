@@ -0,0 +1,133 @@
+// StartupProfiler.cpp
+// Timeline of the start of the game
+#include "StartupProfiler.h"
+
+CStartupProfiler::CStartupProfiler()
+{
+	InitializeCriticalSection(&m_cs);
+	QueryPerformanceFrequency((LARGE_INTEGER*)&m_iFrequency);
+	QueryPerformanceCounter((LARGE_INTEGER*)&m_iStart);
+	m_iFirstFrame = 0;
+	m_bRecording = false;
+	m_iDepth = 0;
+}
+
+CStartupProfiler::~CStartupProfiler()
+{
+	DeleteCriticalSection(&m_cs);
+}
+
+void CStartupProfiler::Start()
+{
+	QueryPerformanceCounter((LARGE_INTEGER*)&m_iStart);
+	m_iFirstFrame = 0;
+	m_bRecording = true;
+	m_iDepth = 0;
+	m_Phases.clear();
+	m_Assets.clear();
+}
+
+void CStartupProfiler::BeginPhase(const char *szName)
+{
+	if(!m_bRecording || m_iDepth >= STARTUP_MAX_DEPTH)
+		return;
+
+	sPhase phase;
+	strncpy_s(phase.szName, sizeof(phase.szName), szName, _TRUNCATE);
+	phase.iDepth = m_iDepth;
+	QueryPerformanceCounter((LARGE_INTEGER*)&phase.iStart);
+	phase.iEnd = phase.iStart;
+
+	m_iOpen[m_iDepth++] = (int)m_Phases.size();
+	m_Phases.push_back(phase);
+}
+
+void CStartupProfiler::EndPhase()
+{
+	if(!m_bRecording || m_iDepth == 0)
+		return;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&m_Phases[m_iOpen[--m_iDepth]].iEnd);
+}
+
+void CStartupProfiler::RecordAsset(const char *szName, __int64 iQueued, __int64 iStarted, __int64 iDone, bool bOk)
+{
+	EnterCriticalSection(&m_cs);
+
+	if(m_bRecording)
+	{
+		sAssetLoad load;
+		strncpy_s(load.szName, MAX_PATH, szName, _TRUNCATE);
+		load.iQueued = iQueued;
+		load.iStarted = iStarted;
+		load.iDone = iDone;
+		load.dwThread = GetCurrentThreadId();
+		load.bOk = bOk;
+		m_Assets.push_back(load);
+	}
+	else
+	{
+		// loads after the first frame are the ones the preload missed
+		char szLine[MAX_PATH + 64];
+		sprintf_s(szLine, sizeof(szLine), "Late asset load: %s, %.2f ms\n", szName, ToMs(iDone - iQueued));
+		OutputDebugString(szLine);
+	}
+
+	LeaveCriticalSection(&m_cs);
+}
+
+void CStartupProfiler::FirstFrame()
+{
+	if(!m_bRecording)
+		return;
+
+	QueryPerformanceCounter((LARGE_INTEGER*)&m_iFirstFrame);
+
+	EnterCriticalSection(&m_cs);
+	m_bRecording = false;
+	LeaveCriticalSection(&m_cs);
+
+	WriteReport(STARTUP_REPORT_FILE);
+}
+
+bool CStartupProfiler::WriteReport(const char *szFileName)
+{
+	FILE *fout = NULL;
+	if(fopen_s(&fout, szFileName, "w") || !fout)
+		return false;
+
+	EnterCriticalSection(&m_cs);
+
+	fprintf(fout, "Startup profile\n\n");
+	if(m_iFirstFrame)
+		fprintf(fout, "Time to first frame: %.2f ms\n\n", ToMs(m_iFirstFrame - m_iStart));
+
+	fprintf(fout, "Phases            start ms    duration ms\n");
+	for(size_t i = 0; i < m_Phases.size(); i++)
+	{
+		const sPhase &phase = m_Phases[i];
+		fprintf(fout, "%*s%-*s %10.2f %14.2f\n", phase.iDepth * 2, "", 16 - phase.iDepth * 2, phase.szName,
+			ToMs(phase.iStart - m_iStart), ToMs(phase.iEnd - phase.iStart));
+	}
+
+	double dDecode = 0, dLast = 0;
+	fprintf(fout, "\nAssets                            queued ms   wait ms   decode ms   thread\n");
+	for(size_t i = 0; i < m_Assets.size(); i++)
+	{
+		const sAssetLoad &load = m_Assets[i];
+		fprintf(fout, "%-32s %10.2f %9.2f %11.2f %8lu%s\n", load.szName, ToMs(load.iQueued - m_iStart),
+			ToMs(load.iStarted - load.iQueued), ToMs(load.iDone - load.iStarted), load.dwThread,
+			load.bOk ? "" : "  failed");
+
+		dDecode += ToMs(load.iDone - load.iStarted);
+		if(ToMs(load.iDone - m_iStart) > dLast)
+			dLast = ToMs(load.iDone - m_iStart);
+	}
+	fprintf(fout, "\n%u assets, %.2f ms of decoding, the last one ready at %.2f ms\n",
+		(UINT)m_Assets.size(), dDecode, dLast);
+
+	LeaveCriticalSection(&m_cs);
+
+	fclose(fout);
+	return true;
+}